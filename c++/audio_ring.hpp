@@ -0,0 +1,149 @@
+/*
+ * Lock-free multi-channel audio ring buffer
+ * Copyright (C) 2012-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __AUDIO_RING_HPP__
+#define __AUDIO_RING_HPP__
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+
+// Single-producer/single-consumer ring for planar audio.
+// The writer is meant to be the JACK process thread, which only does memcpy's here.
+// When the reader falls behind, the frames that do not fit are dropped and counted.
+
+class AudioRing
+{
+public:
+    AudioRing()
+        : fBuffer(nullptr),
+          fChannels(0),
+          fSize(0),
+          fWritePos(0),
+          fReadPos(0),
+          fDroppedFrames(0) {}
+
+    ~AudioRing()
+    {
+        if (fBuffer != nullptr)
+            delete[] fBuffer;
+    }
+
+    // Must not be called while the writer or reader are running.
+    // The capacity is rounded up to a power of 2.
+    void setup(const uint32_t channels, const uint32_t minFrames)
+    {
+        if (fBuffer != nullptr)
+            delete[] fBuffer;
+
+        fSize = 1;
+        while (fSize < minFrames)
+            fSize *= 2;
+
+        fChannels = channels;
+        fBuffer   = (channels > 0) ? new float[fSize*channels] : nullptr;
+        fWritePos = 0;
+        fReadPos  = 0;
+        fDroppedFrames = 0;
+    }
+
+    uint32_t getChannels() const
+    {
+        return fChannels;
+    }
+
+    uint32_t getDroppedFrames() const
+    {
+        return fDroppedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Writer side, realtime safe. 'buffers' holds one pointer per channel.
+    uint32_t write(const float* const* const buffers, uint32_t frames)
+    {
+        if (fBuffer == nullptr)
+            return 0;
+
+        const uint32_t writePos = fWritePos.load(std::memory_order_relaxed);
+        const uint32_t space    = fSize - (writePos - fReadPos.load(std::memory_order_acquire));
+
+        if (frames > space)
+        {
+            fDroppedFrames.fetch_add(frames - space, std::memory_order_relaxed);
+            frames = space;
+        }
+
+        if (frames == 0)
+            return 0;
+
+        const uint32_t offset = writePos & (fSize-1);
+        const uint32_t first  = (frames < fSize-offset) ? frames : fSize-offset;
+
+        for (uint32_t i=0; i < fChannels; ++i)
+        {
+            float* const channel = fBuffer + i*fSize;
+
+            ::memcpy(channel+offset, buffers[i], sizeof(float)*first);
+
+            if (first < frames)
+                ::memcpy(channel, buffers[i]+first, sizeof(float)*(frames-first));
+        }
+
+        fWritePos.store(writePos+frames, std::memory_order_release);
+        return frames;
+    }
+
+    // Reader side. Copies up to 'maxFrames' into 'buffers', returns the number of frames read.
+    uint32_t read(float* const* const buffers, const uint32_t maxFrames)
+    {
+        if (fBuffer == nullptr)
+            return 0;
+
+        const uint32_t readPos   = fReadPos.load(std::memory_order_relaxed);
+        const uint32_t available = fWritePos.load(std::memory_order_acquire) - readPos;
+        const uint32_t frames    = (available < maxFrames) ? available : maxFrames;
+
+        if (frames == 0)
+            return 0;
+
+        const uint32_t offset = readPos & (fSize-1);
+        const uint32_t first  = (frames < fSize-offset) ? frames : fSize-offset;
+
+        for (uint32_t i=0; i < fChannels; ++i)
+        {
+            const float* const channel = fBuffer + i*fSize;
+
+            ::memcpy(buffers[i], channel+offset, sizeof(float)*first);
+
+            if (first < frames)
+                ::memcpy(buffers[i]+first, channel, sizeof(float)*(frames-first));
+        }
+
+        fReadPos.store(readPos+frames, std::memory_order_release);
+        return frames;
+    }
+
+private:
+    float*   fBuffer;
+    uint32_t fChannels;
+    uint32_t fSize;
+
+    std::atomic<uint32_t> fWritePos;
+    std::atomic<uint32_t> fReadPos;
+    std::atomic<uint32_t> fDroppedFrames;
+};
+
+#endif // __AUDIO_RING_HPP__
@@ -20,7 +20,10 @@
 
 #include "jackbridge/JackBridge.cpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -78,4 +81,425 @@ std::string jackbridge_status_get_error_string(const jack_status_t& status)
     return errorString;
 }
 
+// -----------------------------------------------------------------------------
+// Graph snapshots
+//
+// jackbridge_graph_snapshot() reads all clients, ports and connections in one go, into a
+// single allocation that is freed with jackbridge_graph_snapshot_free().
+// Names are stored once and referenced by offset (a port's short name points into its
+// full name, ports of the same type share the type name), ports by index.
+// Clients are sorted by name and ports by client, then short name, so that two snapshots
+// can be compared in a single pass by jackbridge_graph_diff().
+
+#define JACKBRIDGE_GRAPH_NONE 0xffffffff
+
+struct JackBridgeGraphClient {
+    uint32_t name;      // offset into the names
+    uint32_t firstPort;
+    uint32_t portCount;
+};
+
+struct JackBridgeGraphPort {
+    uint32_t name;      // full name, offset into the names
+    uint32_t shortName; // offset into the names
+    uint32_t type;      // offset into the names
+    uint32_t client;
+    int32_t  flags;
+    uint32_t firstConnection; // the ports it is connected to, sorted, in 'connections'
+    uint32_t connectionCount;
+};
+
+struct JackBridgeGraphSnapshot {
+    uint32_t clientCount, portCount, connectionCount;
+    const JackBridgeGraphClient* clients;
+    const JackBridgeGraphPort*   ports;
+    const uint32_t*              connections;
+    const char*                  names;
+
+    const char* getName(const uint32_t offset) const
+    {
+        return names + offset;
+    }
+
+    const char* getPortName(const uint32_t port) const
+    {
+        return names + ports[port].name;
+    }
+
+    bool isConnected(const uint32_t port, const uint32_t other) const
+    {
+        const uint32_t* const first(connections + ports[port].firstConnection);
+        return std::binary_search(first, first + ports[port].connectionCount, other);
+    }
+};
+
+// the order of ports in a snapshot: by client name, then short name
+static inline
+int jackbridge_graph_compare_port_names(const char* const a, const char* const b)
+{
+    const char* const sepA = std::strchr(a, ':');
+    const char* const sepB = std::strchr(b, ':');
+    const size_t lenA = (sepA != nullptr) ? size_t(sepA - a) : std::strlen(a);
+    const size_t lenB = (sepB != nullptr) ? size_t(sepB - b) : std::strlen(b);
+
+    if (const int ret = std::memcmp(a, b, std::min(lenA, lenB)))
+        return ret;
+    if (lenA != lenB)
+        return (lenA < lenB) ? -1 : 1;
+
+    return std::strcmp(a + lenA, b + lenB);
+}
+
+static inline
+bool jackbridge_graph_port_name_less(const char* const a, const char* const b)
+{
+    return jackbridge_graph_compare_port_names(a, b) < 0;
+}
+
+// index of a port in the snapshot, or JACKBRIDGE_GRAPH_NONE
+static inline
+uint32_t jackbridge_graph_find_port(const JackBridgeGraphSnapshot* const snapshot, const char* const name)
+{
+    uint32_t first = 0, last = snapshot->portCount;
+
+    while (first < last)
+    {
+        const uint32_t middle = first + (last - first) / 2;
+        const int ret = jackbridge_graph_compare_port_names(snapshot->getPortName(middle), name);
+
+        if (ret == 0)
+            return middle;
+
+        if (ret < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return JACKBRIDGE_GRAPH_NONE;
+}
+
+// One get_ports call, then a lookup per port and a connection query per output port.
+// Returns null if 'client' is null or on allocation failure.
+static inline
+JackBridgeGraphSnapshot* jackbridge_graph_snapshot(jack_client_t* const client)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    const char** const allPorts = jackbridge_get_ports(client, nullptr, nullptr, 0);
+
+    std::vector<const char*> portNames;
+
+    for (int i=0; allPorts != nullptr && allPorts[i] != nullptr; ++i)
+    {
+        if (std::strchr(allPorts[i], ':') != nullptr)
+            portNames.push_back(allPorts[i]);
+    }
+
+    std::sort(portNames.begin(), portNames.end(), jackbridge_graph_port_name_less);
+
+    std::vector<JackBridgeGraphClient> clients;
+    std::vector<JackBridgeGraphPort> graphPorts(portNames.size());
+    std::vector<jack_port_t*> ports(portNames.size(), nullptr);
+    std::map<std::string, uint32_t> types;
+    std::string names, clientName;
+
+    for (size_t i=0; i < portNames.size(); ++i)
+    {
+        const char* const name(portNames[i]);
+        const size_t clientNameSize = std::strchr(name, ':') - name;
+
+        // null if gone since get_ports, kept to not shift the indexes
+        jack_port_t* const port = ports[i] = jackbridge_port_by_name(client, name);
+
+        if (clients.size() == 0 || clientName.compare(0, std::string::npos, name, clientNameSize) != 0)
+        {
+            clientName.assign(name, clientNameSize);
+
+            JackBridgeGraphClient graphClient;
+            graphClient.name      = names.size();
+            graphClient.firstPort = i;
+            graphClient.portCount = 0;
+            clients.push_back(graphClient);
+
+            names.append(name, clientNameSize);
+            names.push_back('\0');
+        }
+
+        const char* const type = (port != nullptr) ? jackbridge_port_type(port) : nullptr;
+        const std::string typeName((type != nullptr) ? type : "");
+        std::map<std::string, uint32_t>::iterator it(types.find(typeName));
+
+        if (it == types.end())
+        {
+            it = types.insert(std::make_pair(typeName, uint32_t(names.size()))).first;
+            names.append(typeName);
+            names.push_back('\0');
+        }
+
+        JackBridgeGraphPort& graphPort(graphPorts[i]);
+        graphPort.name      = names.size();
+        graphPort.shortName = graphPort.name + clientNameSize + 1;
+        graphPort.type      = it->second;
+        graphPort.client    = clients.size() - 1;
+        graphPort.flags     = (port != nullptr) ? jackbridge_port_flags(port) : 0;
+        graphPort.firstConnection = 0;
+        graphPort.connectionCount = 0;
+
+        names.append(name);
+        names.push_back('\0');
+
+        ++clients.back().portCount;
+    }
+
+    // every connection has an output on one end, asking those is enough
+    std::vector<std::pair<uint32_t, uint32_t> > edges;
+
+    for (size_t i=0; i < ports.size(); ++i)
+    {
+        if (ports[i] == nullptr || (graphPorts[i].flags & JackPortIsOutput) == 0)
+            continue;
+
+        const char** const connections = jackbridge_port_get_all_connections(client, ports[i]);
+
+        for (int j=0; connections != nullptr && connections[j] != nullptr; ++j)
+        {
+            const std::vector<const char*>::const_iterator it(std::lower_bound(portNames.begin(), portNames.end(), connections[j], jackbridge_graph_port_name_less));
+
+            if (it == portNames.end() || jackbridge_graph_compare_port_names(*it, connections[j]) != 0)
+                continue;
+
+            const uint32_t other = it - portNames.begin();
+
+            edges.push_back(std::make_pair(uint32_t(i), other));
+            edges.push_back(std::make_pair(other, uint32_t(i)));
+        }
+
+        if (connections != nullptr)
+            jackbridge_free(connections);
+    }
+
+    if (allPorts != nullptr)
+        jackbridge_free(allPorts);
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    for (size_t i=0; i < edges.size(); ++i)
+    {
+        JackBridgeGraphPort& graphPort(graphPorts[edges[i].first]);
+
+        if (graphPort.connectionCount++ == 0)
+            graphPort.firstConnection = i;
+    }
+
+    // everything in one block, the snapshot first
+    const size_t clientsOffset     = sizeof(JackBridgeGraphSnapshot);
+    const size_t portsOffset       = clientsOffset + sizeof(JackBridgeGraphClient)*clients.size();
+    const size_t connectionsOffset = portsOffset   + sizeof(JackBridgeGraphPort)*graphPorts.size();
+    const size_t namesOffset       = connectionsOffset + sizeof(uint32_t)*edges.size();
+
+    char* const data = (char*)std::malloc(namesOffset + names.size() + 1);
+
+    if (data == nullptr)
+        return nullptr;
+
+    JackBridgeGraphClient* const snapshotClients   = (JackBridgeGraphClient*)(data + clientsOffset);
+    JackBridgeGraphPort*   const snapshotPorts     = (JackBridgeGraphPort*)(data + portsOffset);
+    uint32_t*              const snapshotConnections = (uint32_t*)(data + connectionsOffset);
+    char*                  const snapshotNames     = data + namesOffset;
+
+    if (clients.size() > 0)
+        std::memcpy(snapshotClients, &clients[0], sizeof(JackBridgeGraphClient)*clients.size());
+    if (graphPorts.size() > 0)
+        std::memcpy(snapshotPorts, &graphPorts[0], sizeof(JackBridgeGraphPort)*graphPorts.size());
+
+    for (size_t i=0; i < edges.size(); ++i)
+        snapshotConnections[i] = edges[i].second;
+
+    std::memcpy(snapshotNames, names.c_str(), names.size() + 1);
+
+    JackBridgeGraphSnapshot* const snapshot = (JackBridgeGraphSnapshot*)data;
+    snapshot->clientCount     = clients.size();
+    snapshot->portCount       = graphPorts.size();
+    snapshot->connectionCount = edges.size();
+    snapshot->clients         = snapshotClients;
+    snapshot->ports           = snapshotPorts;
+    snapshot->connections     = snapshotConnections;
+    snapshot->names           = snapshotNames;
+
+    return snapshot;
+}
+
+static inline
+void jackbridge_graph_snapshot_free(JackBridgeGraphSnapshot* const snapshot)
+{
+    std::free(snapshot);
+}
+
+// -----------------------------------------------------------------------------
+// Graph diffs
+
+enum JackBridgeGraphChange {
+    kJackBridgeGraphPortsDisconnected,
+    kJackBridgeGraphPortRemoved,
+    kJackBridgeGraphClientRemoved,
+    kJackBridgeGraphClientAdded,
+    kJackBridgeGraphPortAdded,
+    kJackBridgeGraphPortsConnected
+};
+
+// 'snapshot' is the old one for removals and disconnections, the new one otherwise; 'index'
+// is a client or port in it. For connections, 'index' is the output port and 'other' the
+// input one; 'other' is JACKBRIDGE_GRAPH_NONE for the rest.
+typedef void (*JackBridgeGraphDiffCallback)(JackBridgeGraphChange change, const JackBridgeGraphSnapshot* snapshot, uint32_t index, uint32_t other, void* arg);
+
+// matches items sorted the same way in both snapshots, by name
+template<typename Names>
+static inline
+void jackbridge_graph_match(const uint32_t oldCount, const uint32_t newCount, const Names& oldNames, const Names& newNames,
+                            std::vector<uint32_t>& oldToNew, std::vector<uint32_t>& newToOld)
+{
+    oldToNew.assign(oldCount, JACKBRIDGE_GRAPH_NONE);
+    newToOld.assign(newCount, JACKBRIDGE_GRAPH_NONE);
+
+    for (uint32_t i=0, j=0; i < oldCount && j < newCount;)
+    {
+        const int ret = oldNames(i, newNames(j));
+
+        if (ret < 0)
+        {
+            ++i;
+        }
+        else if (ret > 0)
+        {
+            ++j;
+        }
+        else
+        {
+            oldToNew[i] = j;
+            newToOld[j] = i;
+            ++i, ++j;
+        }
+    }
+}
+
+// Reports what changed from 'oldGraph' to 'newGraph', in an order that can be applied as-is:
+// disconnections, removed ports, removed clients, added clients, added ports, connections.
+// Either snapshot can be null, meaning an empty graph; 'callback' can be null as well.
+// Returns the number of changes.
+static inline
+uint32_t jackbridge_graph_diff(const JackBridgeGraphSnapshot* oldGraph, const JackBridgeGraphSnapshot* newGraph,
+                               const JackBridgeGraphDiffCallback callback, void* const arg)
+{
+    static const JackBridgeGraphSnapshot kEmpty = { 0, 0, 0, nullptr, nullptr, nullptr, "" };
+
+    if (oldGraph == nullptr)
+        oldGraph = &kEmpty;
+    if (newGraph == nullptr)
+        newGraph = &kEmpty;
+
+    std::vector<uint32_t> portOldToNew, portNewToOld, clientOldToNew, clientNewToOld;
+
+    struct PortName {
+        const JackBridgeGraphSnapshot* graph;
+        int operator()(const uint32_t port, const char* const name) const { return jackbridge_graph_compare_port_names(graph->getPortName(port), name); }
+        const char* operator()(const uint32_t port) const { return graph->getPortName(port); }
+    };
+    struct ClientName {
+        const JackBridgeGraphSnapshot* graph;
+        int operator()(const uint32_t client, const char* const name) const { return std::strcmp(graph->getName(graph->clients[client].name), name); }
+        const char* operator()(const uint32_t client) const { return graph->getName(graph->clients[client].name); }
+    };
+
+    const PortName   oldPorts   = { oldGraph }, newPorts   = { newGraph };
+    const ClientName oldClients = { oldGraph }, newClients = { newGraph };
+
+    jackbridge_graph_match(oldGraph->portCount, newGraph->portCount, oldPorts, newPorts, portOldToNew, portNewToOld);
+    jackbridge_graph_match(oldGraph->clientCount, newGraph->clientCount, oldClients, newClients, clientOldToNew, clientNewToOld);
+
+    uint32_t changes = 0;
+
+#define JACKBRIDGE_GRAPH_CHANGE(change, graph, index, other) \
+    ++changes;                                               \
+    if (callback != nullptr)                                 \
+        callback(change, graph, index, other, arg);
+
+    // connections are listed on both ends, only the output side is looked at
+    for (uint32_t i=0; i < oldGraph->portCount; ++i)
+    {
+        const JackBridgeGraphPort& port(oldGraph->ports[i]);
+
+        if ((port.flags & JackPortIsOutput) == 0)
+            continue;
+
+        for (uint32_t j=0; j < port.connectionCount; ++j)
+        {
+            const uint32_t other = oldGraph->connections[port.firstConnection + j];
+
+            if (portOldToNew[i] == JACKBRIDGE_GRAPH_NONE || portOldToNew[other] == JACKBRIDGE_GRAPH_NONE ||
+                ! newGraph->isConnected(portOldToNew[i], portOldToNew[other]))
+            {
+                JACKBRIDGE_GRAPH_CHANGE(kJackBridgeGraphPortsDisconnected, oldGraph, i, other)
+            }
+        }
+    }
+
+    for (uint32_t i=0; i < oldGraph->portCount; ++i)
+    {
+        if (portOldToNew[i] == JACKBRIDGE_GRAPH_NONE)
+        {
+            JACKBRIDGE_GRAPH_CHANGE(kJackBridgeGraphPortRemoved, oldGraph, i, JACKBRIDGE_GRAPH_NONE)
+        }
+    }
+
+    for (uint32_t i=0; i < oldGraph->clientCount; ++i)
+    {
+        if (clientOldToNew[i] == JACKBRIDGE_GRAPH_NONE)
+        {
+            JACKBRIDGE_GRAPH_CHANGE(kJackBridgeGraphClientRemoved, oldGraph, i, JACKBRIDGE_GRAPH_NONE)
+        }
+    }
+
+    for (uint32_t i=0; i < newGraph->clientCount; ++i)
+    {
+        if (clientNewToOld[i] == JACKBRIDGE_GRAPH_NONE)
+        {
+            JACKBRIDGE_GRAPH_CHANGE(kJackBridgeGraphClientAdded, newGraph, i, JACKBRIDGE_GRAPH_NONE)
+        }
+    }
+
+    for (uint32_t i=0; i < newGraph->portCount; ++i)
+    {
+        if (portNewToOld[i] == JACKBRIDGE_GRAPH_NONE)
+        {
+            JACKBRIDGE_GRAPH_CHANGE(kJackBridgeGraphPortAdded, newGraph, i, JACKBRIDGE_GRAPH_NONE)
+        }
+    }
+
+    for (uint32_t i=0; i < newGraph->portCount; ++i)
+    {
+        const JackBridgeGraphPort& port(newGraph->ports[i]);
+
+        if ((port.flags & JackPortIsOutput) == 0)
+            continue;
+
+        for (uint32_t j=0; j < port.connectionCount; ++j)
+        {
+            const uint32_t other = newGraph->connections[port.firstConnection + j];
+
+            if (portNewToOld[i] == JACKBRIDGE_GRAPH_NONE || portNewToOld[other] == JACKBRIDGE_GRAPH_NONE ||
+                ! oldGraph->isConnected(portNewToOld[i], portNewToOld[other]))
+            {
+                JACKBRIDGE_GRAPH_CHANGE(kJackBridgeGraphPortsConnected, newGraph, i, other)
+            }
+        }
+    }
+
+#undef JACKBRIDGE_GRAPH_CHANGE
+
+    return changes;
+}
+
 #endif // __JACK_UTILS_HPP__
@@ -16,6 +16,10 @@
 
 #include "JackBridge.hpp"
 
+#ifdef JACKBRIDGE_SIMULATE
+# include "JackBridgeSim.cpp"
+#else
+
 #if ! (defined(JACKBRIDGE_DIRECT) || defined(JACKBRIDGE_DUMMY))
 
 #include "JackBridgeLibUtils.hpp"
@@ -63,6 +67,9 @@ typedef jack_nframes_t (*jacksym_get_sample_rate)(jack_client_t*);
 typedef jack_nframes_t (*jacksym_get_buffer_size)(jack_client_t*);
 typedef float          (*jacksym_cpu_load)(jack_client_t*);
 
+typedef jack_nframes_t (*jacksym_frame_time)(const jack_client_t*);
+typedef jack_nframes_t (*jacksym_last_frame_time)(const jack_client_t*);
+
 typedef jack_port_t* (*jacksym_port_register)(jack_client_t*, const char*, const char*, unsigned long, unsigned long);
 typedef int          (*jacksym_port_unregister)(jack_client_t*, jack_port_t*);
 typedef void*        (*jacksym_port_get_buffer)(jack_port_t*, jack_nframes_t);
@@ -108,6 +115,7 @@ typedef void (*jacksym_free)(void*);
 typedef uint32_t (*jacksym_midi_get_event_count)(void*);
 typedef int      (*jacksym_midi_event_get)(jack_midi_event_t*, void*, uint32_t);
 typedef void     (*jacksym_midi_clear_buffer)(void*);
+typedef size_t   (*jacksym_midi_max_event_size)(void*);
 typedef int      (*jacksym_midi_event_write)(void*, jack_nframes_t, const jack_midi_data_t*, size_t);
 typedef jack_midi_data_t* (*jacksym_midi_event_reserve)(void*, jack_nframes_t, size_t);
 
@@ -173,6 +181,9 @@ struct JackBridge {
     jacksym_get_buffer_size get_buffer_size_ptr;
     jacksym_cpu_load cpu_load_ptr;
 
+    jacksym_frame_time frame_time_ptr;
+    jacksym_last_frame_time last_frame_time_ptr;
+
     jacksym_port_register port_register_ptr;
     jacksym_port_unregister port_unregister_ptr;
     jacksym_port_get_buffer port_get_buffer_ptr;
@@ -218,6 +229,7 @@ struct JackBridge {
     jacksym_midi_get_event_count midi_get_event_count_ptr;
     jacksym_midi_event_get midi_event_get_ptr;
     jacksym_midi_clear_buffer midi_clear_buffer_ptr;
+    jacksym_midi_max_event_size midi_max_event_size_ptr;
     jacksym_midi_event_write midi_event_write_ptr;
     jacksym_midi_event_reserve midi_event_reserve_ptr;
 
@@ -272,6 +284,8 @@ struct JackBridge {
           get_sample_rate_ptr(nullptr),
           get_buffer_size_ptr(nullptr),
           cpu_load_ptr(nullptr),
+          frame_time_ptr(nullptr),
+          last_frame_time_ptr(nullptr),
           port_register_ptr(nullptr),
           port_unregister_ptr(nullptr),
           port_get_buffer_ptr(nullptr),
@@ -308,6 +322,7 @@ struct JackBridge {
           midi_get_event_count_ptr(nullptr),
           midi_event_get_ptr(nullptr),
           midi_clear_buffer_ptr(nullptr),
+          midi_max_event_size_ptr(nullptr),
           midi_event_write_ptr(nullptr),
           midi_event_reserve_ptr(nullptr),
           release_timebase_ptr(nullptr),
@@ -387,6 +402,9 @@ struct JackBridge {
         LIB_SYMBOL(get_buffer_size)
         LIB_SYMBOL(cpu_load)
 
+        LIB_SYMBOL(frame_time)
+        LIB_SYMBOL(last_frame_time)
+
         LIB_SYMBOL(port_register)
         LIB_SYMBOL(port_unregister)
         LIB_SYMBOL(port_get_buffer)
@@ -432,6 +450,7 @@ struct JackBridge {
         LIB_SYMBOL(midi_get_event_count)
         LIB_SYMBOL(midi_event_get)
         LIB_SYMBOL(midi_clear_buffer)
+        LIB_SYMBOL(midi_max_event_size)
         LIB_SYMBOL(midi_event_write)
         LIB_SYMBOL(midi_event_reserve)
 
@@ -467,6 +486,34 @@ static JackBridge bridge;
 
 #endif // ! JACKBRIDGE_DIRECT
 
+#if JACKBRIDGE_DUMMY
+
+#include <cstdio>
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+// Dummy ports, so process callbacks can be driven without a server.
+// Each one owns a zeroed buffer, returned by jackbridge_port_get_buffer(),
+// which the caller may fill with test data.
+
+#define JACKBRIDGE_DUMMY_BUFFER_SIZE 8192
+
+struct _jack_port {
+    char  name[256];
+    float buffer[JACKBRIDGE_DUMMY_BUFFER_SIZE];
+};
+
+#define JACKBRIDGE_RECORD_CALLBACK(client, member, callback, arg)
+
+#else
+
+#include "JackBridgeRecord.cpp"
+
+#endif // JACKBRIDGE_DUMMY
+
+#include "JackBridgeTiming.cpp"
+#include "JackBridgeCache.cpp"
+
 // -----------------------------------------------------------------------------
 
 void jackbridge_get_version(int* major_ptr, int* minor_ptr, int* micro_ptr, int* proto_ptr)
@@ -506,10 +553,10 @@ jack_client_t* jackbridge_client_open(const char* client_name, jack_options_t op
 {
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
-    return jack_client_open(client_name, options, status);
+    return jackbridge_record_client_open(jack_client_open(client_name, options, status));
 #else
     if (bridge.client_open_ptr != nullptr)
-        return bridge.client_open_ptr(client_name, options, status);
+        return jackbridge_record_client_open(bridge.client_open_ptr(client_name, options, status));
 #endif
     if (status != nullptr)
         *status = JackServerError;
@@ -532,10 +579,10 @@ bool jackbridge_client_close(jack_client_t* client)
 {
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
-    return (jack_client_close(client) == 0);
+    return jackbridge_port_cache_client_close(client, jackbridge_timing_client_close(client, jackbridge_record_client_close(client, jack_client_close(client) == 0)));
 #else
     if (bridge.client_close_ptr != nullptr)
-        return (bridge.client_close_ptr(client) == 0);
+        return jackbridge_port_cache_client_close(client, jackbridge_timing_client_close(client, jackbridge_record_client_close(client, bridge.client_close_ptr(client) == 0)));
 #endif
     return false;
 }
@@ -634,6 +681,8 @@ bool jackbridge_set_thread_init_callback(jack_client_t* client, JackThreadInitCa
 
 void jackbridge_on_shutdown(jack_client_t* client, JackShutdownCallback shutdown_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, shutdown, shutdown_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     jack_on_shutdown(client, shutdown_callback, arg);
@@ -645,6 +694,8 @@ void jackbridge_on_shutdown(jack_client_t* client, JackShutdownCallback shutdown
 
 void jackbridge_on_info_shutdown(jack_client_t* client, JackInfoShutdownCallback shutdown_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, infoShutdown, shutdown_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     jack_on_info_shutdown(client, shutdown_callback, arg);
@@ -656,6 +707,9 @@ void jackbridge_on_info_shutdown(jack_client_t* client, JackInfoShutdownCallback
 
 bool jackbridge_set_process_callback(jack_client_t* client, JackProcessCallback process_callback, void* arg)
 {
+    JACKBRIDGE_TIMING_CALLBACK(client, process, process_callback, arg)
+    JACKBRIDGE_RECORD_CALLBACK(client, process, process_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_process_callback(client, process_callback, arg) == 0);
@@ -668,6 +722,8 @@ bool jackbridge_set_process_callback(jack_client_t* client, JackProcessCallback
 
 bool jackbridge_set_freewheel_callback(jack_client_t* client, JackFreewheelCallback freewheel_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, freewheel, freewheel_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_freewheel_callback(client, freewheel_callback, arg) == 0);
@@ -680,6 +736,8 @@ bool jackbridge_set_freewheel_callback(jack_client_t* client, JackFreewheelCallb
 
 bool jackbridge_set_buffer_size_callback(jack_client_t* client, JackBufferSizeCallback bufsize_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, bufferSize, bufsize_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_buffer_size_callback(client, bufsize_callback, arg) == 0);
@@ -692,6 +750,8 @@ bool jackbridge_set_buffer_size_callback(jack_client_t* client, JackBufferSizeCa
 
 bool jackbridge_set_sample_rate_callback(jack_client_t* client, JackSampleRateCallback srate_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, sampleRate, srate_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_sample_rate_callback(client, srate_callback, arg) == 0);
@@ -704,6 +764,8 @@ bool jackbridge_set_sample_rate_callback(jack_client_t* client, JackSampleRateCa
 
 bool jackbridge_set_client_registration_callback(jack_client_t* client, JackClientRegistrationCallback registration_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, clientRegistration, registration_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_client_registration_callback(client, registration_callback, arg) == 0);
@@ -716,9 +778,11 @@ bool jackbridge_set_client_registration_callback(jack_client_t* client, JackClie
 
 bool jackbridge_set_client_rename_callback(jack_client_t* client, JackClientRenameCallback rename_callback, void* arg)
 {
+    JACKBRIDGE_CACHE_CALLBACK(client, clientRename, rename_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
-    return (jack_set_client_rename_callback(client, registration_callback, arg) == 0);
+    return (jack_set_client_rename_callback(client, rename_callback, arg) == 0);
 #else
     if (bridge.set_client_rename_callback_ptr != nullptr)
         return (bridge.set_client_rename_callback_ptr(client, rename_callback, arg) == 0);
@@ -728,6 +792,9 @@ bool jackbridge_set_client_rename_callback(jack_client_t* client, JackClientRena
 
 bool jackbridge_set_port_registration_callback(jack_client_t* client, JackPortRegistrationCallback registration_callback, void *arg)
 {
+    JACKBRIDGE_CACHE_CALLBACK(client, portRegistration, registration_callback, arg)
+    JACKBRIDGE_RECORD_CALLBACK(client, portRegistration, registration_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_port_registration_callback(client, registration_callback, arg) == 0);
@@ -740,6 +807,8 @@ bool jackbridge_set_port_registration_callback(jack_client_t* client, JackPortRe
 
 bool jackbridge_set_port_connect_callback(jack_client_t* client, JackPortConnectCallback connect_callback, void* arg)
 {
+    JACKBRIDGE_RECORD_CALLBACK(client, portConnect, connect_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_port_connect_callback(client, connect_callback, arg) == 0);
@@ -752,6 +821,9 @@ bool jackbridge_set_port_connect_callback(jack_client_t* client, JackPortConnect
 
 bool jackbridge_set_port_rename_callback(jack_client_t* client, JackPortRenameCallback rename_callback, void* arg)
 {
+    JACKBRIDGE_CACHE_CALLBACK(client, portRename, rename_callback, arg)
+    JACKBRIDGE_RECORD_CALLBACK(client, portRename, rename_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_port_rename_callback(client, rename_callback, arg) == 0);
@@ -764,6 +836,9 @@ bool jackbridge_set_port_rename_callback(jack_client_t* client, JackPortRenameCa
 
 bool jackbridge_set_xrun_callback(jack_client_t* client, JackXRunCallback xrun_callback, void* arg)
 {
+    JACKBRIDGE_TIMING_CALLBACK(client, xrun, xrun_callback, arg)
+    JACKBRIDGE_RECORD_CALLBACK(client, xrun, xrun_callback, arg)
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_set_xrun_callback(client, xrun_callback, arg) == 0);
@@ -852,24 +927,61 @@ float jackbridge_cpu_load(jack_client_t* client)
 
 // -----------------------------------------------------------------------------
 
+jack_nframes_t jackbridge_frame_time(const jack_client_t* client)
+{
+#if JACKBRIDGE_DUMMY
+#elif JACKBRIDGE_DIRECT
+    return jack_frame_time(client);
+#else
+    if (bridge.frame_time_ptr != nullptr)
+        return bridge.frame_time_ptr(client);
+#endif
+    return 0;
+}
+
+jack_nframes_t jackbridge_last_frame_time(const jack_client_t* client)
+{
+#if JACKBRIDGE_DUMMY
+#elif JACKBRIDGE_DIRECT
+    return jack_last_frame_time(client);
+#else
+    if (bridge.last_frame_time_ptr != nullptr)
+        return bridge.last_frame_time_ptr(client);
+#endif
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
 jack_port_t* jackbridge_port_register(jack_client_t* client, const char* port_name, const char* port_type, unsigned long flags, unsigned long buffer_size)
 {
 #if JACKBRIDGE_DUMMY
+    jack_port_t* const port = new jack_port_t;
+    std::snprintf(port->name, sizeof(port->name), "dummy:%s", port_name);
+    std::memset(port->buffer, 0, sizeof(port->buffer));
+    return port;
 #elif JACKBRIDGE_DIRECT
-    return jack_port_register(client, port_name, port_type, flags, buffer_size);
+    return jackbridge_record_port_open(client, jack_port_register(client, port_name, port_type, flags, buffer_size));
 #else
     if (bridge.port_register_ptr != nullptr)
-        return bridge.port_register_ptr(client, port_name, port_type, flags, buffer_size);
+        return jackbridge_record_port_open(client, bridge.port_register_ptr(client, port_name, port_type, flags, buffer_size));
 #endif
     return nullptr;
 }
 
 bool jackbridge_port_unregister(jack_client_t* client, jack_port_t* port)
 {
+    jackbridge_port_cache_forget(port);
+
 #if JACKBRIDGE_DUMMY
+    delete port;
+    return true;
 #elif JACKBRIDGE_DIRECT
+    jackbridge_record_port_close(client, port);
     return (jack_port_unregister(client, port) == 0);
 #else
+    jackbridge_record_port_close(client, port);
+
     if (bridge.port_unregister_ptr != nullptr)
         return (bridge.port_unregister_ptr(client, port) == 0);
 #endif
@@ -879,6 +991,8 @@ bool jackbridge_port_unregister(jack_client_t* client, jack_port_t* port)
 void* jackbridge_port_get_buffer(jack_port_t* port, jack_nframes_t nframes)
 {
 #if JACKBRIDGE_DUMMY
+    if (port != nullptr && nframes <= JACKBRIDGE_DUMMY_BUFFER_SIZE)
+        return port->buffer;
 #elif JACKBRIDGE_DIRECT
     return jack_port_get_buffer(port, nframes);
 #else
@@ -893,6 +1007,8 @@ void* jackbridge_port_get_buffer(jack_port_t* port, jack_nframes_t nframes)
 const char* jackbridge_port_name(const jack_port_t* port)
 {
 #if JACKBRIDGE_DUMMY
+    if (port != nullptr)
+        return port->name;
 #elif JACKBRIDGE_DIRECT
     return jack_port_name(port);
 #else
@@ -1002,6 +1118,8 @@ const char** jackbridge_port_get_all_connections(const jack_client_t* client, co
 
 bool jackbridge_port_set_name(jack_port_t* port, const char* port_name)
 {
+    jackbridge_port_cache_forget(port);
+
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
     return (jack_port_set_name(port, port_name) == 0);
@@ -1224,7 +1342,7 @@ const char** jackbridge_get_ports(jack_client_t* client, const char* port_name_p
     return nullptr;
 }
 
-jack_port_t* jackbridge_port_by_name(jack_client_t* client, const char* port_name)
+static jack_port_t* jackbridge_port_by_name_uncached(jack_client_t* client, const char* port_name)
 {
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
@@ -1236,7 +1354,7 @@ jack_port_t* jackbridge_port_by_name(jack_client_t* client, const char* port_nam
     return nullptr;
 }
 
-jack_port_t* jackbridge_port_by_id(jack_client_t* client, jack_port_id_t port_id)
+static jack_port_t* jackbridge_port_by_id_uncached(jack_client_t* client, jack_port_id_t port_id)
 {
 #if JACKBRIDGE_DUMMY
 #elif JACKBRIDGE_DIRECT
@@ -1248,6 +1366,22 @@ jack_port_t* jackbridge_port_by_id(jack_client_t* client, jack_port_id_t port_id
     return nullptr;
 }
 
+jack_port_t* jackbridge_port_by_name(jack_client_t* client, const char* port_name)
+{
+    if (jack_port_t* const port = jackbridge_port_cache_get(client, port_name))
+        return port;
+
+    return jackbridge_port_cache_add(client, port_name, jackbridge_port_by_name_uncached(client, port_name));
+}
+
+jack_port_t* jackbridge_port_by_id(jack_client_t* client, jack_port_id_t port_id)
+{
+    if (jack_port_t* const port = jackbridge_port_cache_get_by_id(client, port_id))
+        return port;
+
+    return jackbridge_port_cache_add_by_id(client, port_id, jackbridge_port_by_id_uncached(client, port_id));
+}
+
 // -----------------------------------------------------------------------------
 
 void jackbridge_free(void* ptr)
@@ -1301,6 +1435,18 @@ void jackbridge_midi_clear_buffer(void* port_buffer)
 #endif
 }
 
+size_t jackbridge_midi_max_event_size(void* port_buffer)
+{
+#if JACKBRIDGE_DUMMY
+#elif JACKBRIDGE_DIRECT
+    return jack_midi_max_event_size(port_buffer);
+#else
+    if (bridge.midi_max_event_size_ptr != nullptr)
+        return bridge.midi_max_event_size_ptr(port_buffer);
+#endif
+    return 0;
+}
+
 bool jackbridge_midi_event_write(void* port_buffer, jack_nframes_t time, const jack_midi_data_t* data, size_t data_size)
 {
 #if JACKBRIDGE_DUMMY
@@ -1514,3 +1660,5 @@ const char** jackbridge_custom_get_keys(jack_client_t* client, const char* clien
 }
 
 // -----------------------------------------------------------------------------
+
+#endif // ! JACKBRIDGE_SIMULATE
@@ -287,6 +287,9 @@ JACKBRIDGE_EXPORT jack_nframes_t jackbridge_get_sample_rate(jack_client_t* clien
 JACKBRIDGE_EXPORT jack_nframes_t jackbridge_get_buffer_size(jack_client_t* client);
 JACKBRIDGE_EXPORT float          jackbridge_cpu_load(jack_client_t* client);
 
+JACKBRIDGE_EXPORT jack_nframes_t jackbridge_frame_time(const jack_client_t* client);
+JACKBRIDGE_EXPORT jack_nframes_t jackbridge_last_frame_time(const jack_client_t* client);
+
 JACKBRIDGE_EXPORT jack_port_t* jackbridge_port_register(jack_client_t* client, const char* port_name, const char* port_type, unsigned long flags, unsigned long buffer_size);
 JACKBRIDGE_EXPORT bool         jackbridge_port_unregister(jack_client_t* client, jack_port_t* port);
 JACKBRIDGE_EXPORT void*        jackbridge_port_get_buffer(jack_port_t* port, jack_nframes_t nframes);
@@ -332,6 +335,7 @@ JACKBRIDGE_EXPORT void jackbridge_free(void* ptr);
 JACKBRIDGE_EXPORT uint32_t jackbridge_midi_get_event_count(void* port_buffer);
 JACKBRIDGE_EXPORT bool     jackbridge_midi_event_get(jack_midi_event_t* event, void* port_buffer, uint32_t event_index);
 JACKBRIDGE_EXPORT void     jackbridge_midi_clear_buffer(void* port_buffer);
+JACKBRIDGE_EXPORT size_t   jackbridge_midi_max_event_size(void* port_buffer);
 JACKBRIDGE_EXPORT bool     jackbridge_midi_event_write(void* port_buffer, jack_nframes_t time, const jack_midi_data_t* data, size_t data_size);
 JACKBRIDGE_EXPORT jack_midi_data_t* jackbridge_midi_event_reserve(void* port_buffer, jack_nframes_t time, size_t data_size);
 
@@ -354,4 +358,36 @@ JACKBRIDGE_EXPORT bool jackbridge_custom_unpublish_data(jack_client_t* client, c
 JACKBRIDGE_EXPORT bool jackbridge_custom_set_data_appearance_callback(jack_client_t* client, JackCustomDataAppearanceCallback callback, void* arg);
 JACKBRIDGE_EXPORT const char** jackbridge_custom_get_keys(jack_client_t* client, const char* client_name);
 
+// Process callback timing, see JackBridgeTiming.cpp.
+// Enable before setting the process callback and activating the client.
+
+struct JackBridgeTimingStats {
+    uint64_t cycles;
+    uint64_t overruns;  // cycles where the process callback alone took longer than the period
+    uint32_t xruns;
+    uint32_t ownXRuns;  // xruns right after one of those
+    float budgetUs;     // the period, in the last cycle
+    float meanUs, maxUs;
+    float p50Us, p90Us, p99Us, p999Us;
+    float dspLoad, maxDspLoad; // as reported by jackbridge_cpu_load(), in %
+};
+
+struct JackBridgeTimingXRun {
+    jack_nframes_t frame; // when it was reported
+    float worstUs;        // slowest of the client's own cycles just before it
+    float budgetUs;
+    float dspLoad;
+    bool  own;            // worstUs > budgetUs, the client caused it
+};
+
+JACKBRIDGE_EXPORT bool     jackbridge_timing_enable(jack_client_t* client);
+JACKBRIDGE_EXPORT bool     jackbridge_timing_get_stats(jack_client_t* client, JackBridgeTimingStats* stats);
+JACKBRIDGE_EXPORT float    jackbridge_timing_get_percentile(jack_client_t* client, double percentile);
+JACKBRIDGE_EXPORT uint32_t jackbridge_timing_get_xruns(jack_client_t* client, JackBridgeTimingXRun* xruns, uint32_t max_count);
+JACKBRIDGE_EXPORT void     jackbridge_timing_reset(jack_client_t* client);
+
+// Caches jackbridge_port_by_name() and jackbridge_port_by_id() results, see JackBridgeCache.cpp.
+// Enable before setting the client callbacks and activating it.
+JACKBRIDGE_EXPORT bool jackbridge_port_cache_enable(jack_client_t* client);
+
 #endif // JACKBRIDGE_HPP_INCLUDED
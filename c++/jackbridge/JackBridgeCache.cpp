@@ -0,0 +1,576 @@
+/*
+ * JackBridge, port lookup cache
+ * Copyright (C) 2013 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Included by JackBridge.cpp and JackBridgeSim.cpp.
+//
+// After jackbridge_port_cache_enable(), jackbridge_port_by_name() and jackbridge_port_by_id()
+// remember what they found for that client, in open-addressing hash tables by name and
+// by id. Entries are dropped when JACK reports a port registered, unregistered or renamed,
+// or a client renamed, and right away when the client unregisters or renames a port itself.
+// Name lookups also check the port still has that name before returning a cached handle.
+// Call it before setting the client callbacks and activating it.
+//
+// The backend provides jackbridge_port_by_id_uncached(), used by the callbacks.
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define JACKBRIDGE_CACHE_MIN_SLOTS 256 // must be a power of 2
+
+static jack_port_t* jackbridge_port_by_id_uncached(jack_client_t* client, jack_port_id_t port_id);
+
+// -----------------------------------------------------------------------------
+
+struct JackBridgeCacheEntry {
+    std::string name;
+    uint32_t hash;
+    jack_port_t* port;
+    jack_port_id_t id;
+    bool hasId;
+    bool used;
+};
+
+// Linear probing, slots hold an entry index + 1 (0 is empty).
+// Removals shift the following slots back instead of leaving tombstones.
+class JackBridgePortCache
+{
+public:
+    JackBridgePortCache()
+        : fByName(JACKBRIDGE_CACHE_MIN_SLOTS, 0),
+          fById(JACKBRIDGE_CACHE_MIN_SLOTS, 0),
+          fCount(0) {}
+
+    jack_port_t* getByName(const char* const name) const
+    {
+        const uint32_t slot = findName(name, hashName(name));
+        return (fByName[slot] != 0) ? fEntries[fByName[slot]-1].port : nullptr;
+    }
+
+    jack_port_t* getById(const jack_port_id_t id) const
+    {
+        const uint32_t slot = findId(id);
+        return (fById[slot] != 0) ? fEntries[fById[slot]-1].port : nullptr;
+    }
+
+    // 'hasId' false if only the name is known
+    void add(const char* const name, jack_port_t* const port, const jack_port_id_t id, const bool hasId)
+    {
+        const uint32_t hash = hashName(name);
+        uint32_t slot = findName(name, hash);
+
+        if (fByName[slot] != 0)
+        {
+            JackBridgeCacheEntry& entry(fEntries[fByName[slot]-1]);
+
+            if (entry.port == port && (entry.hasId || ! hasId))
+                return;
+
+            remove(fByName[slot]-1);
+        }
+
+        if (hasId)
+        {
+            const uint32_t idSlot = findId(id);
+
+            if (fById[idSlot] != 0)
+                remove(fById[idSlot]-1);
+        }
+
+        if ((fCount + 1) * 2 > fByName.size())
+            rehash(fByName.size() * 2);
+
+        uint32_t index;
+
+        if (fFreeEntries.size() > 0)
+        {
+            index = fFreeEntries.back();
+            fFreeEntries.pop_back();
+        }
+        else
+        {
+            index = fEntries.size();
+            fEntries.push_back(JackBridgeCacheEntry());
+        }
+
+        JackBridgeCacheEntry& entry(fEntries[index]);
+        entry.name  = name;
+        entry.hash  = hash;
+        entry.port  = port;
+        entry.id    = id;
+        entry.hasId = hasId;
+        entry.used  = true;
+        ++fCount;
+
+        slot = findName(name, hash);
+        fByName[slot] = index + 1;
+
+        if (hasId)
+            fById[findId(id)] = index + 1;
+    }
+
+    void removeName(const char* const name)
+    {
+        const uint32_t slot = findName(name, hashName(name));
+
+        if (fByName[slot] != 0)
+            remove(fByName[slot]-1);
+    }
+
+    void removeId(const jack_port_id_t id)
+    {
+        const uint32_t slot = findId(id);
+
+        if (fById[slot] != 0)
+            remove(fById[slot]-1);
+    }
+
+    // entries learned by name do not know their id, so this has to look at all of them
+    void removePort(const jack_port_t* const port)
+    {
+        for (uint32_t i=0; i < fEntries.size(); ++i)
+        {
+            if (fEntries[i].used && fEntries[i].port == port)
+                remove(i);
+        }
+    }
+
+    void clear()
+    {
+        fEntries.clear();
+        fFreeEntries.clear();
+        fByName.assign(JACKBRIDGE_CACHE_MIN_SLOTS, 0);
+        fById.assign(JACKBRIDGE_CACHE_MIN_SLOTS, 0);
+        fCount = 0;
+    }
+
+private:
+    std::vector<JackBridgeCacheEntry> fEntries;
+    std::vector<uint32_t> fFreeEntries;
+    std::vector<uint32_t> fByName, fById;
+    uint32_t fCount;
+
+    // FNV-1a
+    static uint32_t hashName(const char* name)
+    {
+        uint32_t hash = 2166136261U;
+
+        for (; *name != '\0'; ++name)
+            hash = (hash ^ uint8_t(*name)) * 16777619U;
+
+        return hash;
+    }
+
+    static uint32_t hashId(const jack_port_id_t id)
+    {
+        return uint32_t(id) * 2654435761U;
+    }
+
+    uint32_t findName(const char* const name, const uint32_t hash) const
+    {
+        const uint32_t mask = fByName.size() - 1;
+
+        for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+        {
+            const uint32_t index = fByName[slot];
+
+            if (index == 0)
+                return slot;
+
+            const JackBridgeCacheEntry& entry(fEntries[index-1]);
+
+            if (entry.hash == hash && entry.name == name)
+                return slot;
+        }
+    }
+
+    uint32_t findId(const jack_port_id_t id) const
+    {
+        const uint32_t mask = fById.size() - 1;
+
+        for (uint32_t slot = hashId(id) & mask;; slot = (slot + 1) & mask)
+        {
+            const uint32_t index = fById[slot];
+
+            if (index == 0 || fEntries[index-1].id == id)
+                return slot;
+        }
+    }
+
+    uint32_t homeSlot(const std::vector<uint32_t>& table, const uint32_t index) const
+    {
+        const JackBridgeCacheEntry& entry(fEntries[index-1]);
+        return ((&table == &fByName) ? entry.hash : hashId(entry.id)) & (table.size() - 1);
+    }
+
+    void eraseSlot(std::vector<uint32_t>& table, uint32_t slot)
+    {
+        const uint32_t mask = table.size() - 1;
+
+        for (;;)
+        {
+            table[slot] = 0;
+
+            uint32_t next = slot;
+
+            for (;;)
+            {
+                next = (next + 1) & mask;
+
+                if (table[next] == 0)
+                    return;
+
+                // moves back entries that would not be found past the hole anymore
+                const uint32_t home = homeSlot(table, table[next]);
+
+                if ((slot <= next) ? (home <= slot || home > next) : (home <= slot && home > next))
+                    break;
+            }
+
+            table[slot] = table[next];
+            slot = next;
+        }
+    }
+
+    void remove(const uint32_t index)
+    {
+        JackBridgeCacheEntry& entry(fEntries[index]);
+
+        uint32_t slot = findName(entry.name.c_str(), entry.hash);
+        if (fByName[slot] == index + 1)
+            eraseSlot(fByName, slot);
+
+        if (entry.hasId)
+        {
+            slot = findId(entry.id);
+            if (fById[slot] == index + 1)
+                eraseSlot(fById, slot);
+        }
+
+        entry.name.clear();
+        entry.port = nullptr;
+        entry.used = false;
+        fFreeEntries.push_back(index);
+        --fCount;
+    }
+
+    void rehash(const uint32_t size)
+    {
+        fByName.assign(size, 0);
+        fById.assign(size, 0);
+
+        for (uint32_t i=0; i < fEntries.size(); ++i)
+        {
+            const JackBridgeCacheEntry& entry(fEntries[i]);
+
+            if (! entry.used)
+                continue;
+
+            fByName[findName(entry.name.c_str(), entry.hash)] = i + 1;
+
+            if (entry.hasId)
+                fById[findId(entry.id)] = i + 1;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+// the callbacks the client set, called after updating the cache
+struct JackBridgeCacheClient {
+    jack_client_t* client;
+    std::mutex lock;
+    JackBridgePortCache cache;
+
+    JackPortRegistrationCallback portRegistration; void* portRegistrationArg;
+    JackPortRenameCallback       portRename;       void* portRenameArg;
+    JackClientRenameCallback     clientRename;     void* clientRenameArg;
+
+    JackBridgeCacheClient(jack_client_t* const c)
+        : client(c),
+          portRegistration(nullptr), portRegistrationArg(nullptr),
+          portRename(nullptr),       portRenameArg(nullptr),
+          clientRename(nullptr),     clientRenameArg(nullptr) {}
+};
+
+class JackBridgeCache
+{
+public:
+    JackBridgeCache()
+        : fCount(0) {}
+
+    ~JackBridgeCache()
+    {
+        for (size_t i=0; i < fClients.size(); ++i)
+            delete fClients[i];
+    }
+
+    JackBridgeCacheClient* addClient(jack_client_t* const client)
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+
+        JackBridgeCacheClient* const cc(new JackBridgeCacheClient(client));
+        fClients.push_back(cc);
+        ++fCount;
+        return cc;
+    }
+
+    JackBridgeCacheClient* getClient(const jack_client_t* const client)
+    {
+        // the common case, nothing to look for
+        if (fCount == 0)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(fLock);
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (fClients[i]->client == client)
+                return fClients[i];
+        }
+        return nullptr;
+    }
+
+    void removeClient(JackBridgeCacheClient* const cc)
+    {
+        {
+            std::lock_guard<std::mutex> lock(fLock);
+            fClients.erase(std::remove(fClients.begin(), fClients.end(), cc), fClients.end());
+            --fCount;
+        }
+
+        delete cc;
+    }
+
+    // jackbridge_port_set_name() has no client to go with
+    void removePort(const jack_port_t* const port)
+    {
+        if (fCount == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(fLock);
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            std::lock_guard<std::mutex> clientLock(fClients[i]->lock);
+            fClients[i]->cache.removePort(port);
+        }
+    }
+
+private:
+    std::mutex fLock;
+    std::vector<JackBridgeCacheClient*> fClients;
+    std::atomic<int> fCount;
+};
+
+static JackBridgeCache gCache;
+
+// -----------------------------------------------------------------------------
+// Callbacks given to JACK in place of the client's own
+
+static void jackbridge_cache_portRegistration(jack_port_id_t port_id, int register_, void* arg)
+{
+    JackBridgeCacheClient* const cc((JackBridgeCacheClient*)arg);
+    jack_port_t* const port(jackbridge_port_by_id_uncached(cc->client, port_id));
+    const char* const name((port != nullptr && register_ != 0) ? jackbridge_port_name(port) : nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(cc->lock);
+
+        // the id, the handle or the name may have been in use by a port gone by now
+        cc->cache.removeId(port_id);
+
+        if (port != nullptr)
+            cc->cache.removePort(port);
+        if (name != nullptr)
+            cc->cache.add(name, port, port_id, true);
+    }
+
+    if (cc->portRegistration != nullptr)
+        cc->portRegistration(port_id, register_, cc->portRegistrationArg);
+}
+
+static int jackbridge_cache_portRename(jack_port_id_t port_id, const char* old_name, const char* new_name, void* arg)
+{
+    JackBridgeCacheClient* const cc((JackBridgeCacheClient*)arg);
+
+    {
+        std::lock_guard<std::mutex> lock(cc->lock);
+
+        cc->cache.removeId(port_id);
+
+        if (old_name != nullptr)
+            cc->cache.removeName(old_name);
+        if (new_name != nullptr)
+            cc->cache.removeName(new_name);
+    }
+
+    return (cc->portRename != nullptr) ? cc->portRename(port_id, old_name, new_name, cc->portRenameArg) : 0;
+}
+
+static int jackbridge_cache_clientRename(const char* old_name, const char* new_name, void* arg)
+{
+    JackBridgeCacheClient* const cc((JackBridgeCacheClient*)arg);
+
+    {
+        // all ports of the client changed names
+        std::lock_guard<std::mutex> lock(cc->lock);
+        cc->cache.clear();
+    }
+
+    return (cc->clientRename != nullptr) ? cc->clientRename(old_name, new_name, cc->clientRenameArg) : 0;
+}
+
+// Swaps 'callback' and 'arg' for the cache ones above, if the cache is enabled for this client.
+// A null callback is kept as such by the wrapper, which has to stay installed.
+#define JACKBRIDGE_CACHE_CALLBACK(client, member, callback, arg)                    \
+    if (callback != jackbridge_cache_##member)                                      \
+    {                                                                               \
+        if (JackBridgeCacheClient* const cc = gCache.getClient(client))             \
+        {                                                                           \
+            cc->member      = callback;                                             \
+            cc->member##Arg = arg;                                                  \
+            callback = jackbridge_cache_##member;                                   \
+            arg      = cc;                                                          \
+        }                                                                           \
+    }
+
+// -----------------------------------------------------------------------------
+// Called by the jackbridge functions
+
+static inline
+jack_port_t* jackbridge_port_cache_get(jack_client_t* const client, const char* const port_name)
+{
+    JackBridgeCacheClient* const cc(gCache.getClient(client));
+
+    if (cc == nullptr || port_name == nullptr)
+        return nullptr;
+
+    jack_port_t* port;
+
+    {
+        std::lock_guard<std::mutex> lock(cc->lock);
+        port = cc->cache.getByName(port_name);
+    }
+
+    if (port == nullptr)
+        return nullptr;
+
+    // renamed, or the handle reused, and the callback did not get here yet.
+    // Not under the cache lock, the backend may be delivering a callback holding its own.
+    const char* const currentName(jackbridge_port_name(port));
+
+    if (currentName == nullptr || std::strcmp(currentName, port_name) != 0)
+    {
+        std::lock_guard<std::mutex> lock(cc->lock);
+        cc->cache.removePort(port);
+        return nullptr;
+    }
+
+    return port;
+}
+
+static inline
+jack_port_t* jackbridge_port_cache_add(jack_client_t* const client, const char* const port_name, jack_port_t* const port)
+{
+    if (port == nullptr || port_name == nullptr)
+        return port;
+
+    if (JackBridgeCacheClient* const cc = gCache.getClient(client))
+    {
+        std::lock_guard<std::mutex> lock(cc->lock);
+        cc->cache.add(port_name, port, 0, false);
+    }
+
+    return port;
+}
+
+static inline
+jack_port_t* jackbridge_port_cache_get_by_id(jack_client_t* const client, const jack_port_id_t port_id)
+{
+    JackBridgeCacheClient* const cc(gCache.getClient(client));
+
+    if (cc == nullptr)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(cc->lock);
+    return cc->cache.getById(port_id);
+}
+
+static inline
+jack_port_t* jackbridge_port_cache_add_by_id(jack_client_t* const client, const jack_port_id_t port_id, jack_port_t* const port)
+{
+    if (port == nullptr)
+        return nullptr;
+
+    if (JackBridgeCacheClient* const cc = gCache.getClient(client))
+    {
+        if (const char* const name = jackbridge_port_name(port))
+        {
+            std::lock_guard<std::mutex> lock(cc->lock);
+            cc->cache.add(name, port, port_id, true);
+        }
+    }
+
+    return port;
+}
+
+// before the client unregisters or renames one of its ports
+static inline
+void jackbridge_port_cache_forget(const jack_port_t* const port)
+{
+    gCache.removePort(port);
+}
+
+// after the client was closed, so none of its callbacks can run anymore
+static inline
+bool jackbridge_port_cache_client_close(jack_client_t* const client, const bool ok)
+{
+    if (JackBridgeCacheClient* const cc = gCache.getClient(client))
+        gCache.removeClient(cc);
+
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_port_cache_enable(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+    if (gCache.getClient(client) != nullptr)
+        return true;
+
+    JackBridgeCacheClient* const cc(gCache.addClient(client));
+
+    // needed even if the client never sets it itself
+    if (! jackbridge_set_port_registration_callback(client, jackbridge_cache_portRegistration, cc))
+    {
+        gCache.removeClient(cc);
+        return false;
+    }
+
+    // not in all JACK versions, renames are also caught by the name check in lookups
+    jackbridge_set_port_rename_callback(client, jackbridge_cache_portRename, cc);
+    jackbridge_set_client_rename_callback(client, jackbridge_cache_clientRename, cc);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,115 @@
+/*
+ * JackBridge session log format
+ * Copyright (C) 2013 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JACKBRIDGE_LOG_HPP_INCLUDED
+#define JACKBRIDGE_LOG_HPP_INCLUDED
+
+#include "JackBridge.hpp"
+
+// Written by JackBridgeRecord.cpp, replayed by JackBridgeSim.cpp.
+//
+// A file header, then records one after the other, each a JackBridgeLogRecord and
+// its payload. Everything is in native byte order and 8-byte aligned, so a mapped
+// file can be read in place. Strings are null-terminated, after the fixed part.
+
+#define JACKBRIDGE_LOG_MAGIC   "JBLOG\0\0"
+#define JACKBRIDGE_LOG_VERSION 1
+
+enum JackBridgeLogType {
+    kJackBridgeLogClientOpen = 1,     // client name
+    kJackBridgeLogClientClose,        // -
+    kJackBridgeLogSampleRate,         // JackBridgeLogValue
+    kJackBridgeLogBufferSize,         // JackBridgeLogValue
+    kJackBridgeLogPortOpen,           // JackBridgeLogPort, full name; one of the client's own ports
+    kJackBridgeLogPortClose,          // JackBridgeLogPort, full name
+    kJackBridgeLogPortRegistration,   // JackBridgeLogPort, full name
+    kJackBridgeLogPortConnect,        // JackBridgeLogConnect, source name, destination name
+    kJackBridgeLogPortRename,         // JackBridgeLogPort, old name, new name
+    kJackBridgeLogClientRegistration, // JackBridgeLogValue, client name
+    kJackBridgeLogGraphOrder,         // -
+    kJackBridgeLogXRun,               // -
+    kJackBridgeLogFreewheel,          // JackBridgeLogValue
+    kJackBridgeLogShutdown,           // JackBridgeLogValue (status code), reason
+    kJackBridgeLogCycle,              // JackBridgeLogCycle, then its JackBridgeLogBuffer blocks
+    kJackBridgeLogLost                // JackBridgeLogValue, number of records dropped before this one
+};
+
+struct JackBridgeLogFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct JackBridgeLogRecord {
+    uint16_t type;
+    uint16_t client;   // index, in the order clients were opened
+    uint32_t size;     // of the payload, a multiple of 8
+    uint32_t frame;    // JACK frame time when it happened
+    uint32_t reserved;
+};
+
+struct JackBridgeLogValue {
+    int32_t  value;
+    uint32_t reserved;
+};
+
+struct JackBridgeLogPort {
+    uint32_t id;
+    int32_t  flags;
+    uint32_t slot;     // own ports only, referenced by JackBridgeLogBuffer
+    uint8_t  isMidi;
+    uint8_t  value;    // registered, for kJackBridgeLogPortRegistration
+    uint8_t  reserved[2];
+};
+
+struct JackBridgeLogConnect {
+    uint32_t source;
+    uint32_t destination;
+    int32_t  connect;
+    uint32_t reserved;
+};
+
+struct JackBridgeLogCycle {
+    uint32_t nframes;
+    uint32_t lastFrameTime;
+    uint32_t transportState;
+    uint32_t transportFrame;
+    uint32_t bufferCount;
+    uint32_t reserved;
+};
+
+// the data an input port had at the start of the cycle, 'size' bytes follow (a multiple of 8):
+// 'count' floats for audio, 'count' JackBridgeLogMidiEvents for MIDI
+struct JackBridgeLogBuffer {
+    uint32_t slot;
+    uint32_t isMidi;
+    uint32_t count;
+    uint32_t size;
+};
+
+// 'size' bytes of data follow, padded to 4
+struct JackBridgeLogMidiEvent {
+    uint32_t time;
+    uint32_t size;
+};
+
+static inline
+uint32_t jackbridge_log_pad(const uint32_t size, const uint32_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+#endif // JACKBRIDGE_LOG_HPP_INCLUDED
@@ -0,0 +1,841 @@
+/*
+ * JackBridge, session recorder
+ * Copyright (C) 2013 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Included by JackBridge.cpp, except for the dummy and simulated builds.
+//
+// When JACKBRIDGE_RECORD is set to a filename, everything JACK tells the clients is also
+// written there, in the order they see it: each process cycle with the data of the
+// client's input ports, and port, connection, client, xrun, buffer size and shutdown
+// notifications. The format is in JackBridgeLog.hpp; a simulated build with
+// JACKBRIDGE_REPLAY set to the same file feeds it back (see JackBridgeSim.cpp).
+//
+// The file stays open until the process exits, for all clients opened in the meantime.
+// The process thread never touches it. Records go through ring buffers that a
+// writer thread drains; if it falls behind, records are dropped and counted.
+// Each client's process thread has a ring of its own and takes no locks; every record
+// gets a sequence number, so the writer puts them back in the order they happened.
+
+#include "JackBridgeLog.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JACKBRIDGE_RECORD_RING_SIZE       (1024*1024)      // notifications, must be a power of 2
+#define JACKBRIDGE_RECORD_CYCLE_RING_SIZE (16*1024*1024)   // cycles of one client, must be a power of 2
+#define JACKBRIDGE_RECORD_MAX_PORTS 256
+
+// -----------------------------------------------------------------------------
+
+// Single-producer ring of log records, drained by the writer thread.
+// In here the 'reserved' field of each record header holds its sequence number,
+// which the writer uses to put records from all rings back in order.
+class JackBridgeRecordRing
+{
+public:
+    JackBridgeRecordRing(const uint32_t size)
+        : fData(new char[size]),
+          fSize(size),
+          fPos(0),
+          fRecordEnd(0),
+          fLostRecords(0),
+          fWritePos(0),
+          fReadPos(0) {}
+
+    ~JackBridgeRecordRing()
+    {
+        delete[] fData;
+    }
+
+    // -------------------------------------------------------------------------
+    // producer side
+
+    // false if there's no room and the record is dropped; sequence numbers are only
+    // taken once there is room, so the writer never waits for a record that won't come
+    bool begin(const JackBridgeLogType type, const uint16_t client, const uint32_t frame, const uint32_t size,
+               std::atomic<uint32_t>& sequence)
+    {
+        const uint32_t needed = sizeof(JackBridgeLogRecord) + jackbridge_log_pad(size, 8);
+        const uint32_t lost   = (fLostRecords > 0) ? sizeof(JackBridgeLogRecord) + sizeof(JackBridgeLogValue) : 0;
+
+        if (fSize - (fPos - fReadPos.load(std::memory_order_acquire)) < needed + lost)
+        {
+            ++fLostRecords;
+            return false;
+        }
+
+        uint32_t seq = sequence.fetch_add((fLostRecords > 0) ? 2 : 1, std::memory_order_relaxed);
+
+        if (fLostRecords > 0)
+        {
+            JackBridgeLogValue value;
+            value.value    = int32_t(fLostRecords);
+            value.reserved = 0;
+
+            writeHeader(kJackBridgeLogLost, client, frame, sizeof(value), seq++);
+            write(&value, sizeof(value));
+            fLostRecords = 0;
+        }
+
+        writeHeader(type, client, frame, jackbridge_log_pad(size, 8), seq);
+        fRecordEnd = fPos + jackbridge_log_pad(size, 8);
+        return true;
+    }
+
+    void write(const void* const data, const uint32_t size)
+    {
+        if (size == 0)
+            return;
+
+        const uint32_t offset = fPos & (fSize-1);
+        const uint32_t first  = (offset + size > fSize) ? fSize - offset : size;
+
+        std::memcpy(fData + offset, data, first);
+        std::memcpy(fData, (const char*)data + first, size - first);
+
+        fPos += size;
+    }
+
+    void end()
+    {
+        static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        write(zeros, fRecordEnd - fPos);
+        fWritePos.store(fPos, std::memory_order_release);
+    }
+
+    // -------------------------------------------------------------------------
+    // writer thread side
+
+    bool isEmpty() const
+    {
+        return (fReadPos.load(std::memory_order_relaxed) == fWritePos.load(std::memory_order_acquire));
+    }
+
+    // sequence number of the oldest record, if there is one
+    bool peek(uint32_t& seq) const
+    {
+        if (isEmpty())
+            return false;
+
+        JackBridgeLogRecord record;
+        copyOut(fReadPos.load(std::memory_order_relaxed), &record, sizeof(record));
+
+        seq = record.reserved;
+        return true;
+    }
+
+    // writes the oldest record to 'file', as it goes in the log
+    void pop(FILE* const file)
+    {
+        uint32_t readPos = fReadPos.load(std::memory_order_relaxed);
+
+        JackBridgeLogRecord record;
+        copyOut(readPos, &record, sizeof(record));
+        readPos += sizeof(record);
+
+        const uint32_t size = record.size;
+        record.reserved = 0;
+        std::fwrite(&record, sizeof(record), 1, file);
+
+        for (uint32_t done = 0; done < size;)
+        {
+            const uint32_t offset = (readPos + done) & (fSize-1);
+            const uint32_t chunk  = (offset + (size - done) > fSize) ? fSize - offset : size - done;
+
+            std::fwrite(fData + offset, 1, chunk, file);
+            done += chunk;
+        }
+
+        fReadPos.store(readPos + size, std::memory_order_release);
+    }
+
+private:
+    char* const fData;
+    const uint32_t fSize;
+
+    // producer side
+    uint32_t fPos, fRecordEnd, fLostRecords;
+
+    std::atomic<uint32_t> fWritePos;
+    std::atomic<uint32_t> fReadPos;
+
+    void writeHeader(const JackBridgeLogType type, const uint16_t client, const uint32_t frame, const uint32_t size, const uint32_t seq)
+    {
+        JackBridgeLogRecord record;
+        record.type     = type;
+        record.client   = client;
+        record.size     = size;
+        record.frame    = frame;
+        record.reserved = seq;
+
+        write(&record, sizeof(record));
+    }
+
+    void copyOut(const uint32_t pos, void* const data, const uint32_t size) const
+    {
+        const uint32_t offset = pos & (fSize-1);
+        const uint32_t first  = (offset + size > fSize) ? fSize - offset : size;
+
+        std::memcpy(data, fData + offset, first);
+        std::memcpy((char*)data + first, fData, size - first);
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+struct JackBridgeRecordPort {
+    std::atomic<jack_port_t*> port;
+    bool isMidi;
+};
+
+// what one cycle records of a port, taken in one go so it can't change halfway
+struct JackBridgeRecordCyclePort {
+    jack_port_t* port;
+    uint32_t slot;
+    bool isMidi;
+    void* buffer;
+    uint32_t size;
+};
+
+// the callbacks the client set, called after recording what they get
+struct JackBridgeRecordClient {
+    jack_client_t* client;
+    uint16_t index;
+
+    // own ports by slot, read by the process thread
+    JackBridgeRecordPort ports[JACKBRIDGE_RECORD_MAX_PORTS];
+
+    // only used by the process thread
+    JackBridgeRecordRing cycleRing;
+    JackBridgeRecordCyclePort cyclePorts[JACKBRIDGE_RECORD_MAX_PORTS];
+
+    JackProcessCallback            process;            void* processArg;
+    JackFreewheelCallback          freewheel;          void* freewheelArg;
+    JackBufferSizeCallback         bufferSize;         void* bufferSizeArg;
+    JackSampleRateCallback         sampleRate;         void* sampleRateArg;
+    JackClientRegistrationCallback clientRegistration; void* clientRegistrationArg;
+    JackPortRegistrationCallback   portRegistration;   void* portRegistrationArg;
+    JackPortConnectCallback        portConnect;        void* portConnectArg;
+    JackPortRenameCallback         portRename;         void* portRenameArg;
+    JackXRunCallback               xrun;               void* xrunArg;
+    JackShutdownCallback           shutdown;           void* shutdownArg;
+    JackInfoShutdownCallback       infoShutdown;       void* infoShutdownArg;
+
+    JackBridgeRecordClient(jack_client_t* const c, const uint16_t i)
+        : client(c),
+          index(i),
+          cycleRing(JACKBRIDGE_RECORD_CYCLE_RING_SIZE),
+          process(nullptr),            processArg(nullptr),
+          freewheel(nullptr),          freewheelArg(nullptr),
+          bufferSize(nullptr),         bufferSizeArg(nullptr),
+          sampleRate(nullptr),         sampleRateArg(nullptr),
+          clientRegistration(nullptr), clientRegistrationArg(nullptr),
+          portRegistration(nullptr),   portRegistrationArg(nullptr),
+          portConnect(nullptr),        portConnectArg(nullptr),
+          portRename(nullptr),         portRenameArg(nullptr),
+          xrun(nullptr),               xrunArg(nullptr),
+          shutdown(nullptr),           shutdownArg(nullptr),
+          infoShutdown(nullptr),       infoShutdownArg(nullptr)
+    {
+        for (int i=0; i < JACKBRIDGE_RECORD_MAX_PORTS; ++i)
+        {
+            ports[i].port.store(nullptr);
+            ports[i].isMidi = false;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+class JackBridgeRecorder
+{
+public:
+    JackBridgeRecorder()
+        : fFile(nullptr),
+          fRing(nullptr),
+          fSequence(0),
+          fNextSequence(0),
+          fRunning(false),
+          fNextIndex(0) {}
+
+    ~JackBridgeRecorder()
+    {
+        close();
+    }
+
+    bool isOpen() const
+    {
+        return (fFile != nullptr);
+    }
+
+    bool open(const char* const filename)
+    {
+        fFile = std::fopen(filename, "wb");
+
+        if (fFile == nullptr)
+            return false;
+
+        JackBridgeLogFileHeader header;
+        std::memcpy(header.magic, JACKBRIDGE_LOG_MAGIC, sizeof(header.magic));
+        header.version  = JACKBRIDGE_LOG_VERSION;
+        header.reserved = 0;
+        std::fwrite(&header, sizeof(header), 1, fFile);
+
+        fRing = new JackBridgeRecordRing(JACKBRIDGE_RECORD_RING_SIZE);
+        fSequence = fNextSequence = 0;
+
+        fRunning = true;
+        fThread  = std::thread(&JackBridgeRecorder::run, this);
+        return true;
+    }
+
+    void close()
+    {
+        if (fFile == nullptr)
+            return;
+
+        fRunning = false;
+        fThread.join();
+
+        std::lock_guard<std::mutex> clientsLock(fClientsLock);
+        std::lock_guard<std::mutex> lock(fLock);
+
+        std::fclose(fFile);
+        fFile = nullptr;
+
+        delete fRing;
+        fRing = nullptr;
+    }
+
+    // -------------------------------------------------------------------------
+    // clients, not for the process thread
+
+    JackBridgeRecordClient* addClient(jack_client_t* const client)
+    {
+        std::lock_guard<std::mutex> lock(fClientsLock);
+
+        JackBridgeRecordClient* const rc(new JackBridgeRecordClient(client, fNextIndex++));
+        fClients.push_back(rc);
+        return rc;
+    }
+
+    JackBridgeRecordClient* getClient(const jack_client_t* const client)
+    {
+        std::lock_guard<std::mutex> lock(fClientsLock);
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (fClients[i]->client == client)
+                return fClients[i];
+        }
+        return nullptr;
+    }
+
+    // after the client is closed, once everything it recorded is in the file
+    void removeClient(JackBridgeRecordClient* const rc)
+    {
+        // another client's process thread may still be committing a record that goes
+        // before some of this one's, which takes a moment at most
+        for (int i=0; i < 1000 && ! rc->cycleRing.isEmpty(); ++i)
+        {
+            drain();
+
+            if (! rc->cycleRing.isEmpty())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::lock_guard<std::mutex> lock(fClientsLock);
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (fClients[i] == rc)
+            {
+                fClients.erase(fClients.begin() + i);
+                break;
+            }
+        }
+
+        delete rc;
+    }
+
+    // -------------------------------------------------------------------------
+    // records, from any thread but the process one
+
+    void record(const JackBridgeLogType type, const JackBridgeRecordClient* const rc, const void* const data, const uint32_t size,
+                const char* const str1 = nullptr, const char* const str2 = nullptr)
+    {
+        const uint32_t size1 = (str1 != nullptr) ? std::strlen(str1) + 1 : 0;
+        const uint32_t size2 = (str2 != nullptr) ? std::strlen(str2) + 1 : 0;
+        const uint32_t frame = jackbridge_frame_time(rc->client);
+
+        std::lock_guard<std::mutex> lock(fLock);
+
+        if (fRing != nullptr && fRing->begin(type, rc->index, frame, size + size1 + size2, fSequence))
+        {
+            fRing->write(data, size);
+            fRing->write(str1, size1);
+            fRing->write(str2, size2);
+            fRing->end();
+        }
+    }
+
+    void recordValue(const JackBridgeLogType type, const JackBridgeRecordClient* const rc, const int32_t value, const char* const str = nullptr)
+    {
+        JackBridgeLogValue payload;
+        payload.value    = value;
+        payload.reserved = 0;
+
+        record(type, rc, &payload, sizeof(payload), str);
+    }
+
+    void recordPort(const JackBridgeLogType type, const JackBridgeRecordClient* const rc, const jack_port_t* const port,
+                    const uint32_t id, const uint32_t slot, const uint8_t value)
+    {
+        JackBridgeLogPort payload;
+        std::memset(&payload, 0, sizeof(payload));
+        payload.id    = id;
+        payload.slot  = slot;
+        payload.value = value;
+
+        const char* name = "";
+
+        if (port != nullptr)
+        {
+            const char* const portType(jackbridge_port_type(port));
+
+            payload.flags  = jackbridge_port_flags(port);
+            payload.isMidi = (portType != nullptr && std::strcmp(portType, JACK_DEFAULT_MIDI_TYPE) == 0);
+
+            if (const char* const portName = jackbridge_port_name(port))
+                name = portName;
+        }
+
+        record(type, rc, &payload, sizeof(payload), name);
+    }
+
+    // from the process thread, before the client's own process callback.
+    // Goes to the client's own ring, so it never waits for another thread.
+    void recordCycle(JackBridgeRecordClient* const rc, const jack_nframes_t nframes)
+    {
+        jack_position_t pos;
+
+        JackBridgeLogCycle cycle;
+        cycle.nframes        = nframes;
+        cycle.lastFrameTime  = jackbridge_last_frame_time(rc->client);
+        cycle.transportState = jackbridge_transport_query(rc->client, &pos);
+        cycle.transportFrame = pos.frame;
+        cycle.bufferCount    = 0;
+        cycle.reserved       = 0;
+
+        uint32_t size = sizeof(cycle);
+
+        // ports may be registered or unregistered meanwhile, so this takes the ports,
+        // their buffers and sizes once, and what is written below is exactly that
+        for (int i=0; i < JACKBRIDGE_RECORD_MAX_PORTS; ++i)
+        {
+            jack_port_t* const port(rc->ports[i].port.load(std::memory_order_acquire));
+
+            if (port == nullptr || (jackbridge_port_flags(port) & JackPortIsInput) == 0)
+                continue;
+
+            JackBridgeRecordCyclePort& cyclePort(rc->cyclePorts[cycle.bufferCount++]);
+            cyclePort.port   = port;
+            cyclePort.slot   = i;
+            cyclePort.isMidi = rc->ports[i].isMidi;
+            cyclePort.buffer = jackbridge_port_get_buffer(port, nframes);
+            cyclePort.size   = bufferSize(cyclePort.isMidi, cyclePort.buffer, nframes);
+
+            size += sizeof(JackBridgeLogBuffer) + cyclePort.size;
+        }
+
+        JackBridgeRecordRing& ring(rc->cycleRing);
+
+        if (! ring.begin(kJackBridgeLogCycle, rc->index, cycle.lastFrameTime, size, fSequence))
+            return;
+
+        ring.write(&cycle, sizeof(cycle));
+
+        for (uint32_t i=0; i < cycle.bufferCount; ++i)
+        {
+            JackBridgeRecordCyclePort& cyclePort(rc->cyclePorts[i]);
+
+            // closed since the walk above, and maybe recorded as closed before this cycle;
+            // an unknown slot keeps replay from giving the data to a port reusing it
+            if (rc->ports[cyclePort.slot].port.load(std::memory_order_acquire) != cyclePort.port)
+                cyclePort.slot = JACKBRIDGE_RECORD_MAX_PORTS;
+
+            writeBuffer(ring, cyclePort, nframes);
+        }
+
+        ring.end();
+    }
+
+private:
+    FILE* fFile;
+
+    // notifications, guarded by fLock
+    std::mutex fLock;
+    JackBridgeRecordRing* fRing;
+
+    // taken by every record that makes it into a ring
+    std::atomic<uint32_t> fSequence;
+
+    // next record to go in the file, guarded by fClientsLock
+    uint32_t fNextSequence;
+
+    std::atomic<bool> fRunning;
+    std::thread fThread;
+
+    std::mutex fClientsLock;
+    std::vector<JackBridgeRecordClient*> fClients;
+    uint16_t fNextIndex;
+
+    // -------------------------------------------------------------------------
+
+    static uint32_t bufferSize(const bool isMidi, void* const buffer, const jack_nframes_t nframes)
+    {
+        if (buffer == nullptr)
+            return 0;
+
+        if (! isMidi)
+            return jackbridge_log_pad(sizeof(float) * nframes, 8);
+
+        uint32_t size = 0;
+        const uint32_t count = jackbridge_midi_get_event_count(buffer);
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            jack_midi_event_t event;
+
+            if (jackbridge_midi_event_get(&event, buffer, i))
+                size += sizeof(JackBridgeLogMidiEvent) + jackbridge_log_pad(event.size, 4);
+        }
+
+        return jackbridge_log_pad(size, 8);
+    }
+
+    // writes exactly 'port.size' bytes after the header
+    static void writeBuffer(JackBridgeRecordRing& ring, const JackBridgeRecordCyclePort& port, const jack_nframes_t nframes)
+    {
+        static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        void* const buffer(port.buffer);
+
+        JackBridgeLogBuffer header;
+        header.slot   = port.slot;
+        header.isMidi = port.isMidi ? 1 : 0;
+        header.count  = 0;
+        header.size   = port.size;
+
+        if (buffer != nullptr)
+            header.count = port.isMidi ? jackbridge_midi_get_event_count(buffer) : nframes;
+
+        ring.write(&header, sizeof(header));
+
+        if (header.size == 0)
+            return;
+
+        if (! port.isMidi)
+        {
+            ring.write(buffer, sizeof(float) * nframes);
+            ring.write(zeros, header.size - sizeof(float) * nframes);
+            return;
+        }
+
+        uint32_t written = 0;
+
+        for (uint32_t i=0; i < header.count; ++i)
+        {
+            jack_midi_event_t event;
+            JackBridgeLogMidiEvent logEvent;
+
+            if (! jackbridge_midi_event_get(&event, buffer, i))
+            {
+                // keep the count right, as an empty event
+                event.size   = 0;
+                event.time   = 0;
+                event.buffer = nullptr;
+            }
+
+            logEvent.time = event.time;
+            logEvent.size = event.size;
+
+            ring.write(&logEvent, sizeof(logEvent));
+            ring.write(event.buffer, event.size);
+            ring.write(zeros, jackbridge_log_pad(event.size, 4) - event.size);
+
+            written += sizeof(logEvent) + jackbridge_log_pad(event.size, 4);
+        }
+
+        ring.write(zeros, header.size - written);
+    }
+
+    // -------------------------------------------------------------------------
+    // writer thread
+
+    void run()
+    {
+        while (fRunning)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            drain();
+        }
+
+        drain();
+    }
+
+    // Writes records from all rings in sequence order, stopping at one that is not
+    // committed yet (its producer took the number but is still copying it in).
+    void drain()
+    {
+        std::lock_guard<std::mutex> lock(fClientsLock);
+
+        if (fFile == nullptr)
+            return;
+
+        for (;;)
+        {
+            JackBridgeRecordRing* next = nullptr;
+            uint32_t seq;
+
+            if (fRing->peek(seq) && seq == fNextSequence)
+                next = fRing;
+
+            for (size_t i=0; next == nullptr && i < fClients.size(); ++i)
+            {
+                if (fClients[i]->cycleRing.peek(seq) && seq == fNextSequence)
+                    next = &fClients[i]->cycleRing;
+            }
+
+            if (next == nullptr)
+                break;
+
+            next->pop(fFile);
+            ++fNextSequence;
+        }
+
+        // so a crash loses at most the last few cycles
+        std::fflush(fFile);
+    }
+};
+
+static JackBridgeRecorder gRecorder;
+
+// -----------------------------------------------------------------------------
+// Callbacks given to JACK instead of the client's ones
+
+static int jackbridge_record_process(jack_nframes_t nframes, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordCycle(rc, nframes);
+    return rc->process(nframes, rc->processArg);
+}
+
+static void jackbridge_record_freewheel(int starting, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordValue(kJackBridgeLogFreewheel, rc, starting);
+    rc->freewheel(starting, rc->freewheelArg);
+}
+
+static int jackbridge_record_bufferSize(jack_nframes_t nframes, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordValue(kJackBridgeLogBufferSize, rc, int32_t(nframes));
+    return rc->bufferSize(nframes, rc->bufferSizeArg);
+}
+
+static int jackbridge_record_sampleRate(jack_nframes_t nframes, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordValue(kJackBridgeLogSampleRate, rc, int32_t(nframes));
+    return rc->sampleRate(nframes, rc->sampleRateArg);
+}
+
+static void jackbridge_record_clientRegistration(const char* name, int register_, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordValue(kJackBridgeLogClientRegistration, rc, register_, name);
+    rc->clientRegistration(name, register_, rc->clientRegistrationArg);
+}
+
+static void jackbridge_record_portRegistration(jack_port_id_t port, int register_, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordPort(kJackBridgeLogPortRegistration, rc, jackbridge_port_by_id(rc->client, port), port, 0, register_ ? 1 : 0);
+    rc->portRegistration(port, register_, rc->portRegistrationArg);
+}
+
+static void jackbridge_record_portConnect(jack_port_id_t a, jack_port_id_t b, int connect, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+
+    const jack_port_t* const portA(jackbridge_port_by_id(rc->client, a));
+    const jack_port_t* const portB(jackbridge_port_by_id(rc->client, b));
+    const char* const nameA((portA != nullptr) ? jackbridge_port_name(portA) : nullptr);
+    const char* const nameB((portB != nullptr) ? jackbridge_port_name(portB) : nullptr);
+
+    JackBridgeLogConnect payload;
+    payload.source      = a;
+    payload.destination = b;
+    payload.connect     = connect;
+    payload.reserved    = 0;
+
+    gRecorder.record(kJackBridgeLogPortConnect, rc, &payload, sizeof(payload), (nameA != nullptr) ? nameA : "", (nameB != nullptr) ? nameB : "");
+    rc->portConnect(a, b, connect, rc->portConnectArg);
+}
+
+static int jackbridge_record_portRename(jack_port_id_t port, const char* old_name, const char* new_name, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+
+    JackBridgeLogPort payload;
+    std::memset(&payload, 0, sizeof(payload));
+    payload.id = port;
+
+    gRecorder.record(kJackBridgeLogPortRename, rc, &payload, sizeof(payload), old_name, new_name);
+    return rc->portRename(port, old_name, new_name, rc->portRenameArg);
+}
+
+static int jackbridge_record_xrun(void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.record(kJackBridgeLogXRun, rc, nullptr, 0);
+    return rc->xrun(rc->xrunArg);
+}
+
+static void jackbridge_record_shutdown(void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordValue(kJackBridgeLogShutdown, rc, 0, "");
+    rc->shutdown(rc->shutdownArg);
+}
+
+static void jackbridge_record_infoShutdown(jack_status_t code, const char* reason, void* arg)
+{
+    JackBridgeRecordClient* const rc((JackBridgeRecordClient*)arg);
+    gRecorder.recordValue(kJackBridgeLogShutdown, rc, code, (reason != nullptr) ? reason : "");
+    rc->infoShutdown(code, reason, rc->infoShutdownArg);
+}
+
+// Swaps 'callback' and 'arg' for the recording ones above, if this client is being recorded
+#define JACKBRIDGE_RECORD_CALLBACK(client, member, callback, arg)                   \
+    if (callback != nullptr)                                                        \
+    {                                                                               \
+        if (JackBridgeRecordClient* const rc = gRecorder.getClient(client))         \
+        {                                                                           \
+            rc->member      = callback;                                             \
+            rc->member##Arg = arg;                                                  \
+            callback = jackbridge_record_##member;                                  \
+            arg      = rc;                                                          \
+        }                                                                           \
+    }
+
+// -----------------------------------------------------------------------------
+// Called by the jackbridge functions, passing their results through
+
+static inline
+jack_client_t* jackbridge_record_client_open(jack_client_t* const client)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    if (! gRecorder.isOpen())
+    {
+        const char* const filename(std::getenv("JACKBRIDGE_RECORD"));
+
+        if (filename == nullptr || filename[0] == '\0' || ! gRecorder.open(filename))
+            return client;
+    }
+
+    JackBridgeRecordClient* const rc(gRecorder.addClient(client));
+
+    gRecorder.record(kJackBridgeLogClientOpen, rc, nullptr, 0, jackbridge_get_client_name(client));
+    gRecorder.recordValue(kJackBridgeLogSampleRate, rc, int32_t(jackbridge_get_sample_rate(client)));
+    gRecorder.recordValue(kJackBridgeLogBufferSize, rc, int32_t(jackbridge_get_buffer_size(client)));
+
+    return client;
+}
+
+// after the client was closed, so none of its callbacks can run anymore
+static inline
+bool jackbridge_record_client_close(jack_client_t* const client, const bool ok)
+{
+    if (JackBridgeRecordClient* const rc = gRecorder.getClient(client))
+    {
+        gRecorder.record(kJackBridgeLogClientClose, rc, nullptr, 0);
+        gRecorder.removeClient(rc);
+    }
+
+    return ok;
+}
+
+static inline
+jack_port_t* jackbridge_record_port_open(jack_client_t* const client, jack_port_t* const port)
+{
+    if (port == nullptr)
+        return nullptr;
+
+    JackBridgeRecordClient* const rc(gRecorder.getClient(client));
+
+    if (rc == nullptr)
+        return port;
+
+    for (uint32_t i=0; i < JACKBRIDGE_RECORD_MAX_PORTS; ++i)
+    {
+        if (rc->ports[i].port.load() != nullptr)
+            continue;
+
+        const char* const portType(jackbridge_port_type(port));
+
+        rc->ports[i].isMidi = (portType != nullptr && std::strcmp(portType, JACK_DEFAULT_MIDI_TYPE) == 0);
+
+        // recorded first, so no cycle using the slot can go in the log before it
+        gRecorder.recordPort(kJackBridgeLogPortOpen, rc, port, 0, i, 1);
+        rc->ports[i].port.store(port, std::memory_order_release);
+        break;
+    }
+
+    return port;
+}
+
+// before the port is unregistered, while its name is still valid
+static inline
+void jackbridge_record_port_close(jack_client_t* const client, jack_port_t* const port)
+{
+    JackBridgeRecordClient* const rc(gRecorder.getClient(client));
+
+    if (rc == nullptr || port == nullptr)
+        return;
+
+    for (uint32_t i=0; i < JACKBRIDGE_RECORD_MAX_PORTS; ++i)
+    {
+        if (rc->ports[i].port.load() != port)
+            continue;
+
+        gRecorder.recordPort(kJackBridgeLogPortClose, rc, port, 0, i, 0);
+        rc->ports[i].port.store(nullptr, std::memory_order_release);
+        break;
+    }
+}
+
+// -----------------------------------------------------------------------------
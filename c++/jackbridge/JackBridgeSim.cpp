@@ -0,0 +1,2851 @@
+/*
+ * JackBridge, simulated in-process server
+ * Copyright (C) 2013 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Included by JackBridge.cpp when JACKBRIDGE_SIMULATE is defined.
+//
+// The whole jackbridge API, implemented against a server that lives in this process
+// instead of libjack. Clients, ports and connections are kept in memory, a timer thread
+// runs the process callbacks in graph order and mixes connected buffers, and
+// notifications are delivered from a separate thread, like jackd does.
+//
+// The server starts when the first client opens and stops when the last one closes.
+// It is configured with environment variables, read at start:
+//   JACKBRIDGE_SIM_BUFFER_SIZE  frames per cycle, default 256
+//   JACKBRIDGE_SIM_SAMPLE_RATE  default 48000
+//   JACKBRIDGE_SIM_CHANNELS     system audio capture and playback ports, default 2
+//   JACKBRIDGE_SIM_MIDI_RATE    CC messages per second sent from system:midi_capture_1, default 0
+//   JACKBRIDGE_SIM_XRUN_CYCLES  also report an xrun every this many cycles, default 0
+//   JACKBRIDGE_SIM_FREEWHEEL    if 1, run cycles back-to-back instead of in real time
+//   JACKBRIDGE_SIM_REALTIME     if 1, try to use SCHED_FIFO for the process thread
+//   JACKBRIDGE_REPLAY           a log written with JACKBRIDGE_RECORD, see below
+//
+// System capture ports carry a sine per channel (220 Hz, 440 Hz, ...) at -12 dBFS.
+//
+// With JACKBRIDGE_REPLAY, the first client that activates gets the recorded session of
+// the first recorded client instead, as fast as possible: each cycle with its input data,
+// frame time and transport, and all notifications in their original order, delivered
+// from the process thread so runs are deterministic. Ports of other clients named in the
+// log are created on the fly, so port lookups and connection queries keep working.
+// Once the log ends, the client gets a shutdown callback.
+
+#ifndef JACKBRIDGE_PROPER_CPP11_SUPPORT
+# error JACKBRIDGE_SIMULATE needs C++11
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "JackBridgeLog.hpp"
+#include "JackBridgeTiming.cpp"
+#include "JackBridgeCache.cpp"
+
+#ifdef JACKBRIDGE_OS_UNIX
+# include <fcntl.h>
+# include <pthread.h>
+# include <sched.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#define JACKBRIDGE_SIM_CLIENT_NAME_SIZE 64
+#define JACKBRIDGE_SIM_PORT_NAME_SIZE   320
+#define JACKBRIDGE_SIM_PORT_TYPE_SIZE   32
+#define JACKBRIDGE_SIM_MAX_BUFFER_SIZE  8192
+#define JACKBRIDGE_SIM_MIDI_EVENTS      1024
+#define JACKBRIDGE_SIM_MIDI_DATA_SIZE   32768
+#define JACKBRIDGE_SIM_MIDI_MAGIC       0x4d494449 // "MIDI"
+
+// -----------------------------------------------------------------------------
+// Port buffers
+
+struct JackSimMidiEvent {
+    uint32_t time;
+    uint32_t size;
+    uint32_t offset;
+};
+
+// what jackbridge_port_get_buffer() returns for MIDI ports
+struct JackSimMidiBuffer {
+    uint32_t magic;
+    uint32_t nframes;
+    uint32_t eventCount;
+    uint32_t dataUsed;
+    JackSimMidiEvent events[JACKBRIDGE_SIM_MIDI_EVENTS];
+    jack_midi_data_t data[JACKBRIDGE_SIM_MIDI_DATA_SIZE];
+};
+
+static inline
+JackSimMidiBuffer* jackbridge_sim_midi_buffer(void* const port_buffer)
+{
+    JackSimMidiBuffer* const buffer((JackSimMidiBuffer*)port_buffer);
+
+    if (buffer == nullptr || buffer->magic != JACKBRIDGE_SIM_MIDI_MAGIC)
+        return nullptr;
+
+    return buffer;
+}
+
+static inline
+jack_midi_data_t* jackbridge_sim_midi_reserve(JackSimMidiBuffer* const buffer, const jack_nframes_t time, const size_t size)
+{
+    // events must be written in order, and within the cycle
+    if (size == 0 || time >= buffer->nframes)
+        return nullptr;
+    if (buffer->eventCount > 0 && time < buffer->events[buffer->eventCount-1].time)
+        return nullptr;
+    if (buffer->eventCount == JACKBRIDGE_SIM_MIDI_EVENTS || buffer->dataUsed + size > JACKBRIDGE_SIM_MIDI_DATA_SIZE)
+        return nullptr;
+
+    JackSimMidiEvent& event(buffer->events[buffer->eventCount++]);
+    event.time   = time;
+    event.size   = size;
+    event.offset = buffer->dataUsed;
+
+    buffer->dataUsed += size;
+
+    return buffer->data + event.offset;
+}
+
+// -----------------------------------------------------------------------------
+// Server objects
+
+template<typename T>
+struct JackSimCallback {
+    T func;
+    void* arg;
+
+    JackSimCallback()
+        : func(nullptr),
+          arg(nullptr) {}
+
+    void set(T f, void* a)
+    {
+        func = f;
+        arg  = a;
+    }
+};
+
+struct _jack_port {
+    jack_port_id_t id;
+    jack_client_t* client;
+    char name[JACKBRIDGE_SIM_PORT_NAME_SIZE];
+    char type[JACKBRIDGE_SIM_PORT_TYPE_SIZE];
+    char aliases[2][JACKBRIDGE_SIM_PORT_NAME_SIZE];
+    int  flags;
+    bool isMidi;
+    bool registered;
+    int  monitorRequests;
+    jack_latency_range_t latency[2];
+
+    // for inputs the ports feeding them, for outputs the ports they feed
+    std::vector<jack_port_t*> connections;
+
+    std::vector<float> audio;
+    JackSimMidiBuffer* midi;
+
+    _jack_port()
+        : id(0),
+          client(nullptr),
+          flags(0),
+          isMidi(false),
+          registered(false),
+          monitorRequests(0),
+          midi(nullptr)
+    {
+        name[0] = type[0] = aliases[0][0] = aliases[1][0] = '\0';
+        latency[0].min = latency[0].max = latency[1].min = latency[1].max = 0;
+    }
+
+    ~_jack_port()
+    {
+        delete midi;
+    }
+};
+
+struct _jack_client {
+    char name[JACKBRIDGE_SIM_CLIENT_NAME_SIZE];
+    bool active;
+    bool zombie;
+    bool needsInit;
+    bool ghost; // only holds ports named in a replayed log
+    std::vector<jack_port_t*> ports;
+
+    JackSimCallback<JackProcessCallback>             process;
+    JackSimCallback<JackThreadInitCallback>          threadInit;
+    JackSimCallback<JackShutdownCallback>            shutdown;
+    JackSimCallback<JackInfoShutdownCallback>        infoShutdown;
+    JackSimCallback<JackFreewheelCallback>           freewheel;
+    JackSimCallback<JackBufferSizeCallback>          bufferSize;
+    JackSimCallback<JackSampleRateCallback>          sampleRate;
+    JackSimCallback<JackClientRegistrationCallback>  clientRegistration;
+    JackSimCallback<JackClientRenameCallback>        clientRename;
+    JackSimCallback<JackPortRegistrationCallback>    portRegistration;
+    JackSimCallback<JackPortConnectCallback>         portConnect;
+    JackSimCallback<JackPortRenameCallback>          portRename;
+    JackSimCallback<JackGraphOrderCallback>          graphOrder;
+    JackSimCallback<JackXRunCallback>                xrun;
+    JackSimCallback<JackLatencyCallback>             latency;
+    JackSimCallback<JackSyncCallback>                sync;
+    JackSimCallback<JackCustomDataAppearanceCallback> customData;
+
+    _jack_client()
+        : active(false),
+          zombie(false),
+          needsInit(false),
+          ghost(false)
+    {
+        name[0] = '\0';
+    }
+};
+
+struct JackSimNotification {
+    enum Type {
+        kClientRegistration,
+        kClientRename,
+        kPortRegistration,
+        kPortConnect,
+        kPortRename,
+        kGraphOrder,
+        kXRun,
+        kFreewheel,
+        kLatency,
+        kShutdown,
+        kCustomData
+    };
+
+    Type type;
+    jack_client_t* client; // receiver
+    jack_port_id_t portA, portB;
+    int value;
+    std::string str1, str2;
+
+    JackSimNotification(Type t, jack_client_t* c)
+        : type(t),
+          client(c),
+          portA(0),
+          portB(0),
+          value(0) {}
+};
+
+// -----------------------------------------------------------------------------
+// Replay log, mapped in memory where possible
+
+class JackSimLogReader
+{
+public:
+    JackSimLogReader()
+        : fData(nullptr),
+          fSize(0),
+          fPos(0),
+          fMapped(false) {}
+
+    ~JackSimLogReader()
+    {
+        close();
+    }
+
+    bool open(const char* const filename)
+    {
+#ifdef JACKBRIDGE_OS_UNIX
+        const int fd = ::open(filename, O_RDONLY);
+
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* const data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                fData   = (const char*)data;
+                fSize   = st.st_size;
+                fMapped = true;
+            }
+        }
+
+        ::close(fd);
+#else
+        if (FILE* const file = std::fopen(filename, "rb"))
+        {
+            char chunk[65536];
+            size_t count;
+
+            while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+                fBuffer.insert(fBuffer.end(), chunk, chunk + count);
+
+            std::fclose(file);
+
+            fData = fBuffer.size() > 0 ? &fBuffer[0] : nullptr;
+            fSize = fBuffer.size();
+        }
+#endif
+
+        const JackBridgeLogFileHeader* const header((const JackBridgeLogFileHeader*)fData);
+
+        if (fSize < sizeof(JackBridgeLogFileHeader) || std::memcmp(header->magic, JACKBRIDGE_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != JACKBRIDGE_LOG_VERSION)
+        {
+            close();
+            return false;
+        }
+
+        rewind();
+        return true;
+    }
+
+    void close()
+    {
+#ifdef JACKBRIDGE_OS_UNIX
+        if (fMapped)
+            munmap((void*)fData, fSize);
+#endif
+        fBuffer.clear();
+        fData   = nullptr;
+        fSize   = 0;
+        fMapped = false;
+    }
+
+    void rewind()
+    {
+        fPos = sizeof(JackBridgeLogFileHeader);
+    }
+
+    // null at the end, or at a record cut short by a crash
+    const JackBridgeLogRecord* next()
+    {
+        if (fData == nullptr || fPos + sizeof(JackBridgeLogRecord) > fSize)
+            return nullptr;
+
+        const JackBridgeLogRecord* const record((const JackBridgeLogRecord*)(fData + fPos));
+
+        if (fPos + sizeof(JackBridgeLogRecord) + record->size > fSize)
+            return nullptr;
+
+        fPos += sizeof(JackBridgeLogRecord) + record->size;
+        return record;
+    }
+
+    // the fixed part of a record, null if it is too short
+    template<typename T>
+    static const T* payload(const JackBridgeLogRecord* const record)
+    {
+        if (record->size < sizeof(T))
+            return nullptr;
+
+        return (const T*)(record + 1);
+    }
+
+    // the strings after the fixed part, "" if missing
+    static const char* string(const JackBridgeLogRecord* const record, const size_t fixedSize, const int index)
+    {
+        const char* str = (const char*)(record + 1) + fixedSize;
+        const char* const end = (const char*)(record + 1) + record->size;
+
+        for (int i=0; i <= index; ++i)
+        {
+            const char* const nul = (str < end) ? (const char*)std::memchr(str, '\0', end - str) : nullptr;
+
+            if (nul == nullptr)
+                return "";
+            if (i == index)
+                return str;
+
+            str = nul + 1;
+        }
+
+        return "";
+    }
+
+private:
+    const char* fData;
+    size_t fSize, fPos;
+    bool fMapped;
+    std::vector<char> fBuffer;
+};
+
+// -----------------------------------------------------------------------------
+// Server
+
+class JackSimServer
+{
+public:
+    JackSimServer()
+        : fSystem(nullptr),
+          fGraphChanged(false),
+          fBufferSize(256),
+          fPendingBufferSize(0),
+          fSampleRate(48000),
+          fCycleFrames(0),
+          fCycleStartNs(0),
+          fCpuLoad(0.0f),
+          fFreewheel(false),
+          fRealtime(false),
+          fRunning(false),
+          fChannels(2),
+          fMidiRate(0.0),
+          fMidiPending(0.0),
+          fMidiValue(0),
+          fXRunCycles(0),
+          fCycles(0),
+          fTransportState(JackTransportStopped),
+          fTransportFrame(0),
+          fTransportNewPos(true),
+          fTimebaseClient(nullptr),
+          fReplaying(false),
+          fReplayLost(0) {}
+
+    ~JackSimServer()
+    {
+        stop();
+    }
+
+    // all of the graph is protected by this; recursive, so callbacks running
+    // in the process thread can call back into the API
+    std::recursive_mutex fLock;
+
+    std::vector<jack_client_t*> fClients; // in open order, the system client first
+    std::vector<jack_client_t*> fOrder;   // process order, without the system client
+    jack_client_t* fSystem;
+    bool fGraphChanged;
+
+    std::vector<jack_port_t*> fPorts; // by id, ports are kept until the server stops
+    std::map<std::string, jack_port_t*> fPortsByName;
+
+    std::map<std::string, std::map<std::string, std::vector<unsigned char> > > fCustomData;
+
+    // readable from anywhere without the lock
+    std::atomic<uint32_t> fBufferSize;
+    std::atomic<uint32_t> fPendingBufferSize;
+    std::atomic<uint32_t> fSampleRate;
+    std::atomic<uint32_t> fCycleFrames;
+    std::atomic<int64_t>  fCycleStartNs;
+    std::atomic<float>    fCpuLoad;
+    std::atomic<bool>     fFreewheel;
+    std::atomic<bool>     fRealtime;
+    std::atomic<bool>     fRunning;
+
+    // system ports
+    uint32_t fChannels;
+    std::vector<double> fPhases;
+    double fMidiRate, fMidiPending;
+    uint32_t fMidiValue;
+    uint32_t fXRunCycles, fCycles;
+
+    // transport
+    jack_transport_state_t fTransportState;
+    jack_nframes_t fTransportFrame;
+    bool fTransportNewPos;
+    jack_position_t fTransportPos;
+    jack_client_t* fTimebaseClient;
+    JackSimCallback<JackTimebaseCallback> fTimebase;
+
+    // replay
+    JackSimLogReader fReplay;
+    bool fReplaying;
+    std::string fReplayClientName;                 // as recorded
+    std::map<uint32_t, std::string> fReplaySlots;  // recorded slot to the short name of an own port
+    std::map<uint32_t, jack_port_t*> fReplayPorts; // recorded port id to the port here
+    uint32_t fReplayLost;
+
+    // -------------------------------------------------------------------------
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint32_t getEnv(const char* const name, const uint32_t fallback)
+    {
+        if (const char* const value = std::getenv(name))
+            return uint32_t(std::atol(value));
+        return fallback;
+    }
+
+    bool isRunning() const
+    {
+        return fRunning.load(std::memory_order_acquire);
+    }
+
+    // -------------------------------------------------------------------------
+    // lifetime, called without the lock
+
+    void start()
+    {
+        uint32_t bufferSize = getEnv("JACKBRIDGE_SIM_BUFFER_SIZE", 256);
+
+        if (bufferSize < 16 || bufferSize > JACKBRIDGE_SIM_MAX_BUFFER_SIZE)
+            bufferSize = 256;
+
+        fBufferSize  = bufferSize;
+        fSampleRate  = getEnv("JACKBRIDGE_SIM_SAMPLE_RATE", 48000);
+        fChannels    = getEnv("JACKBRIDGE_SIM_CHANNELS", 2);
+        fMidiRate    = getEnv("JACKBRIDGE_SIM_MIDI_RATE", 0);
+        fXRunCycles  = getEnv("JACKBRIDGE_SIM_XRUN_CYCLES", 0);
+        fFreewheel   = (getEnv("JACKBRIDGE_SIM_FREEWHEEL", 0) != 0);
+        fMidiPending = 0.0;
+        fMidiValue   = 0;
+        fCycles      = 0;
+        fCycleFrames = 0;
+        fCpuLoad     = 0.0f;
+
+        if (fSampleRate == 0)
+            fSampleRate = 48000;
+
+        fTransportState  = JackTransportStopped;
+        fTransportFrame  = 0;
+        fTransportNewPos = true;
+        std::memset(&fTransportPos, 0, sizeof(fTransportPos));
+
+        const char* const replayFile(std::getenv("JACKBRIDGE_REPLAY"));
+        fReplaying = (replayFile != nullptr && replayFile[0] != '\0' && fReplay.open(replayFile));
+
+        if (fReplaying)
+            startReplay();
+
+        // the system client, hardware ports that are always there
+        fSystem = new jack_client_t;
+        std::strcpy(fSystem->name, "system");
+        fSystem->active = true;
+        fClients.push_back(fSystem);
+
+        char portName[32];
+        const int physical = JackPortIsPhysical|JackPortIsTerminal;
+
+        for (uint32_t i=0; i < fChannels; ++i)
+        {
+            std::snprintf(portName, sizeof(portName), "capture_%u", i+1);
+            registerPort(fSystem, portName, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput|physical);
+        }
+        for (uint32_t i=0; i < fChannels; ++i)
+        {
+            std::snprintf(portName, sizeof(portName), "playback_%u", i+1);
+            registerPort(fSystem, portName, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput|physical);
+        }
+
+        registerPort(fSystem, "midi_capture_1", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput|physical);
+        registerPort(fSystem, "midi_playback_1", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput|physical);
+
+        fPhases.assign(fChannels, 0.0);
+
+        fRunning = true;
+        fProcessThread = std::thread(&JackSimServer::runProcess, this);
+        fNotifyThread  = std::thread(&JackSimServer::runNotifications, this);
+    }
+
+    void stop()
+    {
+        if (! isRunning())
+            return;
+
+        fRunning = false;
+
+        {
+            std::lock_guard<std::mutex> lock(fQueueLock);
+            fQueueCond.notify_all();
+        }
+
+        fProcessThread.join();
+        fNotifyThread.join();
+
+        std::lock_guard<std::recursive_mutex> lock(fLock);
+
+        for (size_t i=0; i < fPorts.size(); ++i)
+            delete fPorts[i];
+        for (size_t i=0; i < fClients.size(); ++i)
+            delete fClients[i];
+
+        fPorts.clear();
+        fPortsByName.clear();
+        fClients.clear();
+        fOrder.clear();
+        fCustomData.clear();
+        fQueue.clear();
+        fSystem = nullptr;
+        fTimebaseClient = nullptr;
+        fTimebase.set(nullptr, nullptr);
+        fRealtime = false;
+
+        fReplay.close();
+        fReplaying = false;
+        fReplayClientName.clear();
+        fReplaySlots.clear();
+        fReplayPorts.clear();
+    }
+
+    // clients opened through the API, not the system or ghost ones
+    bool hasClients() const
+    {
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (fClients[i] != fSystem && ! fClients[i]->ghost)
+                return true;
+        }
+        return false;
+    }
+
+    // -------------------------------------------------------------------------
+    // graph changes, called with the lock held
+
+    jack_client_t* findClient(const char* const name) const
+    {
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (std::strcmp(fClients[i]->name, name) == 0)
+                return fClients[i];
+        }
+        return nullptr;
+    }
+
+    jack_port_t* findPort(const char* const name) const
+    {
+        if (name == nullptr)
+            return nullptr;
+
+        const std::map<std::string, jack_port_t*>::const_iterator it(fPortsByName.find(name));
+        return (it != fPortsByName.end()) ? it->second : nullptr;
+    }
+
+    jack_port_t* registerPort(jack_client_t* const client, const char* const shortName, const char* const type, const int flags)
+    {
+        const bool isAudio = (std::strcmp(type, JACK_DEFAULT_AUDIO_TYPE) == 0);
+        const bool isMidi  = (std::strcmp(type, JACK_DEFAULT_MIDI_TYPE) == 0);
+
+        if (! (isAudio || isMidi))
+            return nullptr;
+        if ((flags & (JackPortIsInput|JackPortIsOutput)) == 0 || (flags & (JackPortIsInput|JackPortIsOutput)) == (JackPortIsInput|JackPortIsOutput))
+            return nullptr;
+
+        char name[JACKBRIDGE_SIM_PORT_NAME_SIZE];
+        if (std::snprintf(name, sizeof(name), "%s:%s", client->name, shortName) >= int(sizeof(name)))
+            return nullptr;
+        if (findPort(name) != nullptr)
+            return nullptr;
+
+        jack_port_t* const port = new jack_port_t;
+        port->id         = fPorts.size();
+        port->client     = client;
+        port->flags      = flags;
+        port->isMidi     = isMidi;
+        port->registered = true;
+        std::strcpy(port->name, name);
+        std::strcpy(port->type, type);
+
+        if (isMidi)
+        {
+            port->midi = new JackSimMidiBuffer;
+            port->midi->magic      = JACKBRIDGE_SIM_MIDI_MAGIC;
+            port->midi->nframes    = fBufferSize;
+            port->midi->eventCount = 0;
+            port->midi->dataUsed   = 0;
+        }
+        else
+        {
+            port->audio.assign(JACKBRIDGE_SIM_MAX_BUFFER_SIZE, 0.0f);
+        }
+
+        fPorts.push_back(port);
+        fPortsByName[name] = port;
+        client->ports.push_back(port);
+
+        notifyPortRegistration(port->id, 1);
+        return port;
+    }
+
+    void unregisterPort(jack_port_t* const port)
+    {
+        disconnectAll(port);
+
+        jack_client_t* const client(port->client);
+        client->ports.erase(std::find(client->ports.begin(), client->ports.end(), port));
+
+        fPortsByName.erase(port->name);
+        port->registered = false;
+        port->client     = nullptr;
+
+        notifyPortRegistration(port->id, 0);
+    }
+
+    bool connect(jack_port_t* const src, jack_port_t* const dst)
+    {
+        if ((src->flags & JackPortIsOutput) == 0 || (dst->flags & JackPortIsInput) == 0)
+            return false;
+        if (src->isMidi != dst->isMidi)
+            return false;
+        if (std::find(src->connections.begin(), src->connections.end(), dst) != src->connections.end())
+            return false;
+
+        src->connections.push_back(dst);
+        dst->connections.push_back(src);
+
+        fGraphChanged = true;
+        notifyConnect(src->id, dst->id, 1);
+        return true;
+    }
+
+    bool disconnect(jack_port_t* const src, jack_port_t* const dst)
+    {
+        std::vector<jack_port_t*>::iterator it(std::find(src->connections.begin(), src->connections.end(), dst));
+
+        if (it == src->connections.end())
+            return false;
+
+        src->connections.erase(it);
+        dst->connections.erase(std::find(dst->connections.begin(), dst->connections.end(), src));
+
+        fGraphChanged = true;
+        notifyConnect(src->id, dst->id, 0);
+        return true;
+    }
+
+    void disconnectAll(jack_port_t* const port)
+    {
+        while (port->connections.size() > 0)
+        {
+            jack_port_t* const other(port->connections.back());
+
+            if (port->flags & JackPortIsOutput)
+                disconnect(port, other);
+            else
+                disconnect(other, port);
+        }
+    }
+
+    void deactivate(jack_client_t* const client)
+    {
+        for (size_t i=0; i < client->ports.size(); ++i)
+            disconnectAll(client->ports[i]);
+
+        client->active = false;
+        fOrder.erase(std::remove(fOrder.begin(), fOrder.end(), client), fOrder.end());
+        fGraphChanged = true;
+    }
+
+    // -------------------------------------------------------------------------
+    // notifications, queued with the lock held and delivered without it
+
+    void queue(const JackSimNotification& notification)
+    {
+        std::lock_guard<std::mutex> lock(fQueueLock);
+        fQueue.push_back(notification);
+        fQueueCond.notify_one();
+    }
+
+    // one notification per active client that is interested in it
+    // when replaying, clients only get the recorded notifications
+    template<typename T>
+    void queueForAll(JackSimNotification notification, JackSimCallback<T> _jack_client::* callback)
+    {
+        if (fReplaying)
+            return;
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            jack_client_t* const client(fClients[i]);
+
+            if (client == fSystem || client->ghost || ! client->active || (client->*callback).func == nullptr)
+                continue;
+
+            notification.client = client;
+            queue(notification);
+        }
+    }
+
+    void notifyClientRegistration(const char* const name, const int register_)
+    {
+        JackSimNotification notification(JackSimNotification::kClientRegistration, nullptr);
+        notification.str1  = name;
+        notification.value = register_;
+        queueForAll(notification, &_jack_client::clientRegistration);
+    }
+
+    void notifyPortRegistration(const jack_port_id_t id, const int register_)
+    {
+        JackSimNotification notification(JackSimNotification::kPortRegistration, nullptr);
+        notification.portA = id;
+        notification.value = register_;
+        queueForAll(notification, &_jack_client::portRegistration);
+    }
+
+    void notifyConnect(const jack_port_id_t a, const jack_port_id_t b, const int connect)
+    {
+        JackSimNotification notification(JackSimNotification::kPortConnect, nullptr);
+        notification.portA = a;
+        notification.portB = b;
+        notification.value = connect;
+        queueForAll(notification, &_jack_client::portConnect);
+    }
+
+    // removes everything still queued for a client that is going away,
+    // and waits for the one being delivered to it right now, if any
+    void purgeNotifications(jack_client_t* const client)
+    {
+        {
+            std::lock_guard<std::mutex> lock(fQueueLock);
+
+            for (std::deque<JackSimNotification>::iterator it=fQueue.begin(); it != fQueue.end();)
+            {
+                if (it->client == client)
+                    it = fQueue.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(fNotifyLock);
+    }
+
+private:
+    std::thread fProcessThread;
+    std::thread fNotifyThread;
+
+    std::recursive_mutex fNotifyLock;
+    std::mutex fQueueLock;
+    std::condition_variable fQueueCond;
+    std::deque<JackSimNotification> fQueue;
+
+    // -------------------------------------------------------------------------
+
+    void runNotifications()
+    {
+        while (isRunning())
+        {
+            {
+                std::unique_lock<std::mutex> lock(fQueueLock);
+
+                // woken up by queue() and stop()
+                while (fQueue.size() == 0 && isRunning())
+                    fQueueCond.wait(lock);
+            }
+
+            // held while delivering, see purgeNotifications()
+            std::lock_guard<std::recursive_mutex> notifyLock(fNotifyLock);
+            std::unique_lock<std::mutex> lock(fQueueLock);
+
+            if (fQueue.size() == 0 || ! isRunning())
+                continue;
+
+            const JackSimNotification notification(fQueue.front());
+            fQueue.pop_front();
+
+            lock.unlock();
+            deliver(notification);
+        }
+    }
+
+    void deliver(const JackSimNotification& n)
+    {
+        jack_client_t* const c(n.client);
+
+        switch (n.type)
+        {
+        case JackSimNotification::kClientRegistration:
+            if (c->clientRegistration.func != nullptr)
+                c->clientRegistration.func(n.str1.c_str(), n.value, c->clientRegistration.arg);
+            break;
+        case JackSimNotification::kClientRename:
+            if (c->clientRename.func != nullptr)
+                c->clientRename.func(n.str1.c_str(), n.str2.c_str(), c->clientRename.arg);
+            break;
+        case JackSimNotification::kPortRegistration:
+            if (c->portRegistration.func != nullptr)
+                c->portRegistration.func(n.portA, n.value, c->portRegistration.arg);
+            break;
+        case JackSimNotification::kPortConnect:
+            if (c->portConnect.func != nullptr)
+                c->portConnect.func(n.portA, n.portB, n.value, c->portConnect.arg);
+            break;
+        case JackSimNotification::kPortRename:
+            if (c->portRename.func != nullptr)
+                c->portRename.func(n.portA, n.str1.c_str(), n.str2.c_str(), c->portRename.arg);
+            break;
+        case JackSimNotification::kGraphOrder:
+            if (c->graphOrder.func != nullptr)
+                c->graphOrder.func(c->graphOrder.arg);
+            break;
+        case JackSimNotification::kXRun:
+            if (c->xrun.func != nullptr)
+                c->xrun.func(c->xrun.arg);
+            break;
+        case JackSimNotification::kFreewheel:
+            if (c->freewheel.func != nullptr)
+                c->freewheel.func(n.value, c->freewheel.arg);
+            break;
+        case JackSimNotification::kLatency:
+            if (c->latency.func != nullptr)
+            {
+                c->latency.func(JackCaptureLatency, c->latency.arg);
+                c->latency.func(JackPlaybackLatency, c->latency.arg);
+            }
+            break;
+        case JackSimNotification::kShutdown:
+            if (c->infoShutdown.func != nullptr)
+                c->infoShutdown.func(jack_status_t(n.value), n.str1.c_str(), c->infoShutdown.arg);
+            else if (c->shutdown.func != nullptr)
+                c->shutdown.func(c->shutdown.arg);
+            break;
+        case JackSimNotification::kCustomData:
+            if (c->customData.func != nullptr)
+                c->customData.func(n.str1.c_str(), n.str2.c_str(), jack_custom_change_t(n.value), c->customData.arg);
+            break;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // process thread
+
+    void runProcess()
+    {
+#ifdef JACKBRIDGE_OS_UNIX
+        if (getEnv("JACKBRIDGE_SIM_REALTIME", 0) != 0)
+        {
+            sched_param param;
+            param.sched_priority = 70;
+            fRealtime = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0);
+        }
+#endif
+
+        if (fReplaying)
+        {
+            runReplay();
+            return;
+        }
+
+        int64_t wakeTime = now();
+
+        while (isRunning())
+        {
+            const uint32_t nframes = runCycle(wakeTime);
+            const int64_t  endTime = now();
+            const int64_t  period  = int64_t(nframes) * 1000000000LL / fSampleRate;
+
+            const float load = float(endTime - wakeTime) / float(period) * 100.0f;
+            fCpuLoad = fCpuLoad * 0.9f + load * 0.1f;
+
+            if (fFreewheel)
+            {
+                // let the other threads get to the lock
+                std::this_thread::yield();
+                wakeTime = now();
+                continue;
+            }
+
+            const int64_t deadline = wakeTime + period;
+            const bool injectedXRun = (fXRunCycles != 0 && fCycles % fXRunCycles == 0);
+
+            if (endTime > deadline || injectedXRun)
+            {
+                std::lock_guard<std::recursive_mutex> lock(fLock);
+                queueForAll(JackSimNotification(JackSimNotification::kXRun, nullptr), &_jack_client::xrun);
+            }
+
+            if (endTime > deadline)
+            {
+                // late, start over from here
+                wakeTime = endTime;
+                continue;
+            }
+
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - endTime));
+            wakeTime = deadline;
+        }
+    }
+
+    uint32_t runCycle(const int64_t wakeTime)
+    {
+        std::lock_guard<std::recursive_mutex> lock(fLock);
+
+        if (const uint32_t pending = fPendingBufferSize.exchange(0))
+            applyBufferSize(pending);
+
+        const uint32_t nframes = fBufferSize;
+
+        fCycleStartNs = wakeTime;
+        ++fCycles;
+
+        runSync();
+        generateSystemInput(nframes);
+
+        processClients(nframes, nullptr);
+
+        for (size_t i=0; i < fSystem->ports.size(); ++i)
+        {
+            if (fSystem->ports[i]->flags & JackPortIsInput)
+                mixInput(fSystem->ports[i], nframes);
+        }
+
+        runTimebase(nframes);
+
+        fCycleFrames = fCycleFrames + nframes;
+        return nframes;
+    }
+
+    // 'inputsReady' is a client whose input buffers were filled already
+    void processClients(const uint32_t nframes, jack_client_t* const inputsReady)
+    {
+        if (fGraphChanged)
+            sortClients();
+
+        for (size_t i=0; i < fOrder.size(); ++i)
+        {
+            jack_client_t* const client(fOrder[i]);
+
+            if (client->zombie)
+                continue;
+
+            if (client->needsInit)
+            {
+                client->needsInit = false;
+
+                if (client->threadInit.func != nullptr)
+                    client->threadInit.func(client->threadInit.arg);
+                if (client->bufferSize.func != nullptr)
+                    client->bufferSize.func(nframes, client->bufferSize.arg);
+                if (client->sampleRate.func != nullptr)
+                    client->sampleRate.func(fSampleRate, client->sampleRate.arg);
+            }
+
+            for (size_t j=0; j < client->ports.size() && client != inputsReady; ++j)
+            {
+                if (client->ports[j]->flags & JackPortIsInput)
+                    mixInput(client->ports[j], nframes);
+            }
+
+            if (client->process.func != nullptr && client->process.func(nframes, client->process.arg) != 0)
+            {
+                // removed from the graph, like jackd does
+                client->zombie = true;
+
+                JackSimNotification notification(JackSimNotification::kShutdown, client);
+                notification.str1  = "process callback failed";
+                notification.value = JackClientZombie;
+                queue(notification);
+            }
+        }
+    }
+
+    void applyBufferSize(const uint32_t bufferSize)
+    {
+        fBufferSize = bufferSize;
+
+        for (size_t i=0; i < fPorts.size(); ++i)
+        {
+            if (fPorts[i]->midi != nullptr)
+            {
+                fPorts[i]->midi->nframes    = bufferSize;
+                fPorts[i]->midi->eventCount = 0;
+                fPorts[i]->midi->dataUsed   = 0;
+            }
+        }
+
+        for (size_t i=0; i < fOrder.size(); ++i)
+        {
+            jack_client_t* const client(fOrder[i]);
+
+            if (client->bufferSize.func != nullptr && ! client->needsInit)
+                client->bufferSize.func(bufferSize, client->bufferSize.arg);
+        }
+    }
+
+    // clients feeding others come first; clients in a feedback loop keep their open order
+    void sortClients()
+    {
+        fGraphChanged = false;
+
+        std::vector<jack_client_t*> pending;
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (fClients[i] != fSystem && ! fClients[i]->ghost && fClients[i]->active)
+                pending.push_back(fClients[i]);
+        }
+
+        fOrder.clear();
+
+        while (pending.size() > 0)
+        {
+            size_t next = 0;
+
+            for (; next < pending.size(); ++next)
+            {
+                if (! isFedByAny(pending[next], pending))
+                    break;
+            }
+
+            if (next == pending.size())
+                next = 0;
+
+            fOrder.push_back(pending[next]);
+            pending.erase(pending.begin() + next);
+        }
+
+        queueForAll(JackSimNotification(JackSimNotification::kGraphOrder, nullptr), &_jack_client::graphOrder);
+    }
+
+    static bool isFedByAny(jack_client_t* const client, const std::vector<jack_client_t*>& others)
+    {
+        for (size_t i=0; i < client->ports.size(); ++i)
+        {
+            const jack_port_t* const port(client->ports[i]);
+
+            if ((port->flags & JackPortIsInput) == 0)
+                continue;
+
+            for (size_t j=0; j < port->connections.size(); ++j)
+            {
+                jack_client_t* const source(port->connections[j]->client);
+
+                if (source != client && std::find(others.begin(), others.end(), source) != others.end())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    void mixInput(jack_port_t* const port, const uint32_t nframes)
+    {
+        if (port->isMidi)
+        {
+            JackSimMidiBuffer* const buffer(port->midi);
+            buffer->eventCount = 0;
+            buffer->dataUsed   = 0;
+
+            if (port->connections.size() == 0)
+                return;
+
+            // merged in time order, earlier connections first for equal times
+            std::vector<uint32_t> positions(port->connections.size(), 0);
+
+            for (;;)
+            {
+                const JackSimMidiBuffer* source = nullptr;
+                size_t sourceIndex = 0;
+
+                for (size_t i=0; i < port->connections.size(); ++i)
+                {
+                    const JackSimMidiBuffer* const other(port->connections[i]->midi);
+
+                    if (positions[i] >= other->eventCount)
+                        continue;
+                    if (source == nullptr || other->events[positions[i]].time < source->events[positions[sourceIndex]].time)
+                    {
+                        source = other;
+                        sourceIndex = i;
+                    }
+                }
+
+                if (source == nullptr)
+                    break;
+
+                const JackSimMidiEvent& event(source->events[positions[sourceIndex]++]);
+
+                if (jack_midi_data_t* const data = jackbridge_sim_midi_reserve(buffer, event.time, event.size))
+                    std::memcpy(data, source->data + event.offset, event.size);
+            }
+            return;
+        }
+
+        float* const buffer(&port->audio[0]);
+
+        if (port->connections.size() == 0)
+        {
+            std::memset(buffer, 0, sizeof(float)*nframes);
+            return;
+        }
+
+        std::memcpy(buffer, &port->connections[0]->audio[0], sizeof(float)*nframes);
+
+        for (size_t i=1; i < port->connections.size(); ++i)
+        {
+            const float* const source(&port->connections[i]->audio[0]);
+
+            for (uint32_t j=0; j < nframes; ++j)
+                buffer[j] += source[j];
+        }
+    }
+
+    void generateSystemInput(const uint32_t nframes)
+    {
+        const double sampleRate = fSampleRate;
+        uint32_t channel = 0;
+
+        for (size_t i=0; i < fSystem->ports.size(); ++i)
+        {
+            jack_port_t* const port(fSystem->ports[i]);
+
+            if ((port->flags & JackPortIsOutput) == 0)
+                continue;
+
+            if (port->isMidi)
+            {
+                generateMidiInput(port->midi, nframes);
+                continue;
+            }
+
+            // a different frequency per channel, 0.25 is -12 dBFS
+            const double step = 2.0 * M_PI * 220.0 * (channel + 1) / sampleRate;
+            double& phase(fPhases[channel++]);
+
+            for (uint32_t j=0; j < nframes; ++j)
+            {
+                port->audio[j] = float(0.25 * std::sin(phase));
+                phase += step;
+            }
+
+            phase = std::fmod(phase, 2.0 * M_PI);
+        }
+    }
+
+    // CC#1 on channel 1, sweeping up and down, evenly spread over the cycle
+    void generateMidiInput(JackSimMidiBuffer* const buffer, const uint32_t nframes)
+    {
+        buffer->eventCount = 0;
+        buffer->dataUsed   = 0;
+
+        if (fMidiRate <= 0.0)
+            return;
+
+        fMidiPending += fMidiRate * nframes / fSampleRate;
+
+        const uint32_t count = uint32_t(fMidiPending);
+        fMidiPending -= count;
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            jack_midi_data_t* const data = jackbridge_sim_midi_reserve(buffer, i * nframes / count, 3);
+
+            if (data == nullptr)
+                break;
+
+            fMidiValue = (fMidiValue + 1) % 254;
+
+            data[0] = 0xB0;
+            data[1] = 0x01;
+            data[2] = (fMidiValue < 127) ? fMidiValue : 253 - fMidiValue;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // replay
+
+    // sample rate and buffer size are known before the client activates
+    void startReplay()
+    {
+        fFreewheel  = true;
+        fReplayLost = 0;
+
+        bool gotSampleRate = false, gotBufferSize = false;
+
+        while (const JackBridgeLogRecord* const record = fReplay.next())
+        {
+            if (record->type == kJackBridgeLogCycle)
+                break;
+            if (record->client != 0)
+                continue;
+
+            const JackBridgeLogValue* const value(JackSimLogReader::payload<JackBridgeLogValue>(record));
+
+            if (value == nullptr || value->value <= 0)
+                continue;
+
+            if (record->type == kJackBridgeLogSampleRate && ! gotSampleRate)
+            {
+                fSampleRate = value->value;
+                gotSampleRate = true;
+            }
+            else if (record->type == kJackBridgeLogBufferSize && ! gotBufferSize && value->value <= JACKBRIDGE_SIM_MAX_BUFFER_SIZE)
+            {
+                fBufferSize = value->value;
+                gotBufferSize = true;
+            }
+        }
+
+        fReplay.rewind();
+    }
+
+    // the first client that was opened and activated
+    jack_client_t* replayTarget() const
+    {
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            jack_client_t* const client(fClients[i]);
+
+            if (client != fSystem && ! client->ghost)
+                return client->active ? client : nullptr;
+        }
+        return nullptr;
+    }
+
+    void runReplay()
+    {
+        while (isRunning())
+        {
+            {
+                std::lock_guard<std::recursive_mutex> lock(fLock);
+
+                if (replayTarget() != nullptr)
+                    break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        while (isRunning())
+        {
+            const JackBridgeLogRecord* const record(fReplay.next());
+
+            if (record == nullptr)
+                break;
+
+            // only the first recorded client
+            if (record->client != 0)
+                continue;
+
+            {
+                std::lock_guard<std::recursive_mutex> lock(fLock);
+
+                jack_client_t* const client(replayTarget());
+
+                if (client == nullptr)
+                    break;
+
+                replayRecord(client, record);
+            }
+
+            // let the other threads get to the lock
+            if (record->type == kJackBridgeLogCycle)
+                std::this_thread::yield();
+        }
+
+        if (isRunning())
+        {
+            std::lock_guard<std::recursive_mutex> lock(fLock);
+
+            if (jack_client_t* const client = replayTarget())
+            {
+                JackSimNotification notification(JackSimNotification::kShutdown, client);
+                notification.str1  = (fReplayLost > 0) ? "replay finished, the log had dropped records" : "replay finished";
+                notification.value = JackServerError;
+                queue(notification);
+            }
+        }
+    }
+
+    void replayRecord(jack_client_t* const client, const JackBridgeLogRecord* const record)
+    {
+        const JackBridgeLogValue* const value(JackSimLogReader::payload<JackBridgeLogValue>(record));
+        const JackBridgeLogPort*  const port(JackSimLogReader::payload<JackBridgeLogPort>(record));
+
+        switch (record->type)
+        {
+        case kJackBridgeLogClientOpen:
+            fReplayClientName = JackSimLogReader::string(record, 0, 0);
+            break;
+
+        case kJackBridgeLogSampleRate:
+            if (value != nullptr && value->value > 0 && uint32_t(value->value) != fSampleRate)
+            {
+                fSampleRate = value->value;
+
+                if (client->sampleRate.func != nullptr && ! client->needsInit)
+                    client->sampleRate.func(fSampleRate, client->sampleRate.arg);
+            }
+            break;
+
+        case kJackBridgeLogBufferSize:
+            if (value != nullptr && value->value >= 16 && value->value <= JACKBRIDGE_SIM_MAX_BUFFER_SIZE && uint32_t(value->value) != fBufferSize)
+                applyBufferSize(value->value);
+            break;
+
+        case kJackBridgeLogPortOpen:
+            if (port != nullptr)
+                fReplaySlots[port->slot] = shortName(JackSimLogReader::string(record, sizeof(JackBridgeLogPort), 0));
+            break;
+
+        case kJackBridgeLogPortClose:
+            if (port != nullptr)
+                fReplaySlots.erase(port->slot);
+            break;
+
+        case kJackBridgeLogPortRegistration:
+            if (port != nullptr)
+            {
+                jack_port_t* const ours(replayPort(port->id, JackSimLogReader::string(record, sizeof(JackBridgeLogPort), 0), port->flags, port->isMidi));
+
+                if (ours == nullptr)
+                    break;
+
+                if (port->value == 0 && ours->registered && ours->client != nullptr && ours->client->ghost)
+                    unregisterPort(ours);
+
+                JackSimNotification notification(JackSimNotification::kPortRegistration, client);
+                notification.portA = ours->id;
+                notification.value = port->value;
+                deliver(notification);
+            }
+            break;
+
+        case kJackBridgeLogPortConnect:
+            if (const JackBridgeLogConnect* const connection = JackSimLogReader::payload<JackBridgeLogConnect>(record))
+                replayConnect(client, connection,
+                              JackSimLogReader::string(record, sizeof(JackBridgeLogConnect), 0),
+                              JackSimLogReader::string(record, sizeof(JackBridgeLogConnect), 1));
+            break;
+
+        case kJackBridgeLogPortRename:
+            if (port != nullptr)
+            {
+                const std::map<uint32_t, jack_port_t*>::const_iterator it(fReplayPorts.find(port->id));
+
+                if (it == fReplayPorts.end())
+                    break;
+
+                JackSimNotification notification(JackSimNotification::kPortRename, client);
+                notification.portA = it->second->id;
+                notification.str1  = JackSimLogReader::string(record, sizeof(JackBridgeLogPort), 0);
+                notification.str2  = JackSimLogReader::string(record, sizeof(JackBridgeLogPort), 1);
+                deliver(notification);
+            }
+            break;
+
+        case kJackBridgeLogClientRegistration:
+            if (value != nullptr)
+            {
+                JackSimNotification notification(JackSimNotification::kClientRegistration, client);
+                notification.str1  = JackSimLogReader::string(record, sizeof(JackBridgeLogValue), 0);
+                notification.value = value->value;
+                deliver(notification);
+            }
+            break;
+
+        case kJackBridgeLogGraphOrder:
+            deliver(JackSimNotification(JackSimNotification::kGraphOrder, client));
+            break;
+
+        case kJackBridgeLogXRun:
+            deliver(JackSimNotification(JackSimNotification::kXRun, client));
+            break;
+
+        case kJackBridgeLogFreewheel:
+        case kJackBridgeLogShutdown:
+            if (value != nullptr)
+            {
+                const bool freewheel = (record->type == kJackBridgeLogFreewheel);
+
+                JackSimNotification notification(freewheel ? JackSimNotification::kFreewheel : JackSimNotification::kShutdown, client);
+                notification.value = value->value;
+
+                if (! freewheel)
+                    notification.str1 = JackSimLogReader::string(record, sizeof(JackBridgeLogValue), 0);
+
+                deliver(notification);
+            }
+            break;
+
+        case kJackBridgeLogCycle:
+            replayCycle(client, record);
+            break;
+
+        case kJackBridgeLogLost:
+            if (value != nullptr)
+                fReplayLost += value->value;
+            break;
+        }
+    }
+
+    void replayConnect(jack_client_t* const client, const JackBridgeLogConnect* const connection, const char* const sourceName, const char* const destinationName)
+    {
+        // look both up first, so a port created here gets the type of the other one
+        jack_port_t* source(replayPort(connection->source, sourceName, JackPortIsOutput, false, false));
+        jack_port_t* destination(replayPort(connection->destination, destinationName, JackPortIsInput, false, false));
+
+        if (source == nullptr)
+            source = replayPort(connection->source, sourceName, JackPortIsOutput, destination != nullptr && destination->isMidi);
+        if (destination == nullptr)
+            destination = replayPort(connection->destination, destinationName, JackPortIsInput, source != nullptr && source->isMidi);
+
+        if (source == nullptr || destination == nullptr)
+            return;
+
+        // may fail if the client made the same connection itself already
+        if (connection->connect != 0)
+            connect(source, destination);
+        else
+            disconnect(source, destination);
+
+        JackSimNotification notification(JackSimNotification::kPortConnect, client);
+        notification.portA = source->id;
+        notification.portB = destination->id;
+        notification.value = connection->connect;
+        deliver(notification);
+    }
+
+    static std::string shortName(const char* const name)
+    {
+        const char* const sep(std::strchr(name, ':'));
+        return (sep != nullptr) ? sep + 1 : name;
+    }
+
+    jack_port_t* findOwnPort(jack_client_t* const client, const std::string& name) const
+    {
+        for (size_t i=0; i < client->ports.size(); ++i)
+        {
+            if (name == jackbridge_port_short_name(client->ports[i]))
+                return client->ports[i];
+        }
+        return nullptr;
+    }
+
+    // the port here for a recorded one, ports of other clients are made up if needed
+    jack_port_t* replayPort(const uint32_t id, const char* const name, const int flags, const bool isMidi, const bool create = true)
+    {
+        const std::map<uint32_t, jack_port_t*>::const_iterator it(fReplayPorts.find(id));
+
+        // jack reuses the ids of unregistered ports
+        if (it != fReplayPorts.end() && std::strcmp(it->second->name, name) == 0)
+            return it->second;
+
+        const char* const sep(std::strchr(name, ':'));
+
+        if (sep == nullptr)
+            return nullptr;
+
+        const std::string clientName(name, sep - name);
+        jack_port_t* port;
+
+        if (clientName == fReplayClientName)
+        {
+            jack_client_t* const client(replayTarget());
+            port = (client != nullptr) ? findOwnPort(client, sep + 1) : nullptr;
+        }
+        else
+        {
+            port = findPort(name);
+
+            if (port == nullptr && create)
+            {
+                jack_client_t* ghost(findClient(clientName.c_str()));
+
+                if (ghost == nullptr && clientName.size() < JACKBRIDGE_SIM_CLIENT_NAME_SIZE)
+                {
+                    ghost = new jack_client_t;
+                    ghost->ghost = true;
+                    std::strcpy(ghost->name, clientName.c_str());
+                    fClients.push_back(ghost);
+                }
+
+                if (ghost != nullptr)
+                    port = registerPort(ghost, sep + 1, isMidi ? JACK_DEFAULT_MIDI_TYPE : JACK_DEFAULT_AUDIO_TYPE, flags);
+            }
+        }
+
+        if (port != nullptr)
+            fReplayPorts[id] = port;
+
+        return port;
+    }
+
+    void replayCycle(jack_client_t* const client, const JackBridgeLogRecord* const record)
+    {
+        const JackBridgeLogCycle* const cycle(JackSimLogReader::payload<JackBridgeLogCycle>(record));
+
+        if (cycle == nullptr || cycle->nframes == 0 || cycle->nframes > JACKBRIDGE_SIM_MAX_BUFFER_SIZE)
+            return;
+
+        if (cycle->nframes != fBufferSize)
+            applyBufferSize(cycle->nframes);
+
+        const uint32_t nframes = cycle->nframes;
+
+        fCycleFrames    = cycle->lastFrameTime;
+        fCycleStartNs   = now();
+        fTransportState = jack_transport_state_t(cycle->transportState);
+        fTransportFrame = cycle->transportFrame;
+        ++fCycles;
+
+        // what was not recorded stays silent
+        for (size_t i=0; i < client->ports.size(); ++i)
+        {
+            jack_port_t* const port(client->ports[i]);
+
+            if ((port->flags & JackPortIsInput) == 0)
+                continue;
+
+            if (port->isMidi)
+                port->midi->eventCount = port->midi->dataUsed = 0;
+            else
+                std::memset(&port->audio[0], 0, sizeof(float)*nframes);
+        }
+
+        const char* data = (const char*)(record + 1) + sizeof(JackBridgeLogCycle);
+        const char* const end = (const char*)(record + 1) + record->size;
+
+        for (uint32_t i=0; i < cycle->bufferCount && data + sizeof(JackBridgeLogBuffer) <= end; ++i)
+        {
+            const JackBridgeLogBuffer* const buffer((const JackBridgeLogBuffer*)data);
+            const char* const bufferData = data + sizeof(JackBridgeLogBuffer);
+
+            data = bufferData + buffer->size;
+
+            if (data > end)
+                break;
+
+            const std::map<uint32_t, std::string>::const_iterator it(fReplaySlots.find(buffer->slot));
+
+            if (it == fReplaySlots.end())
+                continue;
+
+            jack_port_t* const port(findOwnPort(client, it->second));
+
+            if (port == nullptr || (port->flags & JackPortIsInput) == 0 || port->isMidi != (buffer->isMidi != 0))
+                continue;
+
+            if (! port->isMidi)
+            {
+                const uint32_t count = std::min(std::min(buffer->count, nframes), uint32_t(buffer->size / sizeof(float)));
+                std::memcpy(&port->audio[0], bufferData, sizeof(float)*count);
+                continue;
+            }
+
+            const char* eventData = bufferData;
+
+            for (uint32_t j=0; j < buffer->count && eventData + sizeof(JackBridgeLogMidiEvent) <= data; ++j)
+            {
+                const JackBridgeLogMidiEvent* const event((const JackBridgeLogMidiEvent*)eventData);
+                const char* const bytes = eventData + sizeof(JackBridgeLogMidiEvent);
+
+                eventData = bytes + jackbridge_log_pad(event->size, 4);
+
+                if (eventData > data)
+                    break;
+
+                if (jack_midi_data_t* const dest = jackbridge_sim_midi_reserve(port->midi, event->time, event->size))
+                    std::memcpy(dest, bytes, event->size);
+            }
+        }
+
+        processClients(nframes, client);
+    }
+
+    // -------------------------------------------------------------------------
+    // transport, Starting until all sync callbacks are ready
+
+    void runSync()
+    {
+        if (fTransportState != JackTransportStarting)
+            return;
+
+        bool ready = true;
+
+        for (size_t i=0; i < fOrder.size(); ++i)
+        {
+            jack_client_t* const client(fOrder[i]);
+
+            if (client->sync.func != nullptr && ! client->zombie)
+            {
+                fillPosition();
+
+                if (client->sync.func(fTransportState, &fTransportPos, client->sync.arg) == 0)
+                    ready = false;
+            }
+        }
+
+        if (ready)
+            fTransportState = JackTransportRolling;
+    }
+
+    void runTimebase(const uint32_t nframes)
+    {
+        fillPosition();
+
+        if (fTimebase.func != nullptr)
+        {
+            fTimebase.func(fTransportState, nframes, &fTransportPos, fTransportNewPos ? 1 : 0, fTimebase.arg);
+            fTransportNewPos = false;
+        }
+
+        if (fTransportState == JackTransportRolling)
+            fTransportFrame += nframes;
+    }
+
+public:
+    // BBT fields are left for the timebase master to fill
+    void fillPosition()
+    {
+        fTransportPos.unique_1   = fTransportPos.unique_2 = fCycles;
+        fTransportPos.usecs      = jack_time_t(fCycleStartNs / 1000);
+        fTransportPos.frame_rate = fSampleRate;
+        fTransportPos.frame      = fTransportFrame;
+
+        if (fTimebase.func == nullptr)
+            fTransportPos.valid = jack_position_bits_t(0);
+    }
+
+    void locate(const jack_nframes_t frame)
+    {
+        fTransportFrame  = frame;
+        fTransportNewPos = true;
+
+        if (fTransportState == JackTransportRolling)
+            fTransportState = JackTransportStarting;
+    }
+};
+
+static JackSimServer gSimServer;
+
+// -----------------------------------------------------------------------------
+// Name lists, allocated in one block so jackbridge_free() releases all of it
+
+static inline
+const char** jackbridge_sim_name_list(const std::vector<const char*>& names)
+{
+    if (names.size() == 0)
+        return nullptr;
+
+    size_t bytes = sizeof(char*) * (names.size() + 1);
+
+    for (size_t i=0; i < names.size(); ++i)
+        bytes += std::strlen(names[i]) + 1;
+
+    const char** const list = (const char**)std::malloc(bytes);
+
+    if (list == nullptr)
+        return nullptr;
+
+    char* str = (char*)(list + names.size() + 1);
+
+    for (size_t i=0; i < names.size(); ++i)
+    {
+        const size_t size = std::strlen(names[i]) + 1;
+        std::memcpy(str, names[i], size);
+        list[i] = str;
+        str += size;
+    }
+
+    list[names.size()] = nullptr;
+    return list;
+}
+
+#define JACKBRIDGE_SIM_LOCK std::lock_guard<std::recursive_mutex> lock(gSimServer.fLock)
+
+// -----------------------------------------------------------------------------
+
+void jackbridge_get_version(int* major_ptr, int* minor_ptr, int* micro_ptr, int* proto_ptr)
+{
+    if (major_ptr != nullptr)
+        *major_ptr = 0;
+    if (minor_ptr != nullptr)
+        *minor_ptr = 0;
+    if (micro_ptr != nullptr)
+        *micro_ptr = 0;
+    if (proto_ptr != nullptr)
+        *proto_ptr = 0;
+}
+
+const char* jackbridge_get_version_string()
+{
+    return "simulated";
+}
+
+// -----------------------------------------------------------------------------
+
+jack_client_t* jackbridge_client_open(const char* client_name, jack_options_t options, jack_status_t* status, ...)
+{
+    int ret = 0;
+
+    if (client_name == nullptr || client_name[0] == '\0' || std::strlen(client_name) >= JACKBRIDGE_SIM_CLIENT_NAME_SIZE - 4)
+    {
+        if (status != nullptr)
+            *status = jack_status_t(JackFailure|JackInvalidOption);
+        return nullptr;
+    }
+
+    if (! gSimServer.isRunning())
+    {
+        gSimServer.start();
+        ret |= JackServerStarted;
+    }
+
+    JACKBRIDGE_SIM_LOCK;
+
+    char name[JACKBRIDGE_SIM_CLIENT_NAME_SIZE];
+    std::strcpy(name, client_name);
+
+    // like jackd, "name-01", "name-02" and so on
+    for (int i=1; gSimServer.findClient(name) != nullptr; ++i)
+    {
+        if ((options & JackUseExactName) || i > 99)
+        {
+            if (status != nullptr)
+                *status = jack_status_t(ret|JackFailure|JackNameNotUnique);
+            return nullptr;
+        }
+
+        std::snprintf(name, sizeof(name), "%s-%02i", client_name, i);
+        ret |= JackNameNotUnique;
+    }
+
+    jack_client_t* const client = new jack_client_t;
+    std::strcpy(client->name, name);
+
+    gSimServer.fClients.push_back(client);
+    gSimServer.notifyClientRegistration(name, 1);
+
+    if (status != nullptr)
+        *status = jack_status_t(ret);
+
+    return client;
+}
+
+const char* jackbridge_client_rename(jack_client_t* client, const char* new_name)
+{
+    if (client == nullptr || new_name == nullptr || std::strlen(new_name) >= JACKBRIDGE_SIM_CLIENT_NAME_SIZE)
+        return nullptr;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (gSimServer.findClient(new_name) != nullptr)
+        return nullptr;
+
+    const std::string oldName(client->name);
+    std::strcpy(client->name, new_name);
+
+    for (size_t i=0; i < client->ports.size(); ++i)
+    {
+        jack_port_t* const port(client->ports[i]);
+        const std::string shortName(std::strchr(port->name, ':') + 1);
+
+        gSimServer.fPortsByName.erase(port->name);
+        std::snprintf(port->name, sizeof(port->name), "%s:%s", new_name, shortName.c_str());
+        gSimServer.fPortsByName[port->name] = port;
+    }
+
+    JackSimNotification notification(JackSimNotification::kClientRename, nullptr);
+    notification.str1 = oldName;
+    notification.str2 = new_name;
+    gSimServer.queueForAll(notification, &_jack_client::clientRename);
+
+    return client->name;
+}
+
+bool jackbridge_client_close(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+
+    bool lastClient;
+
+    {
+        JACKBRIDGE_SIM_LOCK;
+
+        if (client->active)
+            gSimServer.deactivate(client);
+
+        while (client->ports.size() > 0)
+            gSimServer.unregisterPort(client->ports.back());
+
+        if (gSimServer.fTimebaseClient == client)
+        {
+            gSimServer.fTimebaseClient = nullptr;
+            gSimServer.fTimebase.set(nullptr, nullptr);
+        }
+
+        std::vector<jack_client_t*>& clients(gSimServer.fClients);
+        clients.erase(std::find(clients.begin(), clients.end(), client));
+
+        gSimServer.notifyClientRegistration(client->name, 0);
+
+        lastClient = ! gSimServer.hasClients();
+    }
+
+    gSimServer.purgeNotifications(client);
+    jackbridge_timing_client_close(client, true);
+    jackbridge_port_cache_client_close(client, true);
+    delete client;
+
+    if (lastClient)
+        gSimServer.stop();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int jackbridge_client_name_size()
+{
+    return JACKBRIDGE_SIM_CLIENT_NAME_SIZE;
+}
+
+char* jackbridge_get_client_name(jack_client_t* client)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    return client->name;
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_activate(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (client->active)
+        return true;
+
+    client->active    = true;
+    client->zombie    = false;
+    client->needsInit = true;
+    gSimServer.fGraphChanged = true;
+    return true;
+}
+
+bool jackbridge_deactivate(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (client->active)
+        gSimServer.deactivate(client);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int jackbridge_get_client_pid(const char* name)
+{
+    if (name == nullptr)
+        return 0;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    jack_client_t* const client(gSimServer.findClient(name));
+
+    if (client == nullptr || client == gSimServer.fSystem)
+        return 0;
+
+#ifdef JACKBRIDGE_OS_WIN
+    return int(GetCurrentProcessId());
+#else
+    return int(getpid());
+#endif
+}
+
+bool jackbridge_is_realtime(jack_client_t* client)
+{
+    return (client != nullptr && gSimServer.fRealtime);
+}
+
+// -----------------------------------------------------------------------------
+// Callbacks are only changed with the lock held, so never while one is running
+// in the process thread
+
+#define JACKBRIDGE_SIM_SET_CALLBACK(member, func, arg) \
+    if (client == nullptr)                             \
+        return false;                                  \
+    JACKBRIDGE_SIM_LOCK;                               \
+    client->member.set(func, arg);                     \
+    return true;
+
+bool jackbridge_set_thread_init_callback(jack_client_t* client, JackThreadInitCallback thread_init_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(threadInit, thread_init_callback, arg)
+}
+
+void jackbridge_on_shutdown(jack_client_t* client, JackShutdownCallback shutdown_callback, void* arg)
+{
+    if (client == nullptr)
+        return;
+
+    JACKBRIDGE_SIM_LOCK;
+    client->shutdown.set(shutdown_callback, arg);
+}
+
+void jackbridge_on_info_shutdown(jack_client_t* client, JackInfoShutdownCallback shutdown_callback, void* arg)
+{
+    if (client == nullptr)
+        return;
+
+    JACKBRIDGE_SIM_LOCK;
+    client->infoShutdown.set(shutdown_callback, arg);
+}
+
+bool jackbridge_set_process_callback(jack_client_t* client, JackProcessCallback process_callback, void* arg)
+{
+    JACKBRIDGE_TIMING_CALLBACK(client, process, process_callback, arg)
+    JACKBRIDGE_SIM_SET_CALLBACK(process, process_callback, arg)
+}
+
+bool jackbridge_set_freewheel_callback(jack_client_t* client, JackFreewheelCallback freewheel_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(freewheel, freewheel_callback, arg)
+}
+
+bool jackbridge_set_buffer_size_callback(jack_client_t* client, JackBufferSizeCallback bufsize_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(bufferSize, bufsize_callback, arg)
+}
+
+bool jackbridge_set_sample_rate_callback(jack_client_t* client, JackSampleRateCallback srate_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(sampleRate, srate_callback, arg)
+}
+
+bool jackbridge_set_client_registration_callback(jack_client_t* client, JackClientRegistrationCallback registration_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(clientRegistration, registration_callback, arg)
+}
+
+bool jackbridge_set_client_rename_callback(jack_client_t* client, JackClientRenameCallback rename_callback, void* arg)
+{
+    JACKBRIDGE_CACHE_CALLBACK(client, clientRename, rename_callback, arg)
+    JACKBRIDGE_SIM_SET_CALLBACK(clientRename, rename_callback, arg)
+}
+
+bool jackbridge_set_port_registration_callback(jack_client_t* client, JackPortRegistrationCallback registration_callback, void* arg)
+{
+    JACKBRIDGE_CACHE_CALLBACK(client, portRegistration, registration_callback, arg)
+    JACKBRIDGE_SIM_SET_CALLBACK(portRegistration, registration_callback, arg)
+}
+
+bool jackbridge_set_port_connect_callback(jack_client_t* client, JackPortConnectCallback connect_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(portConnect, connect_callback, arg)
+}
+
+bool jackbridge_set_port_rename_callback(jack_client_t* client, JackPortRenameCallback rename_callback, void* arg)
+{
+    JACKBRIDGE_CACHE_CALLBACK(client, portRename, rename_callback, arg)
+    JACKBRIDGE_SIM_SET_CALLBACK(portRename, rename_callback, arg)
+}
+
+bool jackbridge_set_graph_order_callback(jack_client_t* client, JackGraphOrderCallback graph_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(graphOrder, graph_callback, arg)
+}
+
+bool jackbridge_set_xrun_callback(jack_client_t* client, JackXRunCallback xrun_callback, void* arg)
+{
+    JACKBRIDGE_TIMING_CALLBACK(client, xrun, xrun_callback, arg)
+    JACKBRIDGE_SIM_SET_CALLBACK(xrun, xrun_callback, arg)
+}
+
+bool jackbridge_set_latency_callback(jack_client_t* client, JackLatencyCallback latency_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(latency, latency_callback, arg)
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_set_freewheel(jack_client_t* client, bool onoff)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (gSimServer.fFreewheel == onoff)
+        return true;
+
+    gSimServer.fFreewheel = onoff;
+
+    JackSimNotification notification(JackSimNotification::kFreewheel, nullptr);
+    notification.value = onoff ? 1 : 0;
+    gSimServer.queueForAll(notification, &_jack_client::freewheel);
+    return true;
+}
+
+// applied by the process thread before its next cycle
+bool jackbridge_set_buffer_size(jack_client_t* client, jack_nframes_t nframes)
+{
+    if (client == nullptr || nframes < 16 || nframes > JACKBRIDGE_SIM_MAX_BUFFER_SIZE || (nframes & (nframes-1)) != 0)
+        return false;
+
+    gSimServer.fPendingBufferSize = nframes;
+    return true;
+}
+
+jack_nframes_t jackbridge_get_sample_rate(jack_client_t* client)
+{
+    return (client != nullptr) ? gSimServer.fSampleRate.load() : 0;
+}
+
+jack_nframes_t jackbridge_get_buffer_size(jack_client_t* client)
+{
+    return (client != nullptr) ? gSimServer.fBufferSize.load() : 0;
+}
+
+float jackbridge_cpu_load(jack_client_t* client)
+{
+    return (client != nullptr) ? gSimServer.fCpuLoad.load() : 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+
+// estimated from the time elapsed since the current cycle started
+jack_nframes_t jackbridge_frame_time(const jack_client_t* client)
+{
+    if (client == nullptr)
+        return 0;
+
+    const int64_t elapsed = JackSimServer::now() - gSimServer.fCycleStartNs;
+
+    return gSimServer.fCycleFrames + jack_nframes_t(elapsed * gSimServer.fSampleRate / 1000000000LL);
+}
+
+jack_nframes_t jackbridge_last_frame_time(const jack_client_t* client)
+{
+    return (client != nullptr) ? gSimServer.fCycleFrames.load() : 0;
+}
+
+// -----------------------------------------------------------------------------
+
+jack_port_t* jackbridge_port_register(jack_client_t* client, const char* port_name, const char* port_type, unsigned long flags, unsigned long)
+{
+    if (client == nullptr || port_name == nullptr || port_type == nullptr)
+        return nullptr;
+
+    JACKBRIDGE_SIM_LOCK;
+    return gSimServer.registerPort(client, port_name, port_type, int(flags));
+}
+
+bool jackbridge_port_unregister(jack_client_t* client, jack_port_t* port)
+{
+    if (client == nullptr || port == nullptr)
+        return false;
+
+    jackbridge_port_cache_forget(port);
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (port->client != client)
+        return false;
+
+    gSimServer.unregisterPort(port);
+    return true;
+}
+
+void* jackbridge_port_get_buffer(jack_port_t* port, jack_nframes_t nframes)
+{
+    if (port == nullptr || ! port->registered || nframes > gSimServer.fBufferSize)
+        return nullptr;
+
+    if (port->isMidi)
+        return port->midi;
+
+    return &port->audio[0];
+}
+
+// -----------------------------------------------------------------------------
+
+const char* jackbridge_port_name(const jack_port_t* port)
+{
+    return (port != nullptr) ? port->name : nullptr;
+}
+
+const char* jackbridge_port_short_name(const jack_port_t* port)
+{
+    if (port == nullptr)
+        return nullptr;
+
+    const char* const sep(std::strchr(port->name, ':'));
+    return (sep != nullptr) ? sep + 1 : port->name;
+}
+
+int jackbridge_port_flags(const jack_port_t* port)
+{
+    return (port != nullptr) ? port->flags : 0;
+}
+
+const char* jackbridge_port_type(const jack_port_t* port)
+{
+    return (port != nullptr) ? port->type : nullptr;
+}
+
+bool jackbridge_port_is_mine(const jack_client_t* client, const jack_port_t* port)
+{
+    return (client != nullptr && port != nullptr && port->client == client);
+}
+
+bool jackbridge_port_connected(const jack_port_t* port)
+{
+    if (port == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+    return (port->connections.size() > 0);
+}
+
+bool jackbridge_port_connected_to(const jack_port_t* port, const char* port_name)
+{
+    if (port == nullptr || port_name == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    for (size_t i=0; i < port->connections.size(); ++i)
+    {
+        if (std::strcmp(port->connections[i]->name, port_name) == 0)
+            return true;
+    }
+    return false;
+}
+
+const char** jackbridge_port_get_connections(const jack_port_t* port)
+{
+    if (port == nullptr)
+        return nullptr;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    std::vector<const char*> names;
+
+    for (size_t i=0; i < port->connections.size(); ++i)
+        names.push_back(port->connections[i]->name);
+
+    return jackbridge_sim_name_list(names);
+}
+
+const char** jackbridge_port_get_all_connections(const jack_client_t* client, const jack_port_t* port)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    return jackbridge_port_get_connections(port);
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_port_set_name(jack_port_t* port, const char* port_name)
+{
+    if (port == nullptr || port_name == nullptr || ! port->registered)
+        return false;
+
+    jackbridge_port_cache_forget(port);
+
+    JACKBRIDGE_SIM_LOCK;
+
+    // the short name or the full one, the client part can't be changed
+    const char* const sep(std::strchr(port_name, ':'));
+    const char* const shortName((sep != nullptr) ? sep + 1 : port_name);
+
+    char name[JACKBRIDGE_SIM_PORT_NAME_SIZE];
+    if (std::snprintf(name, sizeof(name), "%s:%s", port->client->name, shortName) >= int(sizeof(name)))
+        return false;
+    if (gSimServer.findPort(name) != nullptr)
+        return false;
+
+    const std::string oldName(port->name);
+
+    gSimServer.fPortsByName.erase(port->name);
+    std::strcpy(port->name, name);
+    gSimServer.fPortsByName[name] = port;
+
+    JackSimNotification notification(JackSimNotification::kPortRename, nullptr);
+    notification.portA = port->id;
+    notification.str1  = oldName;
+    notification.str2  = name;
+    gSimServer.queueForAll(notification, &_jack_client::portRename);
+    return true;
+}
+
+bool jackbridge_port_set_alias(jack_port_t* port, const char* alias)
+{
+    if (port == nullptr || alias == nullptr || std::strlen(alias) >= JACKBRIDGE_SIM_PORT_NAME_SIZE)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    for (int i=0; i < 2; ++i)
+    {
+        if (port->aliases[i][0] == '\0')
+        {
+            std::strcpy(port->aliases[i], alias);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool jackbridge_port_unset_alias(jack_port_t* port, const char* alias)
+{
+    if (port == nullptr || alias == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    for (int i=0; i < 2; ++i)
+    {
+        if (std::strcmp(port->aliases[i], alias) == 0)
+        {
+            port->aliases[i][0] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+int jackbridge_port_get_aliases(const jack_port_t* port, char* const aliases[2])
+{
+    if (port == nullptr || aliases == nullptr)
+        return 0;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    int count = 0;
+
+    for (int i=0; i < 2; ++i)
+    {
+        if (port->aliases[i][0] != '\0')
+            std::strcpy(aliases[count++], port->aliases[i]);
+    }
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_port_request_monitor(jack_port_t* port, bool onoff)
+{
+    if (port == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (onoff)
+        ++port->monitorRequests;
+    else if (port->monitorRequests > 0)
+        --port->monitorRequests;
+
+    return true;
+}
+
+bool jackbridge_port_request_monitor_by_name(jack_client_t* client, const char* port_name, bool onoff)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+    return jackbridge_port_request_monitor(gSimServer.findPort(port_name), onoff);
+}
+
+bool jackbridge_port_ensure_monitor(jack_port_t* port, bool onoff)
+{
+    if (port == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (onoff && port->monitorRequests == 0)
+        port->monitorRequests = 1;
+    else if (! onoff)
+        port->monitorRequests = 0;
+
+    return true;
+}
+
+bool jackbridge_port_monitoring_input(jack_port_t* port)
+{
+    return (port != nullptr && port->monitorRequests > 0);
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_connect(jack_client_t* client, const char* source_port, const char* destination_port)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    jack_port_t* const src(gSimServer.findPort(source_port));
+    jack_port_t* const dst(gSimServer.findPort(destination_port));
+
+    if (src == nullptr || dst == nullptr)
+        return false;
+
+    return gSimServer.connect(src, dst);
+}
+
+bool jackbridge_disconnect(jack_client_t* client, const char* source_port, const char* destination_port)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    jack_port_t* const src(gSimServer.findPort(source_port));
+    jack_port_t* const dst(gSimServer.findPort(destination_port));
+
+    if (src == nullptr || dst == nullptr)
+        return false;
+
+    return gSimServer.disconnect(src, dst);
+}
+
+bool jackbridge_port_disconnect(jack_client_t* client, jack_port_t* port)
+{
+    if (client == nullptr || port == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+    gSimServer.disconnectAll(port);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int jackbridge_port_name_size()
+{
+    return JACKBRIDGE_SIM_PORT_NAME_SIZE;
+}
+
+int jackbridge_port_type_size()
+{
+    return JACKBRIDGE_SIM_PORT_TYPE_SIZE;
+}
+
+size_t jackbridge_port_type_get_buffer_size(jack_client_t* client, const char* port_type)
+{
+    if (client == nullptr || port_type == nullptr)
+        return 0;
+
+    if (std::strcmp(port_type, JACK_DEFAULT_AUDIO_TYPE) == 0)
+        return sizeof(float) * gSimServer.fBufferSize;
+    if (std::strcmp(port_type, JACK_DEFAULT_MIDI_TYPE) == 0)
+        return sizeof(JackSimMidiBuffer);
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+void jackbridge_port_get_latency_range(jack_port_t* port, jack_latency_callback_mode_t mode, jack_latency_range_t* range)
+{
+    if (port == nullptr || range == nullptr)
+        return;
+
+    JACKBRIDGE_SIM_LOCK;
+    *range = port->latency[(mode == JackCaptureLatency) ? 0 : 1];
+}
+
+void jackbridge_port_set_latency_range(jack_port_t* port, jack_latency_callback_mode_t mode, jack_latency_range_t* range)
+{
+    if (port == nullptr || range == nullptr)
+        return;
+
+    JACKBRIDGE_SIM_LOCK;
+    port->latency[(mode == JackCaptureLatency) ? 0 : 1] = *range;
+}
+
+// latencies are whatever clients set, this only runs the latency callbacks
+bool jackbridge_recompute_total_latencies(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+    gSimServer.queueForAll(JackSimNotification(JackSimNotification::kLatency, nullptr), &_jack_client::latency);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+const char** jackbridge_get_ports(jack_client_t* client, const char* port_name_pattern, const char* type_name_pattern, unsigned long flags)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    std::regex nameRegex, typeRegex;
+    const bool matchName = (port_name_pattern != nullptr && port_name_pattern[0] != '\0');
+    const bool matchType = (type_name_pattern != nullptr && type_name_pattern[0] != '\0');
+
+    try {
+        if (matchName)
+            nameRegex.assign(port_name_pattern, std::regex::extended);
+        if (matchType)
+            typeRegex.assign(type_name_pattern, std::regex::extended);
+    }
+    catch (const std::regex_error&) {
+        return nullptr;
+    }
+
+    JACKBRIDGE_SIM_LOCK;
+
+    std::vector<const char*> names;
+
+    // in registration order, like jackd
+    for (size_t i=0; i < gSimServer.fPorts.size(); ++i)
+    {
+        const jack_port_t* const port(gSimServer.fPorts[i]);
+
+        if (! port->registered)
+            continue;
+        if ((port->flags & flags) != flags)
+            continue;
+        if (matchName && ! std::regex_search(port->name, nameRegex))
+            continue;
+        if (matchType && ! std::regex_search(port->type, typeRegex))
+            continue;
+
+        names.push_back(port->name);
+    }
+
+    return jackbridge_sim_name_list(names);
+}
+
+static jack_port_t* jackbridge_port_by_name_uncached(jack_client_t* client, const char* port_name)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    JACKBRIDGE_SIM_LOCK;
+    return gSimServer.findPort(port_name);
+}
+
+// also works for ports that were unregistered already, like in jackd
+static jack_port_t* jackbridge_port_by_id_uncached(jack_client_t* client, jack_port_id_t port_id)
+{
+    if (client == nullptr)
+        return nullptr;
+
+    JACKBRIDGE_SIM_LOCK;
+    return (port_id < gSimServer.fPorts.size()) ? gSimServer.fPorts[port_id] : nullptr;
+}
+
+jack_port_t* jackbridge_port_by_name(jack_client_t* client, const char* port_name)
+{
+    if (jack_port_t* const port = jackbridge_port_cache_get(client, port_name))
+        return port;
+
+    return jackbridge_port_cache_add(client, port_name, jackbridge_port_by_name_uncached(client, port_name));
+}
+
+jack_port_t* jackbridge_port_by_id(jack_client_t* client, jack_port_id_t port_id)
+{
+    if (jack_port_t* const port = jackbridge_port_cache_get_by_id(client, port_id))
+        return port;
+
+    return jackbridge_port_cache_add_by_id(client, port_id, jackbridge_port_by_id_uncached(client, port_id));
+}
+
+// -----------------------------------------------------------------------------
+
+void jackbridge_free(void* ptr)
+{
+    std::free(ptr);
+}
+
+// -----------------------------------------------------------------------------
+
+uint32_t jackbridge_midi_get_event_count(void* port_buffer)
+{
+    const JackSimMidiBuffer* const buffer(jackbridge_sim_midi_buffer(port_buffer));
+    return (buffer != nullptr) ? buffer->eventCount : 0;
+}
+
+bool jackbridge_midi_event_get(jack_midi_event_t* event, void* port_buffer, uint32_t event_index)
+{
+    JackSimMidiBuffer* const buffer(jackbridge_sim_midi_buffer(port_buffer));
+
+    if (buffer == nullptr || event == nullptr || event_index >= buffer->eventCount)
+        return false;
+
+    const JackSimMidiEvent& simEvent(buffer->events[event_index]);
+
+    event->time   = simEvent.time;
+    event->size   = simEvent.size;
+    event->buffer = buffer->data + simEvent.offset;
+    return true;
+}
+
+void jackbridge_midi_clear_buffer(void* port_buffer)
+{
+    if (JackSimMidiBuffer* const buffer = jackbridge_sim_midi_buffer(port_buffer))
+    {
+        buffer->eventCount = 0;
+        buffer->dataUsed   = 0;
+    }
+}
+
+// JACK keeps events and their data in one pool, here every free event slot counts as its share of the data
+size_t jackbridge_midi_max_event_size(void* port_buffer)
+{
+    const JackSimMidiBuffer* const buffer(jackbridge_sim_midi_buffer(port_buffer));
+
+    if (buffer == nullptr)
+        return 0;
+
+    const size_t dataLeft  = JACKBRIDGE_SIM_MIDI_DATA_SIZE - buffer->dataUsed;
+    const size_t slotsLeft = (JACKBRIDGE_SIM_MIDI_EVENTS - buffer->eventCount) * (JACKBRIDGE_SIM_MIDI_DATA_SIZE / JACKBRIDGE_SIM_MIDI_EVENTS);
+
+    return std::min(dataLeft, slotsLeft);
+}
+
+bool jackbridge_midi_event_write(void* port_buffer, jack_nframes_t time, const jack_midi_data_t* data, size_t data_size)
+{
+    if (data == nullptr)
+        return false;
+
+    if (jack_midi_data_t* const dest = jackbridge_midi_event_reserve(port_buffer, time, data_size))
+    {
+        std::memcpy(dest, data, data_size);
+        return true;
+    }
+    return false;
+}
+
+jack_midi_data_t* jackbridge_midi_event_reserve(void* port_buffer, jack_nframes_t time, size_t data_size)
+{
+    JackSimMidiBuffer* const buffer(jackbridge_sim_midi_buffer(port_buffer));
+
+    if (buffer == nullptr)
+        return nullptr;
+
+    return jackbridge_sim_midi_reserve(buffer, time, data_size);
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_release_timebase(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (gSimServer.fTimebaseClient != client)
+        return false;
+
+    gSimServer.fTimebaseClient = nullptr;
+    gSimServer.fTimebase.set(nullptr, nullptr);
+    return true;
+}
+
+bool jackbridge_set_sync_callback(jack_client_t* client, JackSyncCallback sync_callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(sync, sync_callback, arg)
+}
+
+// there is no sync timeout, Starting lasts until all clients are ready
+bool jackbridge_set_sync_timeout(jack_client_t* client, jack_time_t)
+{
+    return (client != nullptr);
+}
+
+bool jackbridge_set_timebase_callback(jack_client_t* client, bool conditional, JackTimebaseCallback timebase_callback, void* arg)
+{
+    if (client == nullptr || timebase_callback == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (conditional && gSimServer.fTimebaseClient != nullptr && gSimServer.fTimebaseClient != client)
+        return false;
+
+    gSimServer.fTimebaseClient  = client;
+    gSimServer.fTransportNewPos = true;
+    gSimServer.fTimebase.set(timebase_callback, arg);
+    return true;
+}
+
+bool jackbridge_transport_locate(jack_client_t* client, jack_nframes_t frame)
+{
+    if (client == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+    gSimServer.locate(frame);
+    return true;
+}
+
+jack_transport_state_t jackbridge_transport_query(const jack_client_t* client, jack_position_t* pos)
+{
+    if (client == nullptr)
+    {
+        if (pos != nullptr)
+            std::memset(pos, 0, sizeof(*pos));
+        return JackTransportStopped;
+    }
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (pos != nullptr)
+    {
+        gSimServer.fillPosition();
+        std::memcpy(pos, &gSimServer.fTransportPos, sizeof(*pos));
+    }
+
+    return gSimServer.fTransportState;
+}
+
+jack_nframes_t jackbridge_get_current_transport_frame(const jack_client_t* client)
+{
+    if (client == nullptr)
+        return 0;
+
+    JACKBRIDGE_SIM_LOCK;
+    return gSimServer.fTransportFrame;
+}
+
+bool jackbridge_transport_reposition(jack_client_t* client, const jack_position_t* pos)
+{
+    if (pos == nullptr)
+        return false;
+
+    return jackbridge_transport_locate(client, pos->frame);
+}
+
+void jackbridge_transport_start(jack_client_t* client)
+{
+    if (client == nullptr)
+        return;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    if (gSimServer.fTransportState == JackTransportStopped)
+        gSimServer.fTransportState = JackTransportStarting;
+}
+
+void jackbridge_transport_stop(jack_client_t* client)
+{
+    if (client == nullptr)
+        return;
+
+    JACKBRIDGE_SIM_LOCK;
+    gSimServer.fTransportState = JackTransportStopped;
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_custom_publish_data(jack_client_t* client, const char* key, const void* data, size_t size)
+{
+    if (client == nullptr || key == nullptr || (data == nullptr && size != 0))
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    std::map<std::string, std::vector<unsigned char> >& keys(gSimServer.fCustomData[client->name]);
+    const bool replaced = (keys.find(key) != keys.end());
+
+    keys[key].assign((const unsigned char*)data, (const unsigned char*)data + size);
+
+    JackSimNotification notification(JackSimNotification::kCustomData, nullptr);
+    notification.str1  = client->name;
+    notification.str2  = key;
+    notification.value = replaced ? JackCustomReplaced : JackCustomAdded;
+    gSimServer.queueForAll(notification, &_jack_client::customData);
+    return true;
+}
+
+// 'data' is to be released with jackbridge_free()
+bool jackbridge_custom_get_data(jack_client_t* client, const char* client_name, const char* key, void** data, size_t* size)
+{
+    if (client == nullptr || client_name == nullptr || key == nullptr || data == nullptr || size == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    std::map<std::string, std::map<std::string, std::vector<unsigned char> > >::const_iterator clientIt(gSimServer.fCustomData.find(client_name));
+
+    if (clientIt == gSimServer.fCustomData.end())
+        return false;
+
+    std::map<std::string, std::vector<unsigned char> >::const_iterator keyIt(clientIt->second.find(key));
+
+    if (keyIt == clientIt->second.end())
+        return false;
+
+    const std::vector<unsigned char>& value(keyIt->second);
+
+    *data = std::malloc(value.size() > 0 ? value.size() : 1);
+    *size = value.size();
+
+    if (*data == nullptr)
+        return false;
+
+    if (value.size() > 0)
+        std::memcpy(*data, &value[0], value.size());
+
+    return true;
+}
+
+bool jackbridge_custom_unpublish_data(jack_client_t* client, const char* key)
+{
+    if (client == nullptr || key == nullptr)
+        return false;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    std::map<std::string, std::vector<unsigned char> >& keys(gSimServer.fCustomData[client->name]);
+
+    if (keys.erase(key) == 0)
+        return false;
+
+    JackSimNotification notification(JackSimNotification::kCustomData, nullptr);
+    notification.str1  = client->name;
+    notification.str2  = key;
+    notification.value = JackCustomRemoved;
+    gSimServer.queueForAll(notification, &_jack_client::customData);
+    return true;
+}
+
+bool jackbridge_custom_set_data_appearance_callback(jack_client_t* client, JackCustomDataAppearanceCallback callback, void* arg)
+{
+    JACKBRIDGE_SIM_SET_CALLBACK(customData, callback, arg)
+}
+
+const char** jackbridge_custom_get_keys(jack_client_t* client, const char* client_name)
+{
+    if (client == nullptr || client_name == nullptr)
+        return nullptr;
+
+    JACKBRIDGE_SIM_LOCK;
+
+    std::map<std::string, std::map<std::string, std::vector<unsigned char> > >::const_iterator clientIt(gSimServer.fCustomData.find(client_name));
+
+    if (clientIt == gSimServer.fCustomData.end())
+        return nullptr;
+
+    std::vector<const char*> names;
+
+    for (std::map<std::string, std::vector<unsigned char> >::const_iterator it=clientIt->second.begin(); it != clientIt->second.end(); ++it)
+        names.push_back(it->first.c_str());
+
+    return jackbridge_sim_name_list(names);
+}
+
+// -----------------------------------------------------------------------------
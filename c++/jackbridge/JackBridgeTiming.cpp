@@ -0,0 +1,447 @@
+/*
+ * JackBridge, process callback timing
+ * Copyright (C) 2013 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Included by JackBridge.cpp and JackBridgeSim.cpp.
+//
+// After jackbridge_timing_enable(), the process callback of the client is wrapped: every
+// call is timed and counted in a histogram, along with the period it had to fit in and
+// the DSP load reported by JACK. Each xrun is kept with the slowest of the client's own
+// cycles right before it, so a dropout caused by the client can be told apart from one
+// caused by someone else.
+//
+// The process thread only stores to atomics it alone writes; queries can come from any
+// thread, and see counters that may be a cycle apart from each other. For the same
+// reason a reset only asks the process thread to clear them, at the start of its next
+// cycle; until then the queries report them as empty.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define JACKBRIDGE_TIMING_SUB_BUCKETS 8   // per power of 2
+#define JACKBRIDGE_TIMING_BUCKETS     224 // 64 ns units, up to about 17 s
+#define JACKBRIDGE_TIMING_RECENT      256 // cycles kept for xrun attribution, must be a power of 2
+#define JACKBRIDGE_TIMING_XRUN_CYCLES 8   // how far back from an xrun cycles are looked at
+#define JACKBRIDGE_TIMING_MAX_XRUNS   64  // kept for jackbridge_timing_get_xruns()
+
+// -----------------------------------------------------------------------------
+// Log-linear histogram buckets, 8 per power of 2 (at most 6% off from the real value)
+
+static inline
+uint32_t jackbridge_timing_bucket(const uint64_t ns)
+{
+    uint64_t value = ns >> 6;
+    uint32_t octave = 0;
+
+    while (value >= 2*JACKBRIDGE_TIMING_SUB_BUCKETS)
+    {
+        value >>= 1;
+        ++octave;
+    }
+
+    return std::min<uint32_t>(octave*JACKBRIDGE_TIMING_SUB_BUCKETS + uint32_t(value), JACKBRIDGE_TIMING_BUCKETS-1);
+}
+
+// middle of a bucket, in microseconds
+static inline
+float jackbridge_timing_bucket_value(const uint32_t bucket)
+{
+    if (bucket < 2*JACKBRIDGE_TIMING_SUB_BUCKETS)
+        return (float(bucket) + 0.5f) * 0.064f;
+
+    const uint32_t octave = bucket/JACKBRIDGE_TIMING_SUB_BUCKETS - 1;
+    const uint32_t value  = bucket - octave*JACKBRIDGE_TIMING_SUB_BUCKETS;
+
+    return (float(value) + 0.5f) * float(1U << octave) * 0.064f;
+}
+
+// -----------------------------------------------------------------------------
+
+struct JackBridgeTimingClient {
+    jack_client_t* client;
+
+    JackProcessCallback process; void* processArg;
+    JackXRunCallback    xrun;    void* xrunArg;
+
+    // written by the process thread only
+    std::atomic<uint32_t> histogram[JACKBRIDGE_TIMING_BUCKETS];
+    std::atomic<uint64_t> cycles, overruns, totalNs, maxNs;
+    std::atomic<uint32_t> budgetNs;
+    std::atomic<float>    dspLoad, maxDspLoad;
+
+    // last frame time in the high 32 bits, duration in ns in the low ones
+    std::atomic<uint64_t> recent[JACKBRIDGE_TIMING_RECENT];
+    std::atomic<uint32_t> recentPos;
+
+    // bumped by reset(), caught up with by the process thread once it cleared the above
+    std::atomic<uint32_t> resetRequest, resetDone;
+
+    // written by the xrun callback
+    std::mutex xrunLock;
+    std::vector<JackBridgeTimingXRun> xruns;
+    uint32_t xrunCount, ownXRunCount;
+
+    JackBridgeTimingClient(jack_client_t* const c)
+        : client(c),
+          process(nullptr), processArg(nullptr),
+          xrun(nullptr),    xrunArg(nullptr),
+          recentPos(0),
+          resetRequest(0), resetDone(0)
+    {
+        clear();
+
+        std::lock_guard<std::mutex> lock(xrunLock);
+        xrunCount = ownXRunCount = 0;
+    }
+
+    // any thread
+    void reset()
+    {
+        resetRequest.fetch_add(1, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(xrunLock);
+        xruns.clear();
+        xrunCount = ownXRunCount = 0;
+    }
+
+    bool isResetPending() const
+    {
+        return resetRequest.load(std::memory_order_acquire) != resetDone.load(std::memory_order_acquire);
+    }
+
+    // in the process thread, or before it runs
+    void clear()
+    {
+        for (int i=0; i < JACKBRIDGE_TIMING_BUCKETS; ++i)
+            histogram[i].store(0, std::memory_order_relaxed);
+        for (int i=0; i < JACKBRIDGE_TIMING_RECENT; ++i)
+            recent[i].store(0, std::memory_order_relaxed);
+
+        cycles.store(0, std::memory_order_relaxed);
+        overruns.store(0, std::memory_order_relaxed);
+        totalNs.store(0, std::memory_order_relaxed);
+        maxNs.store(0, std::memory_order_relaxed);
+        budgetNs.store(0, std::memory_order_relaxed);
+        dspLoad.store(0.0f, std::memory_order_relaxed);
+        maxDspLoad.store(0.0f, std::memory_order_relaxed);
+    }
+
+    // in the process thread, after the client's callback
+    void addCycle(const jack_nframes_t nframes, const uint64_t ns)
+    {
+        const uint32_t request(resetRequest.load(std::memory_order_acquire));
+
+        if (request != resetDone.load(std::memory_order_relaxed))
+        {
+            clear();
+            resetDone.store(request, std::memory_order_release);
+        }
+
+        const jack_nframes_t sampleRate(jackbridge_get_sample_rate(client));
+        const uint64_t budget = (sampleRate != 0) ? uint64_t(nframes) * 1000000000ULL / sampleRate : 0;
+        const float load(jackbridge_cpu_load(client));
+
+        std::atomic<uint32_t>& bucket(histogram[jackbridge_timing_bucket(ns)]);
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        cycles.store(cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalNs.store(totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+
+        if (ns > maxNs.load(std::memory_order_relaxed))
+            maxNs.store(ns, std::memory_order_relaxed);
+        if (budget != 0 && ns > budget)
+            overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        budgetNs.store(uint32_t(budget), std::memory_order_relaxed);
+        dspLoad.store(load, std::memory_order_relaxed);
+
+        if (load > maxDspLoad.load(std::memory_order_relaxed))
+            maxDspLoad.store(load, std::memory_order_relaxed);
+
+        const uint32_t pos = recentPos.load(std::memory_order_relaxed);
+        recent[pos & (JACKBRIDGE_TIMING_RECENT-1)].store((uint64_t(jackbridge_last_frame_time(client)) << 32) | std::min<uint64_t>(ns, 0xffffffffULL),
+                                                         std::memory_order_relaxed);
+        recentPos.store(pos + 1, std::memory_order_release);
+    }
+
+    // in the xrun callback, looks back at the cycles that led to it
+    void addXRun()
+    {
+        const jack_nframes_t frame(jackbridge_frame_time(client));
+        const jack_nframes_t window(JACKBRIDGE_TIMING_XRUN_CYCLES * jackbridge_get_buffer_size(client));
+        const uint32_t pos = recentPos.load(std::memory_order_acquire);
+
+        uint64_t worst = 0;
+
+        for (uint32_t i=0; i < JACKBRIDGE_TIMING_RECENT && i < pos; ++i)
+        {
+            const uint64_t entry(recent[(pos - 1 - i) & (JACKBRIDGE_TIMING_RECENT-1)].load(std::memory_order_relaxed));
+
+            // frame times wrap around, the difference does not care
+            if (jack_nframes_t(frame - jack_nframes_t(entry >> 32)) > window)
+                break;
+
+            worst = std::max<uint64_t>(worst, entry & 0xffffffffULL);
+        }
+
+        JackBridgeTimingXRun xrun;
+        xrun.frame    = frame;
+        xrun.worstUs  = float(worst) / 1000.0f;
+        xrun.budgetUs = float(budgetNs.load(std::memory_order_relaxed)) / 1000.0f;
+        xrun.dspLoad  = dspLoad.load(std::memory_order_relaxed);
+        xrun.own      = (xrun.budgetUs > 0.0f && xrun.worstUs > xrun.budgetUs);
+
+        std::lock_guard<std::mutex> lock(xrunLock);
+
+        ++xrunCount;
+        if (xrun.own)
+            ++ownXRunCount;
+
+        if (xruns.size() == JACKBRIDGE_TIMING_MAX_XRUNS)
+            xruns.erase(xruns.begin());
+
+        xruns.push_back(xrun);
+    }
+
+    // in microseconds, 0 if there were no cycles yet
+    float getPercentile(const double percentile) const
+    {
+        if (isResetPending())
+            return 0.0f;
+
+        uint64_t total = 0;
+
+        for (int i=0; i < JACKBRIDGE_TIMING_BUCKETS; ++i)
+            total += histogram[i].load(std::memory_order_relaxed);
+
+        if (total == 0)
+            return 0.0f;
+
+        const double clamped = std::max(0.0, std::min(100.0, percentile));
+        const uint64_t rank  = std::max<uint64_t>(1, uint64_t(clamped / 100.0 * double(total) + 0.5));
+        const float maxUs    = float(maxNs.load(std::memory_order_relaxed)) / 1000.0f;
+
+        uint64_t count = 0;
+
+        for (uint32_t i=0; i < JACKBRIDGE_TIMING_BUCKETS; ++i)
+        {
+            count += histogram[i].load(std::memory_order_relaxed);
+
+            if (count >= rank)
+                return std::min(jackbridge_timing_bucket_value(i), maxUs);
+        }
+
+        return maxUs;
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+class JackBridgeTiming
+{
+public:
+    JackBridgeTiming() {}
+
+    ~JackBridgeTiming()
+    {
+        for (size_t i=0; i < fClients.size(); ++i)
+            delete fClients[i];
+    }
+
+    JackBridgeTimingClient* addClient(jack_client_t* const client)
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+
+        JackBridgeTimingClient* const tc(new JackBridgeTimingClient(client));
+        fClients.push_back(tc);
+        return tc;
+    }
+
+    JackBridgeTimingClient* getClient(const jack_client_t* const client)
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+
+        for (size_t i=0; i < fClients.size(); ++i)
+        {
+            if (fClients[i]->client == client)
+                return fClients[i];
+        }
+        return nullptr;
+    }
+
+    void removeClient(JackBridgeTimingClient* const tc)
+    {
+        {
+            std::lock_guard<std::mutex> lock(fLock);
+            fClients.erase(std::remove(fClients.begin(), fClients.end(), tc), fClients.end());
+        }
+
+        delete tc;
+    }
+
+private:
+    std::mutex fLock;
+    std::vector<JackBridgeTimingClient*> fClients;
+};
+
+static JackBridgeTiming gTiming;
+
+// -----------------------------------------------------------------------------
+// Callbacks given to JACK in place of the client's own
+
+static int jackbridge_timing_process(jack_nframes_t nframes, void* arg)
+{
+    JackBridgeTimingClient* const tc((JackBridgeTimingClient*)arg);
+
+    if (tc->process == nullptr)
+        return 0;
+
+    const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+    const int ret = tc->process(nframes, tc->processArg);
+    const std::chrono::steady_clock::duration duration(std::chrono::steady_clock::now() - start);
+
+    tc->addCycle(nframes, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    return ret;
+}
+
+static int jackbridge_timing_xrun(void* arg)
+{
+    JackBridgeTimingClient* const tc((JackBridgeTimingClient*)arg);
+
+    tc->addXRun();
+
+    return (tc->xrun != nullptr) ? tc->xrun(tc->xrunArg) : 0;
+}
+
+// Swaps 'callback' and 'arg' for the timing ones above, if timing is enabled for this client.
+// A null callback is kept as such by the wrapper, which has to stay installed.
+#define JACKBRIDGE_TIMING_CALLBACK(client, member, callback, arg)                   \
+    if (callback != jackbridge_timing_##member)                                     \
+    {                                                                               \
+        if (JackBridgeTimingClient* const tc = gTiming.getClient(client))           \
+        {                                                                           \
+            tc->member      = callback;                                             \
+            tc->member##Arg = arg;                                                  \
+            callback = jackbridge_timing_##member;                                  \
+            arg      = tc;                                                          \
+        }                                                                           \
+    }
+
+// after the client was closed, so none of its callbacks can run anymore
+static inline
+bool jackbridge_timing_client_close(jack_client_t* const client, const bool ok)
+{
+    if (JackBridgeTimingClient* const tc = gTiming.getClient(client))
+        gTiming.removeClient(tc);
+
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+bool jackbridge_timing_enable(jack_client_t* client)
+{
+    if (client == nullptr)
+        return false;
+    if (gTiming.getClient(client) != nullptr)
+        return true;
+
+    JackBridgeTimingClient* const tc(gTiming.addClient(client));
+
+    // needed even if the client never sets an xrun callback of its own
+    if (! jackbridge_set_xrun_callback(client, jackbridge_timing_xrun, tc))
+    {
+        gTiming.removeClient(tc);
+        return false;
+    }
+
+    return true;
+}
+
+bool jackbridge_timing_get_stats(jack_client_t* client, JackBridgeTimingStats* stats)
+{
+    if (stats == nullptr)
+        return false;
+
+    JackBridgeTimingClient* const tc(gTiming.getClient(client));
+
+    if (tc == nullptr)
+        return false;
+
+    // cleared, but not by the process thread yet
+    if (tc->isResetPending())
+    {
+        *stats = JackBridgeTimingStats();
+
+        std::lock_guard<std::mutex> lock(tc->xrunLock);
+        stats->xruns    = tc->xrunCount;
+        stats->ownXRuns = tc->ownXRunCount;
+
+        return true;
+    }
+
+    const uint64_t cycles(tc->cycles.load(std::memory_order_relaxed));
+
+    stats->cycles     = cycles;
+    stats->overruns   = tc->overruns.load(std::memory_order_relaxed);
+    stats->budgetUs   = float(tc->budgetNs.load(std::memory_order_relaxed)) / 1000.0f;
+    stats->meanUs     = (cycles != 0) ? float(double(tc->totalNs.load(std::memory_order_relaxed)) / double(cycles) / 1000.0) : 0.0f;
+    stats->maxUs      = float(tc->maxNs.load(std::memory_order_relaxed)) / 1000.0f;
+    stats->p50Us      = tc->getPercentile(50.0);
+    stats->p90Us      = tc->getPercentile(90.0);
+    stats->p99Us      = tc->getPercentile(99.0);
+    stats->p999Us     = tc->getPercentile(99.9);
+    stats->dspLoad    = tc->dspLoad.load(std::memory_order_relaxed);
+    stats->maxDspLoad = tc->maxDspLoad.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(tc->xrunLock);
+    stats->xruns    = tc->xrunCount;
+    stats->ownXRuns = tc->ownXRunCount;
+
+    return true;
+}
+
+float jackbridge_timing_get_percentile(jack_client_t* client, double percentile)
+{
+    JackBridgeTimingClient* const tc(gTiming.getClient(client));
+
+    return (tc != nullptr) ? tc->getPercentile(percentile) : 0.0f;
+}
+
+uint32_t jackbridge_timing_get_xruns(jack_client_t* client, JackBridgeTimingXRun* xruns, uint32_t max_count)
+{
+    JackBridgeTimingClient* const tc(gTiming.getClient(client));
+
+    if (tc == nullptr || xruns == nullptr)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(tc->xrunLock);
+
+    // the most recent ones, oldest first
+    const uint32_t count = std::min<uint32_t>(max_count, tc->xruns.size());
+    std::copy(tc->xruns.end() - count, tc->xruns.end(), xruns);
+    return count;
+}
+
+void jackbridge_timing_reset(jack_client_t* client)
+{
+    if (JackBridgeTimingClient* const tc = gTiming.getClient(client))
+        tc->reset();
+}
+
+// -----------------------------------------------------------------------------
@@ -23,52 +23,84 @@
 
 #define VERSION "0.8.1"
 
-#include "../jack_utils.hpp"
+#include "meterprocess.hpp"
+#include "../loudness.hpp"
+#include "../spectrum.hpp"
 #include "../widgets/digitalpeakmeter.hpp"
+#include "../widgets/goniometer.hpp"
+#include "../widgets/spectrumdisplay.hpp"
 
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <QtGui/QIcon>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QMessageBox>
 
 // -------------------------------
 
-volatile double x_portValue1 = 0.0;
-volatile double x_portValue2 = 0.0;
 volatile bool x_isOutput = true;
+volatile bool x_stopAnalysis = false;
 volatile bool x_needReconnect = false;
+volatile bool x_needFullRescan = true;
 volatile bool x_quitNow = false;
 
 jack_client_t* jClient = nullptr;
-jack_port_t* jPort1 = nullptr;
-jack_port_t* jPort2 = nullptr;
+
+std::vector<std::string> gSystemPortNames;
+
+// connect events, queued by the JACK notification thread and applied by the GUI/headless loop
+struct PortConnectEvent {
+    jack_port_id_t a, b;
+    bool connect;
+};
+
+static const size_t MAX_CONNECT_EVENTS = 4096;
+
+std::mutex gConnectEventsMutex;
+std::vector<PortConnectEvent> gConnectEvents;
+
+// cached state for incremental reconnects, only touched by the thread that reconnects
+std::map<std::string, uint32_t> gSystemPortIndexes;
+std::vector<std::set<jack_port_t*> > gUpstreamPorts;
+
+LoudnessMeter gLoudness;
+SpectrumAnalyzer gSpectrum;
+std::thread gAnalysisThread;
 
 QString gClientName;
+DigitalPeakMeter::Ballistics gBallistics = DigitalPeakMeter::DIGITAL;
 
 // -------------------------------
 // JACK callbacks
 
-int process_callback(const jack_nframes_t nframes, void*)
+void port_callback(jack_port_id_t a, jack_port_id_t b, int connect, void*)
 {
-    float* const jOut1 = (float*)jackbridge_port_get_buffer(jPort1, nframes);
-    float* const jOut2 = (float*)jackbridge_port_get_buffer(jPort2, nframes);
+    if (! x_isOutput)
+        return;
 
-    for (jack_nframes_t i = 0; i < nframes; i++)
     {
-        if (std::abs(jOut1[i]) > x_portValue1)
-            x_portValue1 = std::abs(jOut1[i]);
+        std::lock_guard<std::mutex> lock(gConnectEventsMutex);
 
-        if (std::abs(jOut2[i]) > x_portValue2)
-            x_portValue2 = std::abs(jOut2[i]);
+        if (gConnectEvents.size() < MAX_CONNECT_EVENTS)
+        {
+            const PortConnectEvent event = { a, b, connect != 0 };
+            gConnectEvents.push_back(event);
+        }
+        else
+        {
+            x_needFullRescan = true;
+        }
     }
 
-    return 0;
-}
-
-void port_callback(jack_port_id_t, jack_port_id_t, int, void*)
-{
-    if (x_isOutput)
-        x_needReconnect = true;
+    x_needReconnect = true;
 }
 
 #ifdef HAVE_JACKSESSION
@@ -95,55 +127,187 @@ void session_callback(jack_session_event_t* const event, void* const arg)
 // -------------------------------
 // helpers
 
-void reconnect_ports()
+// Re-reads every connection of the followed system ports and rebuilds the upstream cache
+void rescan_ports()
 {
-    x_needReconnect = false;
+    gSystemPortIndexes.clear();
+    gUpstreamPorts.assign(gChannels, std::set<jack_port_t*>());
 
-    const QString nameIn1(gClientName+":in1");
-    const QString nameIn2(gClientName+":in2");
-
-    if (x_isOutput)
+    for (uint32_t i=0; i < gChannels; ++i)
     {
-        jack_port_t* const jPlayPort1 = jackbridge_port_by_name(jClient, x_isOutput ? "system:playback_1" : "system:capture_1");
-        jack_port_t* const jPlayPort2 = jackbridge_port_by_name(jClient, x_isOutput ? "system:playback_2" : "system:capture_2");
-        std::vector<char*> jPortList1(jackbridge_port_get_all_connections_as_vector(jClient, jPlayPort1));
-        std::vector<char*> jPortList2(jackbridge_port_get_all_connections_as_vector(jClient, jPlayPort2));
+        const char* const systemPortName = gSystemPortNames[i].c_str();
+        const char* const ourPortName    = jackbridge_port_name(jPorts[i]);
+
+        gSystemPortIndexes[gSystemPortNames[i]] = i;
 
-        foreach (char* const& thisPortName, jPortList1)
+        if (x_isOutput)
         {
-            jack_port_t* const thisPort = jackbridge_port_by_name(jClient, thisPortName);
+            jack_port_t* const jPlayPort = jackbridge_port_by_name(jClient, systemPortName);
+
+            if (jPlayPort == nullptr)
+                continue;
+
+            if (const char** const connections = jackbridge_port_get_all_connections(jClient, jPlayPort))
+            {
+                for (int j=0; connections[j] != nullptr; ++j)
+                {
+                    jack_port_t* const thisPort = jackbridge_port_by_name(jClient, connections[j]);
 
-            if (! (jackbridge_port_is_mine(jClient, thisPort) || jackbridge_port_connected_to(jPort1, thisPortName)))
-                jackbridge_connect(jClient, thisPortName, nameIn1.toUtf8().constData());
+                    if (thisPort == nullptr || jackbridge_port_is_mine(jClient, thisPort))
+                        continue;
 
-            free(thisPortName);
+                    gUpstreamPorts[i].insert(thisPort);
+
+                    if (! jackbridge_port_connected_to(jPorts[i], connections[j]))
+                        jackbridge_connect(jClient, connections[j], ourPortName);
+                }
+
+                jackbridge_free(connections);
+            }
+        }
+        else
+        {
+            if (jackbridge_port_by_name(jClient, systemPortName) != nullptr)
+                if (! jackbridge_port_connected_to(jPorts[i], systemPortName))
+                    jackbridge_connect(jClient, systemPortName, ourPortName);
         }
+    }
+}
+
+// Applies the queued connect events to the upstream cache, connecting only new sources.
+// Returns false if an event could not be resolved, in which case a full rescan is needed.
+bool apply_connect_events()
+{
+    std::vector<PortConnectEvent> events;
+
+    {
+        std::lock_guard<std::mutex> lock(gConnectEventsMutex);
+        events.swap(gConnectEvents);
+    }
 
-        foreach (char* const& thisPortName, jPortList2)
+    foreach (const PortConnectEvent& event, events)
+    {
+        jack_port_t* portA = jackbridge_port_by_id(jClient, event.a);
+        jack_port_t* portB = jackbridge_port_by_id(jClient, event.b);
+
+        // port already gone, the cache might hold a stale pointer now
+        if (portA == nullptr || portB == nullptr)
+            return false;
+
+        // make 'portA' the source
+        if ((jackbridge_port_flags(portA) & JackPortIsOutput) == 0)
+            std::swap(portA, portB);
+
+        // only connections from a foreign source into a followed system port matter
+        const std::map<std::string, uint32_t>::const_iterator it = gSystemPortIndexes.find(jackbridge_port_name(portB));
+
+        if (it == gSystemPortIndexes.end() || jackbridge_port_is_mine(jClient, portA))
+            continue;
+
+        const uint32_t i = it->second;
+
+        if (! event.connect)
         {
-            jack_port_t* const thisPort = jackbridge_port_by_name(jClient, thisPortName);
+            gUpstreamPorts[i].erase(portA);
+            continue;
+        }
+
+        if (! gUpstreamPorts[i].insert(portA).second)
+            continue;
+
+        const char* const sourcePortName = jackbridge_port_name(portA);
+
+        if (! jackbridge_port_connected_to(jPorts[i], sourcePortName))
+            jackbridge_connect(jClient, sourcePortName, jackbridge_port_name(jPorts[i]));
+    }
+
+    return true;
+}
+
+void reconnect_ports()
+{
+    x_needReconnect = false;
+
+    if (! x_needFullRescan && apply_connect_events())
+        return;
+
+    x_needFullRescan = false;
 
-            if (! (jackbridge_port_is_mine(jClient, thisPort) || jackbridge_port_connected_to(jPort2, thisPortName)))
-                jackbridge_connect(jClient, thisPortName, nameIn2.toUtf8().constData());
+    // anything queued until now is covered by the rescan
+    {
+        std::lock_guard<std::mutex> lock(gConnectEventsMutex);
+        gConnectEvents.clear();
+    }
 
-            free(thisPortName);
+    rescan_ports();
+}
+
+// Decides which system ports to follow, either the first 'gChannels' ones or all of them
+void find_system_ports(const bool followAll)
+{
+    const char* const prefix = x_isOutput ? "system:playback_" : "system:capture_";
+
+    gSystemPortNames.clear();
+
+    if (followAll)
+    {
+        const unsigned long flags = x_isOutput ? JackPortIsInput : JackPortIsOutput;
+
+        if (const char** const ports = jackbridge_get_ports(jClient, prefix, JACK_DEFAULT_AUDIO_TYPE, flags|JackPortIsPhysical))
+        {
+            for (int i=0; ports[i] != nullptr && gSystemPortNames.size() < MAX_CHANNELS; ++i)
+                gSystemPortNames.push_back(ports[i]);
+
+            jackbridge_free(ports);
         }
 
-        jPortList1.clear();
-        jPortList2.clear();
+        if (gSystemPortNames.size() > 0)
+        {
+            gChannels = gSystemPortNames.size();
+            return;
+        }
     }
-    else
+
+    for (uint32_t i=0; i < gChannels; ++i)
+        gSystemPortNames.push_back(prefix + std::to_string(i+1));
+}
+
+// -------------------------------
+// analysis thread, drains the audio ring
+
+static const uint32_t ANALYSIS_BLOCK_SIZE = 1024;
+
+void analysis_thread()
+{
+    std::vector<float> storage(gChannels*ANALYSIS_BLOCK_SIZE);
+    float* buffers[MAX_CHANNELS];
+
+    for (uint32_t i=0; i < gChannels; ++i)
+        buffers[i] = &storage[i*ANALYSIS_BLOCK_SIZE];
+
+    while (! x_stopAnalysis)
     {
-        if (jackbridge_port_by_name(jClient, "system:capture_1") != nullptr)
-            if (! jackbridge_port_connected_to(jPort1, "system:capture_1"))
-                jackbridge_connect(jClient, "system:capture_1", nameIn1.toUtf8().constData());
+        const uint32_t frames = x_audioRing.read(buffers, ANALYSIS_BLOCK_SIZE);
 
-        if (jackbridge_port_by_name(jClient, "system:capture_2") != nullptr)
-            if (! jackbridge_port_connected_to(jPort2, "system:capture_2"))
-                jackbridge_connect(jClient, "system:capture_2", nameIn2.toUtf8().constData());
+        if (frames == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        if (x_spectrum)
+            gSpectrum.process(buffers, frames);
+        else
+            gLoudness.process(buffers, frames);
     }
 }
 
+// the meter scale is in dB, so LUFS are shown as if they were dBFS
+float loudness_to_level(const float lufs)
+{
+    return std::pow(10.0f, lufs / 20.0f);
+}
+
 // -------------------------------
 // Meter class
 
@@ -153,23 +317,28 @@ public:
     MeterW() : DigitalPeakMeter(nullptr)
     {
         setWindowFlags(Qt::Tool | Qt::WindowStaysOnTopHint);
-        setWindowTitle(gClientName);
+        setWindowTitle(x_truePeak ? gClientName + " (True Peak)" : gClientName);
 
         if (x_isOutput)
             setColor(Color::GREEN);
         else
             setColor(Color::BLUE);
 
-        setChannels(2);
+        // momentary, short-term and integrated
+        const uint32_t meters = x_loudness ? 3 : gChannels;
+
+        setChannels(meters);
         setOrientation(VERTICAL);
-        setSmoothRelease(1);
+        // loudness values are already integrated
+        setBallistics(x_loudness ? DIRECT : gBallistics);
 
-        displayMeter(1, 0.0f);
-        displayMeter(2, 0.0f);
+        for (uint32_t i=0; i < meters; ++i)
+            displayMeter(i+1, 0.0f);
 
         int refresh = float(jackbridge_get_buffer_size(jClient)) / jackbridge_get_sample_rate(jClient) * 1000;
 
         m_peakTimerId = startTimer(refresh > 50 ? refresh : 50);
+        m_lastPeriods = 0;
     }
 
 protected:
@@ -182,12 +351,40 @@ protected:
             return;
         }
 
-        if (event->timerId() == m_peakTimerId)
+        if (event->timerId() == m_peakTimerId && x_loudness)
         {
-            displayMeter(1, x_portValue1);
-            displayMeter(2, x_portValue2);
-            x_portValue1 = 0.0;
-            x_portValue2 = 0.0;
+            const float momentary  = gLoudness.getMomentary();
+            const float shortTerm  = gLoudness.getShortTerm();
+            const float integrated = gLoudness.getIntegrated();
+
+            const float levels[3] = {
+                loudness_to_level(momentary),
+                loudness_to_level(shortTerm),
+                loudness_to_level(integrated)
+            };
+
+            displayMeters(levels, 3);
+
+            setWindowTitle(QString("%1 - M %2 S %3 I %4 LUFS").arg(gClientName)
+                                                               .arg(momentary, 0, 'f', 1)
+                                                               .arg(shortTerm, 0, 'f', 1)
+                                                               .arg(integrated, 0, 'f', 1));
+
+            if (x_needReconnect)
+                reconnect_ports();
+        }
+        else if (event->timerId() == m_peakTimerId)
+        {
+            float peaks[MAX_CHANNELS];
+            const uint32_t periods = x_peaks.get(peaks);
+
+            displayMeters(peaks, gChannels);
+
+            if (periods != m_lastPeriods)
+            {
+                m_lastPeriods = periods;
+                setToolTip(tr("%1 JACK periods per refresh").arg(periods));
+            }
 
             if (x_needReconnect)
                 reconnect_ports();
@@ -198,22 +395,132 @@ protected:
 
 private:
     int m_peakTimerId;
+    uint32_t m_lastPeriods;
 };
 
 // -------------------------------
+// Spectrum class
 
-int main(int argc, char* argv[])
+class SpectrumW : public SpectrumDisplay
 {
-    QApplication app(argc, argv);
-    app.setApplicationName("JackMeter");
-    app.setApplicationVersion(VERSION);
-    app.setOrganizationName("Cadence");
-    app.setWindowIcon(QIcon(":/scalable/cadence.svg"));
+public:
+    SpectrumW() : SpectrumDisplay(nullptr)
+    {
+        setWindowFlags(Qt::Tool | Qt::WindowStaysOnTopHint);
+        setWindowTitle(gClientName + " (Spectrum)");
+
+        if (x_isOutput)
+            setColor(Color::GREEN);
+        else
+            setColor(Color::BLUE);
+
+        setBands(SPECTRUM_BANDS, SPECTRUM_MIN_FREQ, SPECTRUM_MAX_FREQ, SPECTRUM_MIN_DB);
+
+        m_timerId = startTimer(50);
+    }
+
+protected:
+    void timerEvent(QTimerEvent* event)
+    {
+        if (x_quitNow)
+        {
+            close();
+            x_quitNow = false;
+            return;
+        }
+
+        if (event->timerId() == m_timerId)
+        {
+            float levels[SPECTRUM_BANDS];
+            float peaks[SPECTRUM_BANDS];
+
+            gSpectrum.getBands(levels, peaks);
+            displayBands(levels, peaks);
 
-    if (app.arguments().contains("-in"))
-        x_isOutput = false;
+            if (x_needReconnect)
+                reconnect_ports();
+        }
+
+        QWidget::timerEvent(event);
+    }
+
+private:
+    int m_timerId;
+};
+
+// -------------------------------
+// Goniometer class
 
-    // JACK initialization
+class PhaseW : public Goniometer
+{
+public:
+    PhaseW() : Goniometer(nullptr)
+    {
+        setWindowFlags(Qt::Tool | Qt::WindowStaysOnTopHint);
+        setWindowTitle(gClientName + " (Phase)");
+
+        if (x_isOutput)
+            setColor(Color::GREEN);
+        else
+            setColor(Color::BLUE);
+
+        m_timerId = startTimer(50);
+    }
+
+protected:
+    void timerEvent(QTimerEvent* event)
+    {
+        if (x_quitNow)
+        {
+            close();
+            x_quitNow = false;
+            return;
+        }
+
+        if (event->timerId() == m_timerId)
+        {
+            // only the newest MAX_SCOPE_POINTS of everything read are shown, older ones are skipped
+            float* const buffers[2] = { m_chunkLeft, m_chunkRight };
+            uint32_t count = 0;
+
+            while (const uint32_t frames = x_scopeRing.read(buffers, MAX_SCOPE_POINTS))
+            {
+                const uint32_t keep = std::min(count, MAX_SCOPE_POINTS - frames);
+
+                std::memmove(m_left,  m_left  + (count - keep), keep * sizeof(float));
+                std::memmove(m_right, m_right + (count - keep), keep * sizeof(float));
+                std::memcpy(m_left  + keep, m_chunkLeft,  frames * sizeof(float));
+                std::memcpy(m_right + keep, m_chunkRight, frames * sizeof(float));
+                count = keep + frames;
+            }
+
+            if (count > 0)
+                displayPoints(m_left, m_right, count);
+
+            displayCorrelation(x_correlation.load(std::memory_order_relaxed));
+
+            if (x_needReconnect)
+                reconnect_ports();
+        }
+
+        QWidget::timerEvent(event);
+    }
+
+private:
+    int m_timerId;
+    float m_left[MAX_SCOPE_POINTS];
+    float m_right[MAX_SCOPE_POINTS];
+    float m_chunkLeft[MAX_SCOPE_POINTS];
+    float m_chunkRight[MAX_SCOPE_POINTS];
+};
+
+// -------------------------------
+// JACK setup, shared by the GUI and headless modes
+
+// Returns false and sets 'errorString' if the JACK client could not be opened.
+// A non-empty 'busName' publishes the peaks on the shared-memory level bus.
+bool jack_start(const bool followAllPorts, const std::string& busName, char* const programPath, std::string& errorString)
+{
     jack_status_t jStatus;
 #ifdef HAVE_JACKSESSION
     jack_options_t jOptions = static_cast<jack_options_t>(JackNoStartServer|JackUseExactName|JackSessionID);
@@ -224,38 +531,431 @@ int main(int argc, char* argv[])
 
     if (! jClient)
     {
-        std::string errorString(jackbridge_status_get_error_string(jStatus));
-        QMessageBox::critical(nullptr, app.translate("MeterW", "Error"), app.translate("MeterW",
-                                                                                       "Could not connect to JACK, possible reasons:\n"
-                                                                                       "%1").arg(QString::fromStdString(errorString)));
-        return 1;
+        errorString = jackbridge_status_get_error_string(jStatus);
+        return false;
     }
 
     gClientName = jackbridge_get_client_name(jClient);
 
-    jPort1 = jackbridge_port_register(jClient, "in1", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-    jPort2 = jackbridge_port_register(jClient, "in2", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    find_system_ports(followAllPorts);
+
+    for (uint32_t i=0; i < gChannels; ++i)
+    {
+        const std::string portName("in" + std::to_string(i+1));
+        jPorts[i] = jackbridge_port_register(jClient, portName.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    }
+
+    // pick the best peak kernels for this CPU before the RT thread starts
+    gAbsMaxFunc      = simd_get_abs_max_func();
+    gAbsMaxSumSqFunc = simd_get_abs_max_sum_sq_func();
+    x_peaks.setChannels(gChannels);
+
+    if (x_phase)
+        setup_phase(jackbridge_get_sample_rate(jClient));
+
+    if (! busName.empty())
+    {
+        const char* portNames[MAX_CHANNELS];
+
+        for (uint32_t i=0; i < gChannels; ++i)
+            portNames[i] = gSystemPortNames[i].c_str();
+
+        if (! gLevelBus.open(busName.c_str(), gChannels, jackbridge_get_sample_rate(jClient), portNames))
+        {
+            if (errno == EEXIST)
+                qWarning("The level bus '%s' already exists (another meter, or left over by a crash), use '--bus=NAME' for another one", busName.c_str());
+            else
+                qWarning("Could not create the level bus '%s'", busName.c_str());
+        }
+    }
+
+    if (x_truePeak)
+    {
+        gTruePeakDetectors = new TruePeakDetector[gChannels];
+
+        for (uint32_t i=0; i < gChannels; ++i)
+            gTruePeakDetectors[i].init();
+    }
+
+    // PPM and VU integrate over a few ms, so they run on every sample here, not in the GUI
+    if ((gBallistics == DigitalPeakMeter::PPM || gBallistics == DigitalPeakMeter::VU) && ! (x_headless || x_loudness || x_spectrum))
+    {
+        const MeterBallisticsMode mode = (gBallistics == DigitalPeakMeter::PPM) ? METER_BALLISTICS_PPM : METER_BALLISTICS_VU;
+        const uint32_t sampleRate = jackbridge_get_sample_rate(jClient);
+
+        gMeterBallistics = new MeterBallistics[gChannels];
+
+        for (uint32_t i=0; i < gChannels; ++i)
+            gMeterBallistics[i].init(mode, sampleRate);
+    }
+
+    if (x_loudness || x_spectrum)
+    {
+        const uint32_t sampleRate = jackbridge_get_sample_rate(jClient);
+
+        // 1 second of audio before the analysis thread starts dropping frames
+        x_audioRing.setup(gChannels, sampleRate);
+
+        if (x_spectrum)
+            gSpectrum.setup(gChannels, sampleRate);
+        else
+            gLoudness.setup(gChannels, sampleRate);
+
+        gAnalysisThread = std::thread(analysis_thread);
+    }
+
+    // reconnect_ports() looks up the same system ports on every graph change
+    jackbridge_port_cache_enable(jClient);
 
     jackbridge_set_process_callback(jClient, process_callback, nullptr);
     jackbridge_set_port_connect_callback(jClient, port_callback, nullptr);
+    jackbridge_set_xrun_callback(jClient, xrun_callback, nullptr);
 #ifdef HAVE_JACKSESSION
-    jackbridge_set_session_callback(jClient, session_callback, argv[0]);
+    jackbridge_set_session_callback(jClient, session_callback, programPath);
+#else
+    Q_UNUSED(programPath);
 #endif
     jackbridge_activate(jClient);
 
     reconnect_ports();
 
+    return true;
+}
+
+void jack_stop()
+{
+    jackbridge_deactivate(jClient);
+    jackbridge_client_close(jClient);
+
+    if (gAnalysisThread.joinable())
+    {
+        x_stopAnalysis = true;
+        gAnalysisThread.join();
+    }
+
+    if (gTruePeakDetectors != nullptr)
+        delete[] gTruePeakDetectors;
+
+    if (gMeterBallistics != nullptr)
+        delete[] gMeterBallistics;
+
+    gLevelBus.close();
+}
+
+// -------------------------------
+// Headless mode, periodic records instead of a window
+//
+// CSV output starts with a header line, then one line per record:
+//   time,xruns,periods,peak1,rms1,peak2,rms2,...
+//
+// Binary output starts with "CJMB", then the version, channel count and sample rate
+// as uint32, followed by records of: double time, uint32 xruns, uint32 periods and
+// (float peak, float rms) per channel. Everything is in host byte order.
+//
+// 'time' is in seconds since the epoch, 'xruns' counts the xruns since the previous
+// record, peak and RMS values are linear.
+
+void signal_handler(int)
+{
+    x_quitNow = true;
+}
+
+int headless_main(const char* const outputPath, const bool binary, const double rate)
+{
+    FILE* const out = (std::strcmp(outputPath, "-") == 0) ? stdout : std::fopen(outputPath, binary ? "wb" : "w");
+
+    if (out == nullptr)
+    {
+        qCritical("Could not open '%s' for writing", outputPath);
+        return 1;
+    }
+
+    std::signal(SIGINT,  signal_handler);
+    std::signal(SIGTERM, signal_handler);
+
+    if (binary)
+    {
+        const uint32_t header[3] = { 1, gChannels, jackbridge_get_sample_rate(jClient) };
+        std::fwrite("CJMB", 1, 4, out);
+        std::fwrite(header, sizeof(uint32_t), 3, out);
+    }
+    else
+    {
+        std::fprintf(out, "time,xruns,periods");
+
+        for (uint32_t i=0; i < gChannels; ++i)
+            std::fprintf(out, ",peak%u,rms%u", i+1, i+1);
+
+        std::fprintf(out, "\n");
+    }
+
+    std::fflush(out);
+
+    const std::chrono::steady_clock::duration interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate)));
+    std::chrono::steady_clock::time_point next(std::chrono::steady_clock::now());
+
+    float  peaks[MAX_CHANNELS];
+    double squares[MAX_CHANNELS];
+    float  levels[MAX_CHANNELS*2];
+    uint32_t frames = 0;
+
+    while (! x_quitNow)
+    {
+        next += interval;
+
+        // short sleeps, so signals and session quit requests are handled quickly
+        while (! x_quitNow && std::chrono::steady_clock::now() < next)
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(next - std::chrono::steady_clock::now(), std::chrono::milliseconds(50)));
+
+        if (x_needReconnect)
+            reconnect_ports();
+
+        const uint32_t periods = x_peaks.get(peaks, squares, &frames);
+        const uint32_t xruns   = x_xruns.exchange(0);
+        const double   time    = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        for (uint32_t i=0; i < gChannels; ++i)
+        {
+            levels[i*2]   = peaks[i];
+            levels[i*2+1] = (frames > 0) ? float(std::sqrt(squares[i] / frames)) : 0.0f;
+        }
+
+        if (binary)
+        {
+            const uint32_t counts[2] = { xruns, periods };
+            std::fwrite(&time, sizeof(double), 1, out);
+            std::fwrite(counts, sizeof(uint32_t), 2, out);
+            std::fwrite(levels, sizeof(float), gChannels*2, out);
+        }
+        else
+        {
+            std::fprintf(out, "%.3f,%u,%u", time, xruns, periods);
+
+            for (uint32_t i=0; i < gChannels*2; ++i)
+                std::fprintf(out, ",%.6f", levels[i]);
+
+            std::fprintf(out, "\n");
+        }
+
+        if (std::fflush(out) != 0)
+        {
+            qCritical("Failed to write meter output, quitting");
+            break;
+        }
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+
+    return 0;
+}
+
+// -------------------------------
+
+int main(int argc, char* argv[])
+{
+    bool followAllPorts = false;
+    bool binaryOutput = false;
+    double headlessRate = 10.0;
+    QByteArray outputPath("-");
+    std::string busName;
+
+    // parsed before QApplication is created, so headless mode never touches the GUI
+    for (int i=1; i < argc; ++i)
+    {
+        const QString arg(QString::fromLocal8Bit(argv[i]));
+
+        if (arg == "-in")
+        {
+            x_isOutput = false;
+        }
+        else if (arg == "-truepeak")
+        {
+            x_truePeak = true;
+        }
+        else if (arg == "-loudness")
+        {
+            x_loudness = true;
+        }
+        else if (arg == "-spectrum")
+        {
+            x_spectrum = true;
+        }
+        else if (arg == "-phase")
+        {
+            x_phase = true;
+        }
+        else if (arg == "--headless")
+        {
+            x_headless = true;
+        }
+        else if (arg == "--bus")
+        {
+            busName = LEVEL_BUS_DEFAULT_NAME;
+        }
+        else if (arg.startsWith("--bus="))
+        {
+            busName = arg.mid(6).toStdString();
+
+            // POSIX shared memory names start with a slash
+            if (busName.empty() || busName[0] != '/')
+                busName.insert(0, 1, '/');
+        }
+        else if (arg.startsWith("--ballistics="))
+        {
+            const QString value(arg.mid(13));
+
+            if (value == "digital")
+                gBallistics = DigitalPeakMeter::DIGITAL;
+            else if (value == "ppm")
+                gBallistics = DigitalPeakMeter::PPM;
+            else if (value == "vu")
+                gBallistics = DigitalPeakMeter::VU;
+            else if (value == "none")
+                gBallistics = DigitalPeakMeter::DIRECT;
+            else
+                qWarning("Invalid ballistics '%s', must be 'digital', 'ppm', 'vu' or 'none'", value.toUtf8().constData());
+        }
+        else if (arg.startsWith("--channels="))
+        {
+            const QString value(arg.mid(11));
+
+            if (value == "all")
+            {
+                followAllPorts = true;
+                continue;
+            }
+
+            bool ok;
+            const uint channels = value.toUInt(&ok);
+
+            if (ok && channels > 0 && channels <= MAX_CHANNELS)
+                gChannels = channels;
+            else
+                qWarning("Invalid channel count '%s', must be between 1 and %u", value.toUtf8().constData(), MAX_CHANNELS);
+        }
+        else if (arg.startsWith("--rate="))
+        {
+            bool ok;
+            const double rate = arg.mid(7).toDouble(&ok);
+
+            if (ok && rate >= 0.1 && rate <= 1000.0)
+                headlessRate = rate;
+            else
+                qWarning("Invalid rate '%s', must be between 0.1 and 1000 records per second", arg.mid(7).toUtf8().constData());
+        }
+        else if (arg.startsWith("--output="))
+        {
+            outputPath = arg.mid(9).toLocal8Bit();
+        }
+        else if (arg.startsWith("--format="))
+        {
+            const QString value(arg.mid(9));
+
+            if (value == "csv" || value == "binary")
+                binaryOutput = (value == "binary");
+            else
+                qWarning("Invalid format '%s', must be 'csv' or 'binary'", value.toUtf8().constData());
+        }
+    }
+
+    if (x_headless && x_loudness)
+    {
+        qWarning("Loudness metering is not available in headless mode, ignoring '-loudness'");
+        x_loudness = false;
+    }
+
+    if (x_headless && x_spectrum)
+    {
+        qWarning("The spectrum analyzer is not available in headless mode, ignoring '-spectrum'");
+        x_spectrum = false;
+    }
+
+    if (x_headless && x_phase)
+    {
+        qWarning("The goniometer is not available in headless mode, ignoring '-phase'");
+        x_phase = false;
+    }
+
+    if (x_phase && (x_spectrum || x_loudness))
+    {
+        qWarning("'-phase' can not be combined with '-spectrum' or '-loudness', ignoring '-phase'");
+        x_phase = false;
+    }
+
+    if (x_spectrum && x_loudness)
+    {
+        qWarning("Only one of '-spectrum' and '-loudness' can be used, ignoring '-loudness'");
+        x_loudness = false;
+    }
+
+    if ((x_loudness || x_spectrum) && ! busName.empty())
+    {
+        qWarning("The level bus is not available in loudness or spectrum mode, ignoring '--bus'");
+        busName.clear();
+    }
+
+    if (x_headless)
+    {
+        std::string errorString;
+
+        if (! jack_start(followAllPorts, busName, argv[0], errorString))
+        {
+            qCritical("Could not connect to JACK, possible reasons:\n%s", errorString.c_str());
+            return 1;
+        }
+
+        const int ret = headless_main(outputPath.constData(), binaryOutput, headlessRate);
+
+        jack_stop();
+
+        return ret;
+    }
+
+    QApplication app(argc, argv);
+    app.setApplicationName("JackMeter");
+    app.setApplicationVersion(VERSION);
+    app.setOrganizationName("Cadence");
+    app.setWindowIcon(QIcon(":/scalable/cadence.svg"));
+
+    std::string errorString;
+
+    if (! jack_start(followAllPorts, busName, argv[0], errorString))
+    {
+        QMessageBox::critical(nullptr, app.translate("MeterW", "Error"), app.translate("MeterW",
+                                                                                       "Could not connect to JACK, possible reasons:\n"
+                                                                                       "%1").arg(QString::fromStdString(errorString)));
+        return 1;
+    }
+
     // Show GUI
-    MeterW gui;
-    gui.resize(70, 600);
-    gui.show();
-    gui.setAttribute(Qt::WA_QuitOnClose);
+    QWidget* gui;
+
+    if (x_spectrum)
+    {
+        gui = new SpectrumW();
+        gui->resize(480, 240);
+    }
+    else if (x_phase)
+    {
+        gui = new PhaseW();
+        gui->resize(300, 312);
+    }
+    else
+    {
+        gui = new MeterW();
+        gui->resize(qMax(70, int(gChannels)*12), 600);
+    }
+
+    gui->show();
+    gui->setAttribute(Qt::WA_QuitOnClose);
 
     // App-Loop
     int ret = app.exec();
 
-    jackbridge_deactivate(jClient);
-    jackbridge_client_close(jClient);
+    delete gui;
+
+    jack_stop();
 
     return ret;
 }
@@ -9,17 +9,31 @@ DEFINES   = DEBUG
 DEFINES  += HAVE_JACKSESSION
 PKGCONFIG = jack
 
+LIBS      = -lpthread -lrt
+
 TARGET   = cadence-jackmeter
 TEMPLATE = app
 VERSION  = 0.5.0
 
 SOURCES  = \
     jackmeter.cpp \
-    ../widgets/digitalpeakmeter.cpp
+    ../widgets/digitalpeakmeter.cpp \
+    ../widgets/goniometer.cpp \
+    ../widgets/spectrumdisplay.cpp
 
 HEADERS  = \
+    ../audio_ring.hpp \
     ../jack_utils.hpp \
-    ../widgets/digitalpeakmeter.hpp
+    ../level_bus.hpp \
+    ../loudness.hpp \
+    ../peak_ring.hpp \
+    ../simd_utils.hpp \
+    ../spectrum.hpp \
+    ../true_peak.hpp \
+    meterprocess.hpp \
+    ../widgets/digitalpeakmeter.hpp \
+    ../widgets/goniometer.hpp \
+    ../widgets/spectrumdisplay.hpp
 
 INCLUDEPATH = \
     ../widgets
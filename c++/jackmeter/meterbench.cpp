@@ -0,0 +1,215 @@
+/*
+ * Benchmark for the JACK Audio Meter DSP kernels and process callback
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+// Needs no JACK server, the process callback runs against dummy ports.
+// Build with -DJACKBRIDGE_DUMMY (see the 'bench' target in the Makefile).
+
+#include "meterprocess.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// -------------------------------
+
+static const uint32_t kSampleRate = 48000;
+static const uint32_t kSeconds    = 10;
+
+static volatile float gSink = 0.0f;
+
+// Runs 'kSeconds' worth of audio through 'func' in 'bufferSize' chunks, returns ns per frame.
+template<typename Func>
+static double bench(const std::vector<float>& audio, const uint32_t bufferSize, Func func)
+{
+    const uint32_t totalFrames = kSampleRate * kSeconds;
+    const uint32_t audioFrames = audio.size();
+
+    float peak = 0.0f;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (uint32_t done=0; done < totalFrames; done += bufferSize)
+    {
+        const float value = func(&audio[done % (audioFrames - bufferSize)], bufferSize);
+
+        if (value > peak)
+            peak = value;
+    }
+
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    gSink = peak;
+
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) / totalFrames;
+}
+
+// -------------------------------
+// process_callback() with dummy ports, in batches of periods so timer overhead stays small
+
+static const uint32_t kBatches = 50;
+
+struct ProcessResult {
+    double nsPerFrame; // mean over all batches, for all channels together
+    double stddev;     // of the per-batch ns/frame
+    double msamples;   // channel samples processed per second, in millions
+};
+
+static ProcessResult bench_process(const std::vector<float>& audio, const uint32_t channels, const uint32_t bufferSize)
+{
+    gChannels = channels;
+
+    for (uint32_t i=0; i < channels; ++i)
+    {
+        const std::string portName("in" + std::to_string(i+1));
+        jPorts[i] = jackbridge_port_register(nullptr, portName.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    }
+
+    x_peaks.setChannels(channels);
+
+    if (x_truePeak)
+    {
+        gTruePeakDetectors = new TruePeakDetector[channels];
+
+        for (uint32_t i=0; i < channels; ++i)
+            gTruePeakDetectors[i].init();
+    }
+
+    // about 100ms of audio per batch
+    const uint32_t periodsPerBatch = (kSampleRate/10 > bufferSize) ? kSampleRate/10/bufferSize : 1;
+    const uint32_t audioFrames = audio.size();
+
+    float  peaks[MAX_CHANNELS];
+    double batchCosts[kBatches];
+    uint32_t position = 0;
+
+    for (uint32_t b=0; b < kBatches; ++b)
+    {
+        std::chrono::steady_clock::duration elapsed(0);
+
+        for (uint32_t p=0; p < periodsPerBatch; ++p)
+        {
+            // new input for every period, like a real server
+            for (uint32_t i=0; i < channels; ++i)
+            {
+                float* const buffer = (float*)jackbridge_port_get_buffer(jPorts[i], bufferSize);
+                std::memcpy(buffer, &audio[(position + i*997) % (audioFrames - bufferSize)], sizeof(float)*bufferSize);
+            }
+
+            position += bufferSize;
+
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            process_callback(bufferSize, nullptr);
+            elapsed += std::chrono::steady_clock::now() - start;
+
+            // the GUI would do this every 50ms, draining every period keeps the ring from filling up
+            x_peaks.get(peaks);
+        }
+
+        batchCosts[b] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / (periodsPerBatch * bufferSize);
+    }
+
+    for (uint32_t i=0; i < channels; ++i)
+        jackbridge_port_unregister(nullptr, jPorts[i]);
+
+    if (gTruePeakDetectors != nullptr)
+    {
+        delete[] gTruePeakDetectors;
+        gTruePeakDetectors = nullptr;
+    }
+
+    double mean = 0.0, variance = 0.0;
+
+    for (uint32_t b=0; b < kBatches; ++b)
+        mean += batchCosts[b];
+    mean /= kBatches;
+
+    for (uint32_t b=0; b < kBatches; ++b)
+        variance += (batchCosts[b] - mean) * (batchCosts[b] - mean);
+    variance /= kBatches;
+
+    gSink = peaks[0];
+
+    ProcessResult result;
+    result.nsPerFrame = mean;
+    result.stddev     = std::sqrt(variance);
+    result.msamples   = (mean > 0.0) ? 1000.0 * channels / mean : 0.0;
+    return result;
+}
+
+// -------------------------------
+
+int main(int argc, char* argv[])
+{
+    // same mode switches as cadence-jackmeter
+    for (int i=1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-truepeak") == 0)
+            x_truePeak = true;
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            x_headless = true;
+    }
+
+    std::vector<float> audio(kSampleRate + 8192);
+
+    for (size_t i=0; i < audio.size(); ++i)
+        audio[i] = float(std::rand()) / RAND_MAX * 2.0f - 1.0f;
+
+    const SimdAbsMaxFunc absMaxFunc = simd_get_abs_max_func();
+
+    TruePeakDetector truePeak;
+    truePeak.init();
+
+    std::printf("SIMD level: %s\n", simd_get_arch_name());
+    std::printf("%-8s %14s %14s %14s\n", "frames", "peak scalar", "peak simd", "true-peak");
+
+    for (uint32_t bufferSize=16; bufferSize <= 4096; bufferSize *= 2)
+    {
+        const double scalarCost = bench(audio, bufferSize, simd_abs_max_scalar);
+        const double simdCost   = bench(audio, bufferSize, absMaxFunc);
+        const double truePeakCost = bench(audio, bufferSize, [&truePeak](const float* buf, uint32_t frames) {
+            return truePeak.process(buf, frames);
+        });
+
+        std::printf("%-8u %11.3f ns %11.3f ns %11.3f ns\n", bufferSize, scalarCost, simdCost, truePeakCost);
+    }
+
+    std::printf("(cost per frame and channel)\n\n");
+
+    gAbsMaxFunc      = absMaxFunc;
+    gAbsMaxSumSqFunc = simd_get_abs_max_sum_sq_func();
+
+    std::printf("process_callback, %s mode\n", x_truePeak ? "true-peak" : (x_headless ? "peak+RMS" : "peak"));
+    std::printf("%-8s %-8s %14s %12s %16s\n", "frames", "channels", "ns/frame", "stddev", "throughput");
+
+    for (uint32_t channels=2; channels <= MAX_CHANNELS; channels *= 4)
+    {
+        for (uint32_t bufferSize=16; bufferSize <= 4096; bufferSize *= 2)
+        {
+            const ProcessResult result = bench_process(audio, channels, bufferSize);
+
+            std::printf("%-8u %-8u %11.3f ns %9.3f ns %10.1f MS/s\n", bufferSize, channels, result.nsPerFrame, result.stddev, result.msamples);
+        }
+    }
+
+    std::printf("(cost per frame for all channels, throughput in channel samples per second)\n");
+
+    return 0;
+}
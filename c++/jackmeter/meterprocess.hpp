@@ -0,0 +1,185 @@
+/*
+ * Realtime part of the JACK Audio Meter, kept free of Qt for benchmarking
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __METERPROCESS_HPP__
+#define __METERPROCESS_HPP__
+
+#include "../audio_ring.hpp"
+#include "../jack_utils.hpp"
+#include "../level_bus.hpp"
+#include "../meter_ballistics.hpp"
+#include "../peak_ring.hpp"
+#include "../simd_utils.hpp"
+#include "../true_peak.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+// Everything the JACK process thread touches lives here, so that meterbench.cpp
+// can drive the very same process_callback() against the dummy JackBridge.
+// Like jack_utils.hpp, this must only be included once per program.
+
+// -------------------------------
+
+static const uint32_t MAX_CHANNELS = 128;
+
+PeakRing x_peaks;
+AudioRing x_audioRing;
+volatile bool x_truePeak = false;
+volatile bool x_loudness = false;
+volatile bool x_spectrum = false;
+volatile bool x_phase = false;
+volatile bool x_headless = false;
+std::atomic<uint32_t> x_xruns(0);
+
+jack_port_t* jPorts[MAX_CHANNELS] = { nullptr };
+
+uint32_t gChannels = 2;
+
+SimdAbsMaxFunc gAbsMaxFunc = simd_abs_max_scalar;
+SimdAbsMaxSumSqFunc gAbsMaxSumSqFunc = simd_abs_max_sum_sq_scalar;
+TruePeakDetector* gTruePeakDetectors = nullptr;
+MeterBallistics* gMeterBallistics = nullptr; // PPM or VU, what the GUI shows instead of the peaks
+LevelBusWriter gLevelBus;
+
+// -------------------------------
+// Phase correlation and goniometer, on the first two channels
+
+static const uint32_t MAX_SCOPE_POINTS = 4096;
+
+std::atomic<float> x_correlation(0.0f);
+AudioRing x_scopeRing; // decimated left/right samples
+
+SimdStereoSumsFunc gStereoSumsFunc = simd_stereo_sums_scalar;
+double   gCorrelationSums[3] = { 0.0, 0.0, 0.0 }; // L*R, L*L, R*R
+double   gCorrelationDecay   = 0.0; // per frame
+uint32_t gScopeDecimation    = 1;
+uint32_t gScopeOffset        = 0;
+
+// one period of decimated samples, before going into the ring
+float gScopeLeft[MAX_SCOPE_POINTS];
+float gScopeRight[MAX_SCOPE_POINTS];
+
+// Must be called before activation.
+void setup_phase(const uint32_t sampleRate)
+{
+    gStereoSumsFunc  = simd_get_stereo_sums_func();
+    gScopeDecimation = (sampleRate > 24000) ? sampleRate / 24000 : 1;
+
+    // 300ms integration time, as usual for correlation meters
+    gCorrelationDecay = std::exp(-1.0 / (0.3 * sampleRate));
+
+    x_scopeRing.setup(2, 8192);
+
+    // touch the pages now rather than in the process thread
+    std::memset(gScopeLeft,  0, sizeof(gScopeLeft));
+    std::memset(gScopeRight, 0, sizeof(gScopeRight));
+}
+
+void process_phase(const float* const left, const float* const right, const uint32_t nframes)
+{
+    float sums[3];
+    gStereoSumsFunc(left, right, nframes, sums);
+
+    const double decay = std::pow(gCorrelationDecay, double(nframes));
+
+    for (int i=0; i < 3; ++i)
+        gCorrelationSums[i] = gCorrelationSums[i] * decay + sums[i];
+
+    const double energy = gCorrelationSums[1] * gCorrelationSums[2];
+
+    x_correlation.store((energy > 1e-18) ? float(gCorrelationSums[0] / std::sqrt(energy)) : 0.0f, std::memory_order_relaxed);
+
+    // keep every 'gScopeDecimation'th sample, continuing across periods
+    uint32_t count = 0;
+    uint32_t i = gScopeOffset;
+
+    for (; i < nframes && count < MAX_SCOPE_POINTS; i += gScopeDecimation, ++count)
+    {
+        gScopeLeft[count]  = left[i];
+        gScopeRight[count] = right[i];
+    }
+
+    gScopeOffset = (i > nframes) ? i - nframes : 0;
+
+    const float* const scope[2] = { gScopeLeft, gScopeRight };
+    x_scopeRing.write(scope, count);
+}
+
+// -------------------------------
+// JACK callbacks
+
+int process_callback(const jack_nframes_t nframes, void*)
+{
+    if (x_loudness || x_spectrum)
+    {
+        const float* buffers[MAX_CHANNELS];
+
+        for (uint32_t i=0; i < gChannels; ++i)
+            buffers[i] = (float*)jackbridge_port_get_buffer(jPorts[i], nframes);
+
+        // all the heavy work happens in the analysis thread
+        x_audioRing.write(buffers, nframes);
+        return 0;
+    }
+
+    float peaks[MAX_CHANNELS];
+    float squares[MAX_CHANNELS];
+    float levels[MAX_CHANNELS];
+
+    for (uint32_t i=0; i < gChannels; ++i)
+    {
+        const float* const jOut = (float*)jackbridge_port_get_buffer(jPorts[i], nframes);
+
+        // RMS is only reported in headless mode
+        if (x_headless)
+            peaks[i] = gAbsMaxSumSqFunc(jOut, nframes, &squares[i]);
+        else if (! x_truePeak)
+            peaks[i] = gAbsMaxFunc(jOut, nframes);
+
+        if (x_truePeak)
+            peaks[i] = gTruePeakDetectors[i].process(jOut, nframes);
+
+        if (gMeterBallistics != nullptr)
+            levels[i] = gMeterBallistics[i].process(jOut, nframes);
+    }
+
+    if (x_phase)
+    {
+        const float* const left  = (float*)jackbridge_port_get_buffer(jPorts[0], nframes);
+        const float* const right = (float*)jackbridge_port_get_buffer(jPorts[gChannels > 1 ? 1 : 0], nframes);
+
+        process_phase(left, right, nframes);
+    }
+
+    // hand over this period's peaks (or meter readings), the GUI folds them together
+    x_peaks.put((gMeterBallistics != nullptr) ? levels : peaks, x_headless ? squares : nullptr, nframes);
+
+    // and the peaks to any other process reading the level bus
+    gLevelBus.publish(peaks, nframes);
+
+    return 0;
+}
+
+int xrun_callback(void*)
+{
+    ++x_xruns;
+    return 0;
+}
+
+#endif // __METERPROCESS_HPP__
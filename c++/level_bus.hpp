@@ -0,0 +1,395 @@
+/*
+ * Shared-memory level bus, publishes meter levels to other processes
+ * Copyright (C) 2012-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __LEVEL_BUS_HPP__
+#define __LEVEL_BUS_HPP__
+
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+# define LEVEL_BUS_SUPPORTED
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+// One writer (the JACK process thread of a meter) publishes the peaks of every period
+// into a POSIX shared-memory object; any number of readers map it read-only.
+//
+// Memory layout, all fields in host byte order:
+//
+//   LevelBusHeader                      (fixed size, see below)
+//   LevelBusSlot[LEVEL_BUS_SLOTS]       each followed by 'channels' floats of peaks
+//
+// 'writeCount' is the number of periods published so far, the newest one lives in
+// slot (writeCount-1) % LEVEL_BUS_SLOTS. Every slot is a seqlock: its 'sequence' is odd
+// while the writer is filling it, so a reader copies the slot and accepts the copy only
+// if 'sequence' was even and unchanged around it. The writer never waits for readers.
+
+#define LEVEL_BUS_MAGIC        "CADLVL1"
+#define LEVEL_BUS_VERSION      1
+#define LEVEL_BUS_SLOTS        64
+#define LEVEL_BUS_MAX_CHANNELS 128
+#define LEVEL_BUS_NAME_SIZE    64
+#define LEVEL_BUS_DEFAULT_NAME "/cadence-levels"
+
+struct LevelBusHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t channels;
+    uint32_t sampleRate;
+    uint32_t slotCount;
+    uint32_t slotSize;   // in bytes, including the peaks
+    uint32_t padding;
+    uint64_t writeCount;
+    char     portNames[LEVEL_BUS_MAX_CHANNELS][LEVEL_BUS_NAME_SIZE];
+};
+
+struct LevelBusSlot {
+    uint32_t sequence;
+    uint32_t frames;     // period size the peaks were taken over
+    uint64_t index;      // value of 'writeCount' once this slot was published
+};
+
+// -------------------------------
+
+static inline
+uint32_t level_bus_slot_size(const uint32_t channels)
+{
+    return sizeof(LevelBusSlot) + ((sizeof(float)*channels + 7) & ~7U);
+}
+
+static inline
+uint32_t level_bus_total_size(const uint32_t channels)
+{
+    return sizeof(LevelBusHeader) + LEVEL_BUS_SLOTS * level_bus_slot_size(channels);
+}
+
+// -------------------------------
+
+class LevelBusWriter
+{
+public:
+    LevelBusWriter()
+        : fData(nullptr),
+          fSize(0),
+          fSlotSize(0),
+          fChannels(0)
+    {
+        fName[0] = '\0';
+    }
+
+    ~LevelBusWriter()
+    {
+        close();
+    }
+
+    // Not realtime safe. Creates the shared memory object 'name', which must not exist yet,
+    // so two writers never share (and resize) one bus; errno is EEXIST if it does.
+    // 'portNames' holds one name per channel, as shown to readers.
+    bool open(const char* const name, const uint32_t channels, const uint32_t sampleRate, const char* const* const portNames)
+    {
+        close();
+
+        if (channels == 0 || channels > LEVEL_BUS_MAX_CHANNELS || std::strlen(name) >= sizeof(fName))
+            return false;
+
+#ifdef LEVEL_BUS_SUPPORTED
+        const int fd = ::shm_open(name, O_CREAT|O_EXCL|O_RDWR, 0644);
+
+        if (fd < 0)
+            return false;
+
+        const uint32_t size = level_bus_total_size(channels);
+
+        if (::ftruncate(fd, size) != 0)
+        {
+            ::close(fd);
+            ::shm_unlink(name);
+            return false;
+        }
+
+        void* const data = ::mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (data == MAP_FAILED)
+        {
+            ::shm_unlink(name);
+            return false;
+        }
+
+        // the process thread writes here, keep it out of swap (best effort)
+        ::mlock(data, size);
+        ::memset(data, 0, size);
+
+        fData     = (char*)data;
+        fSize     = size;
+        fSlotSize = level_bus_slot_size(channels);
+        fChannels = channels;
+        std::strcpy(fName, name);
+
+        LevelBusHeader* const header = getHeader();
+        header->version    = LEVEL_BUS_VERSION;
+        header->channels   = channels;
+        header->sampleRate = sampleRate;
+        header->slotCount  = LEVEL_BUS_SLOTS;
+        header->slotSize   = fSlotSize;
+
+        for (uint32_t i=0; i < channels; ++i)
+            std::strncpy(header->portNames[i], portNames[i], LEVEL_BUS_NAME_SIZE-1);
+
+        // readers check the magic last
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        std::memcpy(header->magic, LEVEL_BUS_MAGIC, sizeof(LEVEL_BUS_MAGIC));
+
+        return true;
+#else
+        (void)sampleRate;
+        (void)portNames;
+        return false;
+#endif
+    }
+
+    void close()
+    {
+        if (fData == nullptr)
+            return;
+
+#ifdef LEVEL_BUS_SUPPORTED
+        // open() created it, nobody else can be writing there
+        ::munmap(fData, fSize);
+        ::shm_unlink(fName);
+#endif
+
+        fData     = nullptr;
+        fSize     = 0;
+        fSlotSize = 0;
+        fChannels = 0;
+        fName[0]  = '\0';
+    }
+
+    bool isOpen() const
+    {
+        return (fData != nullptr);
+    }
+
+    // Writer side, realtime safe. 'peaks' holds one value per channel.
+    void publish(const float* const peaks, const uint32_t frames)
+    {
+        if (fData == nullptr)
+            return;
+
+        LevelBusHeader* const header = getHeader();
+
+        const uint64_t index = header->writeCount + 1;
+        LevelBusSlot* const slot = (LevelBusSlot*)(fData + sizeof(LevelBusHeader) + ((index-1) % LEVEL_BUS_SLOTS) * fSlotSize);
+
+        const uint32_t sequence = slot->sequence;
+
+        __atomic_store_n(&slot->sequence, sequence+1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        slot->frames = frames;
+        slot->index  = index;
+        std::memcpy(slot+1, peaks, sizeof(float)*fChannels);
+
+        __atomic_store_n(&slot->sequence, sequence+2, __ATOMIC_RELEASE);
+        __atomic_store_n(&header->writeCount, index, __ATOMIC_RELEASE);
+    }
+
+private:
+    LevelBusHeader* getHeader() const
+    {
+        return (LevelBusHeader*)fData;
+    }
+
+    char*    fData;
+    uint32_t fSize;
+    uint32_t fSlotSize;
+    uint32_t fChannels;
+    char     fName[256];
+};
+
+// -------------------------------
+
+class LevelBusReader
+{
+public:
+    LevelBusReader()
+        : fData(nullptr),
+          fSize(0) {}
+
+    ~LevelBusReader()
+    {
+        close();
+    }
+
+    // Maps an existing bus read-only, fails if there is none or its layout is unknown.
+    bool open(const char* const name = LEVEL_BUS_DEFAULT_NAME)
+    {
+        close();
+
+#ifdef LEVEL_BUS_SUPPORTED
+        const int fd = ::shm_open(name, O_RDONLY, 0);
+
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+
+        if (::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LevelBusHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* const data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (data == MAP_FAILED)
+            return false;
+
+        const LevelBusHeader* const header = (const LevelBusHeader*)data;
+
+        if (std::memcmp(header->magic, LEVEL_BUS_MAGIC, sizeof(LEVEL_BUS_MAGIC)) != 0 ||
+            header->version != LEVEL_BUS_VERSION ||
+            header->channels == 0 || header->channels > LEVEL_BUS_MAX_CHANNELS ||
+            header->slotSize != level_bus_slot_size(header->channels) ||
+            (uint32_t)st.st_size < level_bus_total_size(header->channels))
+        {
+            ::munmap(data, st.st_size);
+            return false;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        fData = (const char*)data;
+        fSize = st.st_size;
+        return true;
+#else
+        (void)name;
+        return false;
+#endif
+    }
+
+    void close()
+    {
+        if (fData == nullptr)
+            return;
+
+#ifdef LEVEL_BUS_SUPPORTED
+        ::munmap((void*)fData, fSize);
+#endif
+
+        fData = nullptr;
+        fSize = 0;
+    }
+
+    bool isOpen() const
+    {
+        return (fData != nullptr);
+    }
+
+    uint32_t getChannels() const
+    {
+        return (fData != nullptr) ? getHeader()->channels : 0;
+    }
+
+    uint32_t getSampleRate() const
+    {
+        return (fData != nullptr) ? getHeader()->sampleRate : 0;
+    }
+
+    const char* getPortName(const uint32_t channel) const
+    {
+        return (channel < getChannels()) ? getHeader()->portNames[channel] : "";
+    }
+
+    // Copies the newest published peaks into 'peaks' (getChannels() values).
+    // Returns the period index of that copy, or 0 if nothing was published yet.
+    uint64_t readLatest(float* const peaks) const
+    {
+        if (fData == nullptr)
+            return 0;
+
+        const uint64_t writeCount = __atomic_load_n(&getHeader()->writeCount, __ATOMIC_ACQUIRE);
+
+        if (writeCount == 0)
+            return 0;
+
+        return readSlot(writeCount, peaks) ? writeCount : readLatestRetry(peaks);
+    }
+
+    // Copies the peaks of period 'index' if still in the ring, for readers that want every period.
+    bool read(const uint64_t index, float* const peaks) const
+    {
+        if (fData == nullptr || index == 0)
+            return false;
+
+        return readSlot(index, peaks);
+    }
+
+    uint64_t getWriteCount() const
+    {
+        return (fData != nullptr) ? __atomic_load_n(&getHeader()->writeCount, __ATOMIC_ACQUIRE) : 0;
+    }
+
+private:
+    const LevelBusHeader* getHeader() const
+    {
+        return (const LevelBusHeader*)fData;
+    }
+
+    bool readSlot(const uint64_t index, float* const peaks) const
+    {
+        const LevelBusHeader* const header = getHeader();
+        const LevelBusSlot* const slot = (const LevelBusSlot*)(fData + sizeof(LevelBusHeader) + ((index-1) % LEVEL_BUS_SLOTS) * header->slotSize);
+
+        const uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (before & 1)
+            return false;
+
+        std::memcpy(peaks, slot+1, sizeof(float)*header->channels);
+        const uint64_t slotIndex = slot->index;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        return (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before && slotIndex == index);
+    }
+
+    // the writer lapped us while copying, try again on whatever is newest now
+    uint64_t readLatestRetry(float* const peaks) const
+    {
+        for (int i=0; i < 4; ++i)
+        {
+            const uint64_t writeCount = __atomic_load_n(&getHeader()->writeCount, __ATOMIC_ACQUIRE);
+
+            if (readSlot(writeCount, peaks))
+                return writeCount;
+        }
+
+        return 0;
+    }
+
+    const char* fData;
+    uint32_t    fSize;
+};
+
+#endif // __LEVEL_BUS_HPP__
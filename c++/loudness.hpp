@@ -0,0 +1,338 @@
+/*
+ * EBU R128 / ITU-R BS.1770 loudness measurement
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __LOUDNESS_HPP__
+#define __LOUDNESS_HPP__
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+// Not realtime safe by design, this is fed from a worker thread.
+// All channels are weighted 1.0, as for mono and stereo programmes.
+//
+// The signal is K-weighted and squared, then summed into 100ms sub-blocks.
+// Momentary (400ms) and short-term (3s) loudness come from running sums over
+// the last 4 and 30 sub-blocks. Integrated loudness gates the 400ms blocks
+// (75% overlap) through a 0.1 LU histogram, so memory stays constant.
+
+#define LOUDNESS_MIN_LUFS -120.0f
+
+class LoudnessMeter
+{
+public:
+    LoudnessMeter()
+        : fChannels(0),
+          fFilters(nullptr),
+          fSubBlockSize(0),
+          fSubBlockFrames(0),
+          fSubBlockEnergy(0.0),
+          fSubBlockCount(0),
+          fMomentarySum(0.0),
+          fShortTermSum(0.0),
+          fMomentary(LOUDNESS_MIN_LUFS),
+          fShortTerm(LOUDNESS_MIN_LUFS),
+          fIntegrated(LOUDNESS_MIN_LUFS)
+    {
+        ::memset(fSubBlocks, 0, sizeof(fSubBlocks));
+        reset();
+    }
+
+    ~LoudnessMeter()
+    {
+        if (fFilters != nullptr)
+            delete[] fFilters;
+    }
+
+    void setup(const uint32_t channels, const uint32_t sampleRate)
+    {
+        if (fFilters != nullptr)
+            delete[] fFilters;
+
+        fChannels     = channels;
+        fFilters      = (channels > 0) ? new KWeighting[channels] : nullptr;
+        fSubBlockSize = sampleRate / 10;
+
+        for (uint32_t i=0; i < channels; ++i)
+            fFilters[i].setup(sampleRate);
+
+        reset();
+    }
+
+    void reset()
+    {
+        for (uint32_t i=0; i < fChannels; ++i)
+            fFilters[i].reset();
+
+        ::memset(fSubBlocks, 0, sizeof(fSubBlocks));
+        ::memset(fHistogramCount, 0, sizeof(fHistogramCount));
+        ::memset(fHistogramEnergy, 0, sizeof(fHistogramEnergy));
+
+        fSubBlockFrames = 0;
+        fSubBlockEnergy = 0.0;
+        fSubBlockCount  = 0;
+        fMomentarySum   = 0.0;
+        fShortTermSum   = 0.0;
+
+        fMomentary  = LOUDNESS_MIN_LUFS;
+        fShortTerm  = LOUDNESS_MIN_LUFS;
+        fIntegrated = LOUDNESS_MIN_LUFS;
+    }
+
+    // 'buffers' holds one pointer per channel, as given by AudioRing::read().
+    void process(const float* const* const buffers, const uint32_t frames)
+    {
+        for (uint32_t offset=0; offset < frames;)
+        {
+            uint32_t chunk = fSubBlockSize - fSubBlockFrames;
+
+            if (chunk > frames - offset)
+                chunk = frames - offset;
+
+            for (uint32_t i=0; i < fChannels; ++i)
+                fSubBlockEnergy += fFilters[i].process(buffers[i]+offset, chunk);
+
+            offset += chunk;
+            fSubBlockFrames += chunk;
+
+            if (fSubBlockFrames == fSubBlockSize)
+                finishSubBlock();
+        }
+    }
+
+    // These can be read from any thread.
+    float getMomentary() const
+    {
+        return fMomentary.load(std::memory_order_relaxed);
+    }
+
+    float getShortTerm() const
+    {
+        return fShortTerm.load(std::memory_order_relaxed);
+    }
+
+    float getIntegrated() const
+    {
+        return fIntegrated.load(std::memory_order_relaxed);
+    }
+
+private:
+    // -------------------------------
+    // K-weighting, a high-shelf followed by a high-pass, in double precision
+
+    struct KWeighting {
+        double b0, b1, b2, a1, a2; // shelf
+        double c1, c2;             // high-pass, numerator is 1, -2, 1
+        double s1, s2, t1, t2;
+
+        KWeighting()
+            : b0(1.0), b1(0.0), b2(0.0), a1(0.0), a2(0.0), c1(0.0), c2(0.0)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            s1 = s2 = t1 = t2 = 0.0;
+        }
+
+        void setup(const uint32_t sampleRate)
+        {
+            // stage 1, from BS.1770 with the coefficients re-derived for any sample rate
+            {
+                const double f0 = 1681.974450955533;
+                const double G  = 3.999843853973347;
+                const double Q  = 0.7071752369554196;
+
+                const double K  = std::tan(M_PI * f0 / sampleRate);
+                const double Vh = std::pow(10.0, G / 20.0);
+                const double Vb = std::pow(Vh, 0.4996667741545416);
+                const double a0 = 1.0 + K / Q + K * K;
+
+                b0 = (Vh + Vb * K / Q + K * K) / a0;
+                b1 = 2.0 * (K * K - Vh) / a0;
+                b2 = (Vh - Vb * K / Q + K * K) / a0;
+                a1 = 2.0 * (K * K - 1.0) / a0;
+                a2 = (1.0 - K / Q + K * K) / a0;
+            }
+
+            // stage 2
+            {
+                const double f0 = 38.13547087602444;
+                const double Q  = 0.5003270373238773;
+
+                const double K  = std::tan(M_PI * f0 / sampleRate);
+                const double a0 = 1.0 + K / Q + K * K;
+
+                c1 = 2.0 * (K * K - 1.0) / a0;
+                c2 = (1.0 - K / Q + K * K) / a0;
+            }
+        }
+
+        // Filters 'frames' samples and returns the sum of their squares.
+        double process(const float* const buf, const uint32_t frames)
+        {
+            double energy = 0.0;
+
+            for (uint32_t i=0; i < frames; ++i)
+            {
+                // transposed direct form II
+                const double x = buf[i];
+                const double y = b0 * x + s1;
+                s1 = b1 * x - a1 * y + s2;
+                s2 = b2 * x - a2 * y;
+
+                const double z = y + t1;
+                t1 = -2.0 * y - c1 * z + t2;
+                t2 = y - c2 * z;
+
+                energy += z * z;
+            }
+
+            return energy;
+        }
+    };
+
+    // -------------------------------
+
+    static float energyToLUFS(const double meanSquare)
+    {
+        if (meanSquare <= 1e-12)
+            return LOUDNESS_MIN_LUFS;
+
+        return -0.691f + 10.0f * float(std::log10(meanSquare));
+    }
+
+    void finishSubBlock()
+    {
+        const uint32_t index = fSubBlockCount % SHORT_TERM_BLOCKS;
+
+        // running sums, O(1) per sub-block
+        fMomentarySum += fSubBlockEnergy - fSubBlocks[(fSubBlockCount + SHORT_TERM_BLOCKS - MOMENTARY_BLOCKS) % SHORT_TERM_BLOCKS];
+        fShortTermSum += fSubBlockEnergy - fSubBlocks[index];
+        fSubBlocks[index] = fSubBlockEnergy;
+
+        ++fSubBlockCount;
+        fSubBlockFrames = 0;
+        fSubBlockEnergy = 0.0;
+
+        // re-sum once per window to keep rounding errors from building up
+        if (index == SHORT_TERM_BLOCKS-1)
+        {
+            fMomentarySum = fShortTermSum = 0.0;
+
+            for (uint32_t i=0; i < SHORT_TERM_BLOCKS; ++i)
+            {
+                fShortTermSum += fSubBlocks[i];
+
+                if ((fSubBlockCount + SHORT_TERM_BLOCKS - 1 - i) % SHORT_TERM_BLOCKS < MOMENTARY_BLOCKS)
+                    fMomentarySum += fSubBlocks[i];
+            }
+        }
+
+        const double momentaryMS = fMomentarySum / (MOMENTARY_BLOCKS * fSubBlockSize);
+        const double shortTermMS = fShortTermSum / (SHORT_TERM_BLOCKS * fSubBlockSize);
+
+        const float momentary = energyToLUFS(momentaryMS);
+        fMomentary = momentary;
+        fShortTerm = energyToLUFS(shortTermMS);
+
+        // every sub-block completes a new 400ms gating block
+        if (fSubBlockCount >= MOMENTARY_BLOCKS && momentary > ABSOLUTE_GATE)
+        {
+            int bin = int((momentary - ABSOLUTE_GATE) * HISTOGRAM_STEPS_PER_LU);
+
+            if (bin >= HISTOGRAM_SIZE)
+                bin = HISTOGRAM_SIZE-1;
+
+            ++fHistogramCount[bin];
+            fHistogramEnergy[bin] += momentaryMS;
+
+            updateIntegrated();
+        }
+    }
+
+    void updateIntegrated()
+    {
+        uint64_t count  = 0;
+        double   energy = 0.0;
+
+        for (int i=0; i < HISTOGRAM_SIZE; ++i)
+        {
+            count  += fHistogramCount[i];
+            energy += fHistogramEnergy[i];
+        }
+
+        if (count == 0)
+            return;
+
+        const float relativeGate = energyToLUFS(energy / count) - 10.0f;
+
+        int firstBin = 0;
+
+        if (relativeGate > ABSOLUTE_GATE)
+        {
+            firstBin = int((relativeGate - ABSOLUTE_GATE) * HISTOGRAM_STEPS_PER_LU);
+
+            if (firstBin >= HISTOGRAM_SIZE)
+                firstBin = HISTOGRAM_SIZE-1;
+        }
+
+        count  = 0;
+        energy = 0.0;
+
+        for (int i=firstBin; i < HISTOGRAM_SIZE; ++i)
+        {
+            count  += fHistogramCount[i];
+            energy += fHistogramEnergy[i];
+        }
+
+        if (count > 0)
+            fIntegrated = energyToLUFS(energy / count);
+    }
+
+    // -------------------------------
+
+    static const uint32_t MOMENTARY_BLOCKS  = 4;
+    static const uint32_t SHORT_TERM_BLOCKS = 30;
+
+    static constexpr float ABSOLUTE_GATE = -70.0f;
+    static const int HISTOGRAM_STEPS_PER_LU = 10;
+    static const int HISTOGRAM_SIZE = 80 * HISTOGRAM_STEPS_PER_LU; // -70 to +10 LUFS
+
+    uint32_t    fChannels;
+    KWeighting* fFilters;
+
+    uint32_t fSubBlockSize;
+    uint32_t fSubBlockFrames;
+    double   fSubBlockEnergy;
+    uint64_t fSubBlockCount;
+    double   fSubBlocks[SHORT_TERM_BLOCKS];
+
+    double fMomentarySum;
+    double fShortTermSum;
+
+    uint64_t fHistogramCount[HISTOGRAM_SIZE];
+    double   fHistogramEnergy[HISTOGRAM_SIZE];
+
+    std::atomic<float> fMomentary;
+    std::atomic<float> fShortTerm;
+    std::atomic<float> fIntegrated;
+};
+
+#endif // __LOUDNESS_HPP__
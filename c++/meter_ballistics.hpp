@@ -0,0 +1,145 @@
+/*
+ * PPM and VU meter ballistics, run on every sample
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __METER_BALLISTICS_HPP__
+#define __METER_BALLISTICS_HPP__
+
+#include <cmath>
+#include <stdint.h>
+
+// The integration times of these meters are a few ms, far below a GUI refresh, so they
+// have to see the signal itself; the GUI then only draws the result (and the peak hold).
+//
+// PPM, IEC 60268-10 type I: quasi-peak rectifier, charging while the signal is above it.
+//   The 1.27 ms attack makes a 5 kHz tone burst of 5 ms read 2 dB low (10 ms: -0.8 dB,
+//   3 ms: -3.5 dB); it falls 20 dB in 1.5 s. The reading is the highest value of a period.
+// VU, IEC 60268-17: full-wave rectified average through two 45.2 ms one-pole stages, which
+//   reach 99% of a step in 300 ms, both ways, without overshoot. Scaled so a sine reads
+//   its RMS level. The reading is the value at the end of a period.
+
+enum MeterBallisticsMode {
+    METER_BALLISTICS_NONE = 0,
+    METER_BALLISTICS_PPM  = 1,
+    METER_BALLISTICS_VU   = 2
+};
+
+class MeterBallistics
+{
+public:
+    MeterBallistics()
+        : fMode(METER_BALLISTICS_NONE),
+          fAttack(1.0f),
+          fRelease(0.0f),
+          fScale(1.0f)
+    {
+        reset();
+    }
+
+    // Not realtime safe, call before processing starts.
+    void init(const MeterBallisticsMode mode, const uint32_t sampleRate)
+    {
+        fMode = mode;
+
+        switch (mode)
+        {
+        case METER_BALLISTICS_PPM:
+            fAttack  = 1.0f - std::exp(-1.0f / (0.00127f * sampleRate));
+            fRelease = std::pow(10.0f, -1.0f / (1.5f * sampleRate));
+            fScale   = 1.0f;
+            break;
+        case METER_BALLISTICS_VU:
+            fAttack  = 1.0f - std::exp(-1.0f / (0.0452f * sampleRate));
+            fRelease = 0.0f;
+            fScale   = float(M_PI / (2.0 * M_SQRT2));
+            break;
+        default:
+            fAttack  = 1.0f;
+            fRelease = 0.0f;
+            fScale   = 1.0f;
+            break;
+        }
+
+        reset();
+    }
+
+    void reset()
+    {
+        fState[0] = fState[1] = 0.0f;
+    }
+
+    // Returns the meter reading for this period, as a linear amplitude.
+    float process(const float* const buf, const uint32_t frames)
+    {
+        if (fMode == METER_BALLISTICS_PPM)
+        {
+            float level = fState[0];
+            float max   = 0.0f;
+
+            for (uint32_t i=0; i < frames; ++i)
+            {
+                const float value = std::fabs(buf[i]);
+
+                if (value > level)
+                    level += (value - level) * fAttack;
+                else
+                    level *= fRelease;
+
+                if (level > max)
+                    max = level;
+            }
+
+            // keep denormals out of the feedback path
+            fState[0] = (level > 1e-12f) ? level : 0.0f;
+            return max;
+        }
+
+        if (fMode == METER_BALLISTICS_VU)
+        {
+            float stage1 = fState[0];
+            float stage2 = fState[1];
+
+            for (uint32_t i=0; i < frames; ++i)
+            {
+                stage1 += (std::fabs(buf[i]) * fScale - stage1) * fAttack;
+                stage2 += (stage1 - stage2) * fAttack;
+            }
+
+            fState[0] = (stage1 > 1e-12f) ? stage1 : 0.0f;
+            fState[1] = (stage2 > 1e-12f) ? stage2 : 0.0f;
+            return stage2;
+        }
+
+        float max = 0.0f;
+
+        for (uint32_t i=0; i < frames; ++i)
+        {
+            const float value = std::fabs(buf[i]);
+
+            if (value > max)
+                max = value;
+        }
+
+        return max;
+    }
+
+private:
+    MeterBallisticsMode fMode;
+    float fAttack, fRelease, fScale;
+    float fState[2];
+};
+
+#endif // __METER_BALLISTICS_HPP__
@@ -1,6 +1,6 @@
 /*
  * Simple Queue, specially developed for MIDI messages
- * Copyright (C) 2012 Filipe Coelho <falktx@falktx.com>
+ * Copyright (C) 2012-2015 Filipe Coelho <falktx@falktx.com>
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -18,142 +18,168 @@
 #ifndef MIDI_QUEUE_HPP
 #define MIDI_QUEUE_HPP
 
+#include <atomic>
 #include <cstring>
-#include <QtCore/QMutex>
+#include <stdint.h>
+
+// Wait-free single-producer/single-consumer queue of timestamped MIDI events.
+//
+// One thread only calls put(), another one only calls peek(), getData() and pop();
+// neither ever blocks, so either side can be the JACK process thread.
+// When the queue is full, put() drops the event and counts it as an overflow.
+//
+// Events of any length are kept as-is. Short ones are stored inline, longer ones
+// (SysEx) in a data arena that is released in the same order as the events.
+
+// events up to this size are stored inline
+#define MIDI_EVENT_INLINE_SIZE 4
+
+struct MidiEvent {
+    uint32_t time;     // JACK frame time
+    uint32_t size;
+    uint32_t arenaPos; // only used when size > MIDI_EVENT_INLINE_SIZE
+    unsigned char data[MIDI_EVENT_INLINE_SIZE];
+};
 
-class Queue
+class MidiQueue
 {
 public:
-    Queue()
+    MidiQueue()
+        : fArenaWritePos(0),
+          fWritePos(0),
+          fReadPos(0),
+          fArenaReadPos(0),
+          fOverflows(0) {}
+
+    bool isEmpty() const
     {
-        index = 0;
-        empty = true;
-        full  = false;
+        return fReadPos.load(std::memory_order_acquire) == fWritePos.load(std::memory_order_acquire);
     }
 
-    void copyDataFrom(Queue* queue)
+    // events dropped since start because the queue was full
+    uint32_t getOverflowCount() const
     {
-        // lock mutexes
-        queue->mutex.lock();
-        mutex.lock();
-
-        // copy data from queue
-        ::memcpy(data, queue->data, sizeof(datatype)*MAX_SIZE);
-        index = queue->index;
-        empty = queue->empty;
-        full  = queue->full;
-
-        // unlock our mutex, no longer needed
-        mutex.unlock();
-
-        // reset queque
-        ::memset(queue->data, 0, sizeof(datatype)*MAX_SIZE);
-        queue->index = 0;
-        queue->empty = true;
-        queue->full  = false;
-
-        // unlock queque mutex
-        queue->mutex.unlock();
+        return fOverflows.load(std::memory_order_relaxed);
     }
 
-    bool isEmpty()
+    // producer side, copies 'size' bytes from 'data'
+    bool put(const uint32_t time, const unsigned char* const data, const uint32_t size)
     {
-        return empty;
-    }
+        if (size == 0)
+            return false;
 
-    bool isFull()
-    {
-        return full;
-    }
+        const uint32_t writePos = fWritePos.load(std::memory_order_relaxed);
 
-    void lock()
-    {
-        mutex.lock();
-    }
-
-    void unlock()
-    {
-        mutex.unlock();
-    }
+        if (size > ARENA_SIZE || writePos - fReadPos.load(std::memory_order_acquire) >= MAX_SIZE)
+        {
+            fOverflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
 
-    void put(unsigned char d1, unsigned char d2, unsigned char d3, bool lock = true)
-    {
-        Q_ASSERT(d1 != 0);
+        MidiEvent& event(fEvents[writePos & (MAX_SIZE-1)]);
 
-        if (full || d1 == 0)
-            return;
+        if (size <= MIDI_EVENT_INLINE_SIZE)
+        {
+            std::memcpy(event.data, data, size);
+        }
+        else
+        {
+            uint32_t arenaPos = fArenaWritePos;
 
-        if (lock)
-            mutex.lock();
+            // data is never split, skip the end of the arena if it does not fit there
+            if ((arenaPos & (ARENA_SIZE-1)) + size > ARENA_SIZE)
+                arenaPos += ARENA_SIZE - (arenaPos & (ARENA_SIZE-1));
 
-        for (unsigned short i=0; i < MAX_SIZE; i++)
-        {
-            if (data[i].d1 == 0)
+            if (arenaPos + size - fArenaReadPos.load(std::memory_order_acquire) > ARENA_SIZE)
             {
-                data[i].d1 = d1;
-                data[i].d2 = d2;
-                data[i].d3 = d3;
-                empty = false;
-                full  = (i == MAX_SIZE-1);
-                break;
+                fOverflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
             }
+
+            std::memcpy(fArena + (arenaPos & (ARENA_SIZE-1)), data, size);
+
+            event.arenaPos = arenaPos;
+            fArenaWritePos = arenaPos + size;
         }
 
-        if (lock)
-            mutex.unlock();
+        event.time = time;
+        event.size = size;
+
+        fWritePos.store(writePos + 1, std::memory_order_release);
+        return true;
     }
 
-    bool get(unsigned char* d1, unsigned char* d2, unsigned char* d3, bool lock = true)
+    // consumer side, returns up to 'maxCount' of the oldest events without removing them.
+    // They stay valid until pop() is called.
+    uint32_t peek(const MidiEvent** const events, const uint32_t maxCount) const
     {
-        Q_ASSERT(d1 && d2 && d3);
+        const uint32_t readPos = fReadPos.load(std::memory_order_relaxed);
+        uint32_t count = fWritePos.load(std::memory_order_acquire) - readPos;
 
-        if (empty || ! (d1 && d2 && d3))
-            return false;
+        if (count > maxCount)
+            count = maxCount;
 
-        if (lock)
-            mutex.lock();
+        for (uint32_t i=0; i < count; ++i)
+            events[i] = &fEvents[(readPos + i) & (MAX_SIZE-1)];
 
-        full = false;
+        return count;
+    }
 
-        if (data[index].d1 == 0)
-        {
-            index = 0;
-            empty = true;
+    // consumer side, oldest event or null if empty
+    const MidiEvent* peek() const
+    {
+        const MidiEvent* event;
+        return (peek(&event, 1) == 1) ? event : nullptr;
+    }
 
-            if (lock)
-                mutex.unlock();
+    // consumer side
+    const unsigned char* getData(const MidiEvent& event) const
+    {
+        if (event.size <= MIDI_EVENT_INLINE_SIZE)
+            return event.data;
 
-            return false;
-        }
+        return fArena + (event.arenaPos & (ARENA_SIZE-1));
+    }
 
-        *d1 = data[index].d1;
-        *d2 = data[index].d2;
-        *d3 = data[index].d3;
+    // consumer side, removes the 'count' oldest events
+    void pop(uint32_t count = 1)
+    {
+        const uint32_t readPos  = fReadPos.load(std::memory_order_relaxed);
+        const uint32_t readable = fWritePos.load(std::memory_order_acquire) - readPos;
 
-        data[index].d1 = data[index].d2 = data[index].d3 = 0;
-        index++;
-        empty = false;
+        if (count > readable)
+            count = readable;
 
-        if (lock)
-            mutex.unlock();
+        // arena data is released up to the newest removed event that used it
+        for (uint32_t i=count; i > 0; --i)
+        {
+            const MidiEvent& event(fEvents[(readPos + i - 1) & (MAX_SIZE-1)]);
 
-        return true;
+            if (event.size > MIDI_EVENT_INLINE_SIZE)
+            {
+                fArenaReadPos.store(event.arenaPos + event.size, std::memory_order_release);
+                break;
+            }
+        }
+
+        fReadPos.store(readPos + count, std::memory_order_release);
     }
 
-private:
-    struct datatype {
-        unsigned char d1, d2, d3;
+    static const uint32_t MAX_SIZE   = 512;   // must be a power of 2
+    static const uint32_t ARENA_SIZE = 32768; // must be a power of 2
 
-        datatype()
-            : d1(0), d2(0), d3(0) {}
-    };
+private:
+    MidiEvent fEvents[MAX_SIZE];
+    unsigned char fArena[ARENA_SIZE];
 
-    static const unsigned short MAX_SIZE = 512;
-    datatype data[MAX_SIZE];
-    unsigned short index;
-    bool empty, full;
+    // producer only
+    uint32_t fArenaWritePos;
 
-    QMutex mutex;
+    // free-running positions, only wrapped when indexing
+    std::atomic<uint32_t> fWritePos;
+    std::atomic<uint32_t> fReadPos;
+    std::atomic<uint32_t> fArenaReadPos;
+    std::atomic<uint32_t> fOverflows;
 };
 
 #endif // MIDI_QUEUE_HPP
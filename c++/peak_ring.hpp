@@ -0,0 +1,228 @@
+/*
+ * Lossless, wait-free peak handoff between a realtime and a GUI thread
+ * Copyright (C) 2012-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __PEAK_RING_HPP__
+#define __PEAK_RING_HPP__
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+
+// Single-producer/single-consumer ring of per-period peaks.
+//
+// The writer (JACK process thread) calls put() once per period with one peak per channel.
+// If the ring is full because the reader is late, the period is folded (max per channel)
+// into a writer-local pending slot that is published as soon as there is room again,
+// so no peak is ever dropped and the writer never waits.
+//
+// The reader (GUI thread) calls get(), which folds every published slot into one value
+// per channel and returns how many periods those values cover.
+//
+// Optionally, the writer can pass the sum of squared samples of each channel too;
+// these are summed instead of folded, so the reader can compute RMS over any interval.
+
+class PeakRing
+{
+public:
+    PeakRing()
+        : fChannels(0),
+          fPeaks(nullptr),
+          fCounts(nullptr),
+          fSquares(nullptr),
+          fFrames(nullptr),
+          fPending(nullptr),
+          fPendingSquares(nullptr),
+          fPendingCount(0),
+          fPendingFrames(0),
+          fWritePos(0),
+          fReadPos(0) {}
+
+    ~PeakRing()
+    {
+        clear();
+    }
+
+    // Must not be called while the writer or reader are running.
+    void setChannels(const uint32_t channels)
+    {
+        clear();
+
+        if (channels == 0)
+            return;
+
+        fChannels = channels;
+        fPeaks    = new float[MAX_SIZE*channels];
+        fCounts   = new uint32_t[MAX_SIZE];
+        fSquares  = new double[MAX_SIZE*channels];
+        fFrames   = new uint32_t[MAX_SIZE];
+        fPending  = new float[channels];
+        fPendingSquares = new double[channels];
+
+        ::memset(fPeaks, 0, sizeof(float)*MAX_SIZE*channels);
+        ::memset(fCounts, 0, sizeof(uint32_t)*MAX_SIZE);
+        ::memset(fSquares, 0, sizeof(double)*MAX_SIZE*channels);
+        ::memset(fFrames, 0, sizeof(uint32_t)*MAX_SIZE);
+        ::memset(fPending, 0, sizeof(float)*channels);
+        ::memset(fPendingSquares, 0, sizeof(double)*channels);
+    }
+
+    uint32_t getChannels() const
+    {
+        return fChannels;
+    }
+
+    // Writer side, realtime safe. 'peaks' holds one value per channel,
+    // 'squares' (optional) the sum of squares of the 'frames' samples of each channel.
+    void put(const float* const peaks, const float* const squares = nullptr, const uint32_t frames = 0)
+    {
+        if (fChannels == 0)
+            return;
+
+        for (uint32_t i=0; i < fChannels; ++i)
+        {
+            if (peaks[i] > fPending[i])
+                fPending[i] = peaks[i];
+        }
+
+        if (squares != nullptr)
+        {
+            for (uint32_t i=0; i < fChannels; ++i)
+                fPendingSquares[i] += squares[i];
+
+            fPendingFrames += frames;
+        }
+
+        ++fPendingCount;
+
+        const uint32_t writePos = fWritePos.load(std::memory_order_relaxed);
+
+        // full, keep folding until the reader catches up
+        if (writePos - fReadPos.load(std::memory_order_acquire) >= MAX_SIZE)
+            return;
+
+        const uint32_t slot = writePos & (MAX_SIZE-1);
+
+        ::memcpy(fPeaks + slot*fChannels, fPending, sizeof(float)*fChannels);
+        ::memcpy(fSquares + slot*fChannels, fPendingSquares, sizeof(double)*fChannels);
+        fCounts[slot] = fPendingCount;
+        fFrames[slot] = fPendingFrames;
+
+        ::memset(fPending, 0, sizeof(float)*fChannels);
+        ::memset(fPendingSquares, 0, sizeof(double)*fChannels);
+        fPendingCount  = 0;
+        fPendingFrames = 0;
+
+        fWritePos.store(writePos+1, std::memory_order_release);
+    }
+
+    // Reader side. Writes the max of every period published since the last call into 'peaks',
+    // or zeros if there was none, and returns the number of periods folded together.
+    // If given, 'squares' and 'frames' receive the summed squares and frame count of those periods.
+    uint32_t get(float* const peaks, double* const squares = nullptr, uint32_t* const frames = nullptr)
+    {
+        if (fChannels == 0)
+            return 0;
+
+        ::memset(peaks, 0, sizeof(float)*fChannels);
+
+        if (squares != nullptr)
+            ::memset(squares, 0, sizeof(double)*fChannels);
+        if (frames != nullptr)
+            *frames = 0;
+
+        const uint32_t writePos = fWritePos.load(std::memory_order_acquire);
+        uint32_t readPos = fReadPos.load(std::memory_order_relaxed);
+        uint32_t periods = 0;
+
+        for (; readPos != writePos; ++readPos)
+        {
+            const uint32_t slot = readPos & (MAX_SIZE-1);
+            const float* const slotPeaks = fPeaks + slot*fChannels;
+
+            for (uint32_t i=0; i < fChannels; ++i)
+            {
+                if (slotPeaks[i] > peaks[i])
+                    peaks[i] = slotPeaks[i];
+            }
+
+            if (squares != nullptr)
+            {
+                const double* const slotSquares = fSquares + slot*fChannels;
+
+                for (uint32_t i=0; i < fChannels; ++i)
+                    squares[i] += slotSquares[i];
+            }
+
+            if (frames != nullptr)
+                *frames += fFrames[slot];
+
+            periods += fCounts[slot];
+        }
+
+        fReadPos.store(readPos, std::memory_order_release);
+
+        return periods;
+    }
+
+private:
+    void clear()
+    {
+        if (fPeaks != nullptr)
+            delete[] fPeaks;
+        if (fCounts != nullptr)
+            delete[] fCounts;
+        if (fSquares != nullptr)
+            delete[] fSquares;
+        if (fFrames != nullptr)
+            delete[] fFrames;
+        if (fPending != nullptr)
+            delete[] fPending;
+        if (fPendingSquares != nullptr)
+            delete[] fPendingSquares;
+
+        fChannels = 0;
+        fPeaks    = nullptr;
+        fCounts   = nullptr;
+        fSquares  = nullptr;
+        fFrames   = nullptr;
+        fPending  = nullptr;
+        fPendingSquares = nullptr;
+        fPendingCount   = 0;
+        fPendingFrames  = 0;
+        fWritePos = 0;
+        fReadPos  = 0;
+    }
+
+    static const uint32_t MAX_SIZE = 64; // must be a power of 2
+
+    uint32_t  fChannels;
+    float*    fPeaks;
+    uint32_t* fCounts;
+    double*   fSquares;
+    uint32_t* fFrames;
+
+    // owned by the writer
+    float*   fPending;
+    double*  fPendingSquares;
+    uint32_t fPendingCount;
+    uint32_t fPendingFrames;
+
+    std::atomic<uint32_t> fWritePos;
+    std::atomic<uint32_t> fReadPos;
+};
+
+#endif // __PEAK_RING_HPP__
@@ -0,0 +1,443 @@
+/*
+ * SIMD audio kernels with runtime CPU dispatch
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __SIMD_UTILS_HPP__
+#define __SIMD_UTILS_HPP__
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+// Each kernel is compiled for its own instruction set through per-function target
+// attributes, so the global build flags (-msse -mtune=generic) do not limit them.
+// The best variant the running CPU supports is picked once, on first use.
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# define SIMD_UTILS_X86
+# include <immintrin.h>
+#endif
+
+// -------------------------------
+// scalar fallback
+
+static inline
+float simd_abs_max_scalar(const float* const buf, const uint32_t frames)
+{
+    float peak = 0.0f;
+
+    for (uint32_t i=0; i < frames; ++i)
+    {
+        const float value = std::fabs(buf[i]);
+
+        if (value > peak)
+            peak = value;
+    }
+
+    return peak;
+}
+
+// Same as above, also stores the sum of the squared samples in 'squares'.
+static inline
+float simd_abs_max_sum_sq_scalar(const float* const buf, const uint32_t frames, float* const squares)
+{
+    float peak = 0.0f;
+    float sum  = 0.0f;
+
+    for (uint32_t i=0; i < frames; ++i)
+    {
+        const float value = std::fabs(buf[i]);
+
+        if (value > peak)
+            peak = value;
+
+        sum += buf[i] * buf[i];
+    }
+
+    *squares = sum;
+    return peak;
+}
+
+// Sums of L*R, L*L and R*R over a stereo pair, for phase correlation.
+static inline
+void simd_stereo_sums_scalar(const float* const left, const float* const right, const uint32_t frames, float* const sums)
+{
+    float lr = 0.0f, ll = 0.0f, rr = 0.0f;
+
+    for (uint32_t i=0; i < frames; ++i)
+    {
+        lr += left[i] * right[i];
+        ll += left[i] * left[i];
+        rr += right[i] * right[i];
+    }
+
+    sums[0] = lr;
+    sums[1] = ll;
+    sums[2] = rr;
+}
+
+#ifdef SIMD_UTILS_X86
+
+// -------------------------------
+// SSE2, 16 frames per iteration
+
+__attribute__((target("sse2")))
+static inline
+float simd_abs_max_sse2(const float* const buf, const uint32_t frames)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 max0 = _mm_setzero_ps();
+    __m128 max1 = _mm_setzero_ps();
+    __m128 max2 = _mm_setzero_ps();
+    __m128 max3 = _mm_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+16 <= frames; i += 16)
+    {
+        max0 = _mm_max_ps(max0, _mm_and_ps(mask, _mm_loadu_ps(buf+i)));
+        max1 = _mm_max_ps(max1, _mm_and_ps(mask, _mm_loadu_ps(buf+i+4)));
+        max2 = _mm_max_ps(max2, _mm_and_ps(mask, _mm_loadu_ps(buf+i+8)));
+        max3 = _mm_max_ps(max3, _mm_and_ps(mask, _mm_loadu_ps(buf+i+12)));
+    }
+
+    for (; i+4 <= frames; i += 4)
+        max0 = _mm_max_ps(max0, _mm_and_ps(mask, _mm_loadu_ps(buf+i)));
+
+    max0 = _mm_max_ps(_mm_max_ps(max0, max1), _mm_max_ps(max2, max3));
+    max0 = _mm_max_ps(max0, _mm_shuffle_ps(max0, max0, _MM_SHUFFLE(1, 0, 3, 2)));
+    max0 = _mm_max_ps(max0, _mm_shuffle_ps(max0, max0, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    const float peak = _mm_cvtss_f32(max0);
+    const float tail = simd_abs_max_scalar(buf+i, frames-i);
+
+    return (tail > peak) ? tail : peak;
+}
+
+// -------------------------------
+// AVX2, 32 frames per iteration
+
+__attribute__((target("avx2")))
+static inline
+float simd_abs_max_avx2(const float* const buf, const uint32_t frames)
+{
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 max0 = _mm256_setzero_ps();
+    __m256 max1 = _mm256_setzero_ps();
+    __m256 max2 = _mm256_setzero_ps();
+    __m256 max3 = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+32 <= frames; i += 32)
+    {
+        max0 = _mm256_max_ps(max0, _mm256_and_ps(mask, _mm256_loadu_ps(buf+i)));
+        max1 = _mm256_max_ps(max1, _mm256_and_ps(mask, _mm256_loadu_ps(buf+i+8)));
+        max2 = _mm256_max_ps(max2, _mm256_and_ps(mask, _mm256_loadu_ps(buf+i+16)));
+        max3 = _mm256_max_ps(max3, _mm256_and_ps(mask, _mm256_loadu_ps(buf+i+24)));
+    }
+
+    for (; i+8 <= frames; i += 8)
+        max0 = _mm256_max_ps(max0, _mm256_and_ps(mask, _mm256_loadu_ps(buf+i)));
+
+    max0 = _mm256_max_ps(_mm256_max_ps(max0, max1), _mm256_max_ps(max2, max3));
+
+    __m128 max = _mm_max_ps(_mm256_castps256_ps128(max0), _mm256_extractf128_ps(max0, 1));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(1, 0, 3, 2)));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    const float peak = _mm_cvtss_f32(max);
+    const float tail = simd_abs_max_scalar(buf+i, frames-i);
+
+    return (tail > peak) ? tail : peak;
+}
+
+// -------------------------------
+// AVX-512, 64 frames per iteration, masked tail
+
+// gcc 12 warns about _mm512_undefined_ps() inside its own intrinsic headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+static inline
+float simd_abs_max_avx512(const float* const buf, const uint32_t frames)
+{
+    __m512 max0 = _mm512_setzero_ps();
+    __m512 max1 = _mm512_setzero_ps();
+    __m512 max2 = _mm512_setzero_ps();
+    __m512 max3 = _mm512_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+64 <= frames; i += 64)
+    {
+        max0 = _mm512_max_ps(max0, _mm512_abs_ps(_mm512_loadu_ps(buf+i)));
+        max1 = _mm512_max_ps(max1, _mm512_abs_ps(_mm512_loadu_ps(buf+i+16)));
+        max2 = _mm512_max_ps(max2, _mm512_abs_ps(_mm512_loadu_ps(buf+i+32)));
+        max3 = _mm512_max_ps(max3, _mm512_abs_ps(_mm512_loadu_ps(buf+i+48)));
+    }
+
+    for (; i+16 <= frames; i += 16)
+        max0 = _mm512_max_ps(max0, _mm512_abs_ps(_mm512_loadu_ps(buf+i)));
+
+    if (i < frames)
+    {
+        const __mmask16 tailMask = static_cast<__mmask16>((1U << (frames-i)) - 1U);
+        max1 = _mm512_max_ps(max1, _mm512_abs_ps(_mm512_maskz_loadu_ps(tailMask, buf+i)));
+    }
+
+    max0 = _mm512_max_ps(_mm512_max_ps(max0, max1), _mm512_max_ps(max2, max3));
+
+    return _mm512_reduce_max_ps(max0);
+}
+
+#pragma GCC diagnostic pop
+
+// -------------------------------
+// peak and sum of squares in a single pass, for RMS
+
+__attribute__((target("sse2")))
+static inline
+float simd_abs_max_sum_sq_sse2(const float* const buf, const uint32_t frames, float* const squares)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 max0 = _mm_setzero_ps();
+    __m128 max1 = _mm_setzero_ps();
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+8 <= frames; i += 8)
+    {
+        const __m128 x0 = _mm_loadu_ps(buf+i);
+        const __m128 x1 = _mm_loadu_ps(buf+i+4);
+
+        max0 = _mm_max_ps(max0, _mm_and_ps(mask, x0));
+        max1 = _mm_max_ps(max1, _mm_and_ps(mask, x1));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(x0, x0));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(x1, x1));
+    }
+
+    max0 = _mm_max_ps(max0, max1);
+    max0 = _mm_max_ps(max0, _mm_shuffle_ps(max0, max0, _MM_SHUFFLE(1, 0, 3, 2)));
+    max0 = _mm_max_ps(max0, _mm_shuffle_ps(max0, max0, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_shuffle_ps(sum0, sum0, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum0 = _mm_add_ps(sum0, _mm_shuffle_ps(sum0, sum0, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    float tailSquares;
+    const float peak = _mm_cvtss_f32(max0);
+    const float tail = simd_abs_max_sum_sq_scalar(buf+i, frames-i, &tailSquares);
+
+    *squares = _mm_cvtss_f32(sum0) + tailSquares;
+    return (tail > peak) ? tail : peak;
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+float simd_abs_max_sum_sq_avx2(const float* const buf, const uint32_t frames, float* const squares)
+{
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 max0 = _mm256_setzero_ps();
+    __m256 max1 = _mm256_setzero_ps();
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+16 <= frames; i += 16)
+    {
+        const __m256 x0 = _mm256_loadu_ps(buf+i);
+        const __m256 x1 = _mm256_loadu_ps(buf+i+8);
+
+        max0 = _mm256_max_ps(max0, _mm256_and_ps(mask, x0));
+        max1 = _mm256_max_ps(max1, _mm256_and_ps(mask, x1));
+        sum0 = _mm256_fmadd_ps(x0, x0, sum0);
+        sum1 = _mm256_fmadd_ps(x1, x1, sum1);
+    }
+
+    max0 = _mm256_max_ps(max0, max1);
+    sum0 = _mm256_add_ps(sum0, sum1);
+
+    __m128 max = _mm_max_ps(_mm256_castps256_ps128(max0), _mm256_extractf128_ps(max0, 1));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(1, 0, 3, 2)));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    float tailSquares;
+    const float peak = _mm_cvtss_f32(max);
+    const float tail = simd_abs_max_sum_sq_scalar(buf+i, frames-i, &tailSquares);
+
+    *squares = _mm_cvtss_f32(sum) + tailSquares;
+    return (tail > peak) ? tail : peak;
+}
+
+// -------------------------------
+// stereo sums in a single pass
+
+// horizontal sum of 4 floats
+__attribute__((target("sse2")))
+static inline
+float simd_hsum_sse2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2")))
+static inline
+void simd_stereo_sums_sse2(const float* const left, const float* const right, const uint32_t frames, float* const sums)
+{
+    __m128 lr = _mm_setzero_ps();
+    __m128 ll = _mm_setzero_ps();
+    __m128 rr = _mm_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+4 <= frames; i += 4)
+    {
+        const __m128 l = _mm_loadu_ps(left+i);
+        const __m128 r = _mm_loadu_ps(right+i);
+
+        lr = _mm_add_ps(lr, _mm_mul_ps(l, r));
+        ll = _mm_add_ps(ll, _mm_mul_ps(l, l));
+        rr = _mm_add_ps(rr, _mm_mul_ps(r, r));
+    }
+
+    simd_stereo_sums_scalar(left+i, right+i, frames-i, sums);
+
+    sums[0] += simd_hsum_sse2(lr);
+    sums[1] += simd_hsum_sse2(ll);
+    sums[2] += simd_hsum_sse2(rr);
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+void simd_stereo_sums_avx2(const float* const left, const float* const right, const uint32_t frames, float* const sums)
+{
+    __m256 lr = _mm256_setzero_ps();
+    __m256 ll = _mm256_setzero_ps();
+    __m256 rr = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+8 <= frames; i += 8)
+    {
+        const __m256 l = _mm256_loadu_ps(left+i);
+        const __m256 r = _mm256_loadu_ps(right+i);
+
+        lr = _mm256_fmadd_ps(l, r, lr);
+        ll = _mm256_fmadd_ps(l, l, ll);
+        rr = _mm256_fmadd_ps(r, r, rr);
+    }
+
+    simd_stereo_sums_scalar(left+i, right+i, frames-i, sums);
+
+    sums[0] += simd_hsum_sse2(_mm_add_ps(_mm256_castps256_ps128(lr), _mm256_extractf128_ps(lr, 1)));
+    sums[1] += simd_hsum_sse2(_mm_add_ps(_mm256_castps256_ps128(ll), _mm256_extractf128_ps(ll, 1)));
+    sums[2] += simd_hsum_sse2(_mm_add_ps(_mm256_castps256_ps128(rr), _mm256_extractf128_ps(rr, 1)));
+}
+
+#endif // SIMD_UTILS_X86
+
+// -------------------------------
+// runtime dispatch
+
+typedef float (*SimdAbsMaxFunc)(const float* buf, uint32_t frames);
+
+static inline
+const char* simd_get_arch_name()
+{
+#ifdef SIMD_UTILS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512";
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    if (__builtin_cpu_supports("sse2"))
+        return "sse2";
+#endif
+    return "scalar";
+}
+
+static inline
+SimdAbsMaxFunc simd_get_abs_max_func()
+{
+#ifdef SIMD_UTILS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return simd_abs_max_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return simd_abs_max_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return simd_abs_max_sse2;
+#endif
+    return simd_abs_max_scalar;
+}
+
+typedef float (*SimdAbsMaxSumSqFunc)(const float* buf, uint32_t frames, float* squares);
+
+static inline
+SimdAbsMaxSumSqFunc simd_get_abs_max_sum_sq_func()
+{
+#ifdef SIMD_UTILS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return simd_abs_max_sum_sq_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return simd_abs_max_sum_sq_sse2;
+#endif
+    return simd_abs_max_sum_sq_scalar;
+}
+
+typedef void (*SimdStereoSumsFunc)(const float* left, const float* right, uint32_t frames, float* sums);
+
+static inline
+SimdStereoSumsFunc simd_get_stereo_sums_func()
+{
+#ifdef SIMD_UTILS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return simd_stereo_sums_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return simd_stereo_sums_sse2;
+#endif
+    return simd_stereo_sums_scalar;
+}
+
+// Returns the highest absolute sample value in 'buf'.
+// The CPU is probed on the first call; realtime code should instead keep the
+// pointer returned by simd_get_abs_max_func(), fetched before activation.
+static inline
+float simd_abs_max(const float* const buf, const uint32_t frames)
+{
+    static const SimdAbsMaxFunc func = simd_get_abs_max_func();
+    return func(buf, frames);
+}
+
+#endif // __SIMD_UTILS_HPP__
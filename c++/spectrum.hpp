@@ -0,0 +1,380 @@
+/*
+ * FFT spectrum analyzer with log-frequency bands and peak-hold
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __SPECTRUM_HPP__
+#define __SPECTRUM_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#ifdef __SSE__
+# include <xmmintrin.h>
+#endif
+
+// Not realtime safe by design, this is fed from a worker thread.
+//
+// All channels are averaged down to mono, then every SPECTRUM_HOP_SIZE frames a
+// Hann-windowed FFT of the last SPECTRUM_FFT_SIZE frames is taken (75% overlap).
+// The power spectrum is folded into SPECTRUM_BANDS log-spaced bands from 20Hz
+// to 20kHz, with a smooth release and a peak-hold per band.
+// A full scale sine on every channel reads 0 dB; on one channel out of N it reads
+// 20*log10(1/N) dB (-6 dB for one side of a stereo input).
+
+#define SPECTRUM_FFT_SIZE 4096
+#define SPECTRUM_HOP_SIZE (SPECTRUM_FFT_SIZE/4)
+#define SPECTRUM_BANDS    96
+#define SPECTRUM_MIN_DB   -90.0f
+#define SPECTRUM_MIN_FREQ 20.0f
+#define SPECTRUM_MAX_FREQ 20000.0f
+
+// -------------------------------
+// In-place radix-2 FFT on split real/imaginary arrays
+
+class SpectrumFFT
+{
+public:
+    SpectrumFFT()
+        : fSize(0) {}
+
+    void setup(const uint32_t size)
+    {
+        fSize = size;
+        fBitReverse.resize(size);
+        fTwiddleRe.resize(size);
+        fTwiddleIm.resize(size);
+
+        uint32_t bits = 0;
+        while ((1U << bits) < size)
+            ++bits;
+
+        for (uint32_t i=0; i < size; ++i)
+        {
+            uint32_t reversed = 0;
+
+            for (uint32_t b=0; b < bits; ++b)
+                if (i & (1U << b))
+                    reversed |= 1U << (bits-1-b);
+
+            fBitReverse[i] = reversed;
+        }
+
+        // per stage, the twiddles of a butterfly group are stored contiguously
+        // starting at index 'half', so the inner loop can use plain vector loads
+        for (uint32_t half=1; half < size; half *= 2)
+        {
+            for (uint32_t k=0; k < half; ++k)
+            {
+                const double angle = -M_PI * k / half;
+                fTwiddleRe[half+k] = float(std::cos(angle));
+                fTwiddleIm[half+k] = float(std::sin(angle));
+            }
+        }
+    }
+
+    void process(float* const re, float* const im) const
+    {
+        for (uint32_t i=0; i < fSize; ++i)
+        {
+            const uint32_t j = fBitReverse[i];
+
+            if (j > i)
+            {
+                std::swap(re[i], re[j]);
+                std::swap(im[i], im[j]);
+            }
+        }
+
+        for (uint32_t half=1; half < fSize; half *= 2)
+        {
+            const float* const wRe = &fTwiddleRe[half];
+            const float* const wIm = &fTwiddleIm[half];
+
+            for (uint32_t group=0; group < fSize; group += half*2)
+            {
+                float* const aRe = re + group;
+                float* const aIm = im + group;
+                float* const bRe = aRe + half;
+                float* const bIm = aIm + half;
+
+                uint32_t k = 0;
+#ifdef __SSE__
+                for (; k+4 <= half; k += 4)
+                {
+                    const __m128 wr = _mm_loadu_ps(wRe+k);
+                    const __m128 wi = _mm_loadu_ps(wIm+k);
+                    const __m128 br = _mm_loadu_ps(bRe+k);
+                    const __m128 bi = _mm_loadu_ps(bIm+k);
+                    const __m128 ar = _mm_loadu_ps(aRe+k);
+                    const __m128 ai = _mm_loadu_ps(aIm+k);
+
+                    const __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                    const __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+
+                    _mm_storeu_ps(aRe+k, _mm_add_ps(ar, tr));
+                    _mm_storeu_ps(aIm+k, _mm_add_ps(ai, ti));
+                    _mm_storeu_ps(bRe+k, _mm_sub_ps(ar, tr));
+                    _mm_storeu_ps(bIm+k, _mm_sub_ps(ai, ti));
+                }
+#endif
+                for (; k < half; ++k)
+                {
+                    const float tr = bRe[k]*wRe[k] - bIm[k]*wIm[k];
+                    const float ti = bRe[k]*wIm[k] + bIm[k]*wRe[k];
+
+                    bRe[k] = aRe[k] - tr;
+                    bIm[k] = aIm[k] - ti;
+                    aRe[k] += tr;
+                    aIm[k] += ti;
+                }
+            }
+        }
+    }
+
+private:
+    uint32_t fSize;
+    std::vector<uint32_t> fBitReverse;
+    std::vector<float> fTwiddleRe;
+    std::vector<float> fTwiddleIm;
+};
+
+// -------------------------------
+
+class SpectrumAnalyzer
+{
+public:
+    SpectrumAnalyzer()
+        : fChannels(0),
+          fSampleRate(48000),
+          fHistoryPos(0),
+          fHopFrames(0)
+    {
+        reset();
+    }
+
+    void setup(const uint32_t channels, const uint32_t sampleRate)
+    {
+        fChannels   = channels;
+        fSampleRate = sampleRate;
+
+        fFFT.setup(SPECTRUM_FFT_SIZE);
+
+        for (uint32_t i=0; i < SPECTRUM_FFT_SIZE; ++i)
+            fWindow[i] = 0.5f - 0.5f * float(std::cos(2.0 * M_PI * i / SPECTRUM_FFT_SIZE));
+
+        // band edges, in FFT bins
+        const double binWidth = double(sampleRate) / SPECTRUM_FFT_SIZE;
+        const double ratio    = std::pow(double(SPECTRUM_MAX_FREQ) / SPECTRUM_MIN_FREQ, 1.0 / SPECTRUM_BANDS);
+
+        for (uint32_t b=0; b <= SPECTRUM_BANDS; ++b)
+            fBandEdges[b] = SPECTRUM_MIN_FREQ * std::pow(ratio, double(b)) / binWidth;
+
+        reset();
+    }
+
+    void reset()
+    {
+        ::memset(fHistory, 0, sizeof(fHistory));
+        fHistoryPos = 0;
+        fHopFrames  = 0;
+
+        std::lock_guard<std::mutex> lock(fMutex);
+
+        for (uint32_t b=0; b < SPECTRUM_BANDS; ++b)
+        {
+            fLevels[b]   = SPECTRUM_MIN_DB;
+            fPeaks[b]    = SPECTRUM_MIN_DB;
+            fPeakAge[b]  = 0.0f;
+        }
+    }
+
+    // 'buffers' holds one pointer per channel, as given by AudioRing::read().
+    void process(const float* const* const buffers, const uint32_t frames)
+    {
+        if (fChannels == 0)
+            return;
+
+        // averaged, so correlated channels (mono material on a stereo input) do not read high
+        const float gain = 1.0f / fChannels;
+
+        for (uint32_t i=0; i < frames; ++i)
+        {
+            float sum = 0.0f;
+
+            for (uint32_t c=0; c < fChannels; ++c)
+                sum += buffers[c][i];
+
+            fHistory[fHistoryPos] = sum * gain;
+            fHistoryPos = (fHistoryPos + 1) & (SPECTRUM_FFT_SIZE-1);
+
+            if (++fHopFrames == SPECTRUM_HOP_SIZE)
+            {
+                fHopFrames = 0;
+                analyze();
+            }
+        }
+    }
+
+    // Band center frequency, for labelling.
+    static float getBandFrequency(const uint32_t band)
+    {
+        return SPECTRUM_MIN_FREQ * std::pow(SPECTRUM_MAX_FREQ / SPECTRUM_MIN_FREQ, (band + 0.5f) / SPECTRUM_BANDS);
+    }
+
+    // Can be called from any thread, copies SPECTRUM_BANDS values (in dB) into each array.
+    void getBands(float* const levels, float* const peaks)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+
+        ::memcpy(levels, fLevels, sizeof(fLevels));
+        ::memcpy(peaks, fPeaks, sizeof(fPeaks));
+    }
+
+private:
+    void analyze()
+    {
+        // oldest sample first
+        for (uint32_t i=0; i < SPECTRUM_FFT_SIZE; ++i)
+            fRe[i] = fHistory[(fHistoryPos + i) & (SPECTRUM_FFT_SIZE-1)];
+
+#ifdef __SSE__
+        for (uint32_t i=0; i < SPECTRUM_FFT_SIZE; i += 4)
+        {
+            _mm_storeu_ps(fRe+i, _mm_mul_ps(_mm_loadu_ps(fRe+i), _mm_loadu_ps(fWindow+i)));
+            _mm_storeu_ps(fIm+i, _mm_setzero_ps());
+        }
+#else
+        for (uint32_t i=0; i < SPECTRUM_FFT_SIZE; ++i)
+        {
+            fRe[i] *= fWindow[i];
+            fIm[i]  = 0.0f;
+        }
+#endif
+
+        fFFT.process(fRe, fIm);
+
+        // power, scaled so that a full scale sine is 1.0 (Hann coherent gain is 0.5)
+        const float scale = 4.0f / SPECTRUM_FFT_SIZE;
+
+#ifdef __SSE__
+        const __m128 scale2 = _mm_set1_ps(scale*scale);
+
+        for (uint32_t k=0; k < SPECTRUM_FFT_SIZE/2; k += 4)
+        {
+            const __m128 re = _mm_loadu_ps(fRe+k);
+            const __m128 im = _mm_loadu_ps(fIm+k);
+            _mm_storeu_ps(fPower+k, _mm_mul_ps(scale2, _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+        }
+#else
+        for (uint32_t k=0; k < SPECTRUM_FFT_SIZE/2; ++k)
+            fPower[k] = scale*scale * (fRe[k]*fRe[k] + fIm[k]*fIm[k]);
+#endif
+
+        const float dt = float(SPECTRUM_HOP_SIZE) / fSampleRate;
+
+        std::lock_guard<std::mutex> lock(fMutex);
+
+        for (uint32_t b=0; b < SPECTRUM_BANDS; ++b)
+        {
+            const double start = fBandEdges[b];
+            const double end   = fBandEdges[b+1];
+
+            uint32_t first = uint32_t(std::ceil(start));
+            uint32_t last  = uint32_t(std::floor(end));
+
+            if (last >= SPECTRUM_FFT_SIZE/2)
+                last = SPECTRUM_FFT_SIZE/2 - 1;
+
+            float power = 0.0f;
+
+            if (first <= last)
+            {
+                // widest bands, take the strongest bin
+                for (uint32_t j=first; j <= last; ++j)
+                    if (fPower[j] > power)
+                        power = fPower[j];
+            }
+            else
+            {
+                // narrower than a bin, interpolate at the band center
+                const double center = 0.5 * (start + end);
+                first = uint32_t(center);
+
+                if (first+1 < SPECTRUM_FFT_SIZE/2)
+                {
+                    const float frac = float(center - first);
+                    power = fPower[first] * (1.0f - frac) + fPower[first+1] * frac;
+                }
+            }
+
+            float level = (power > 1e-12f) ? 10.0f * std::log10(power) : SPECTRUM_MIN_DB;
+
+            if (level < SPECTRUM_MIN_DB)
+                level = SPECTRUM_MIN_DB;
+
+            // instant attack, smooth release
+            const float released = fLevels[b] - RELEASE_DB_PER_SECOND * dt;
+            fLevels[b] = (level > released) ? level : released;
+
+            // peak-hold, then decay
+            if (level >= fPeaks[b])
+            {
+                fPeaks[b]   = level;
+                fPeakAge[b] = 0.0f;
+            }
+            else if ((fPeakAge[b] += dt) > PEAK_HOLD_SECONDS)
+            {
+                fPeaks[b] -= PEAK_DECAY_DB_PER_SECOND * dt;
+
+                if (fPeaks[b] < fLevels[b])
+                    fPeaks[b] = fLevels[b];
+            }
+        }
+    }
+
+    // -------------------------------
+
+    static constexpr float RELEASE_DB_PER_SECOND    = 40.0f;
+    static constexpr float PEAK_HOLD_SECONDS        = 1.5f;
+    static constexpr float PEAK_DECAY_DB_PER_SECOND = 20.0f;
+
+    uint32_t fChannels;
+    uint32_t fSampleRate;
+
+    SpectrumFFT fFFT;
+    float  fWindow[SPECTRUM_FFT_SIZE];
+    double fBandEdges[SPECTRUM_BANDS+1];
+
+    // owned by the worker thread
+    float    fHistory[SPECTRUM_FFT_SIZE];
+    uint32_t fHistoryPos;
+    uint32_t fHopFrames;
+    float    fRe[SPECTRUM_FFT_SIZE];
+    float    fIm[SPECTRUM_FFT_SIZE];
+    float    fPower[SPECTRUM_FFT_SIZE/2];
+    float    fPeakAge[SPECTRUM_BANDS];
+
+    // shared with the GUI
+    std::mutex fMutex;
+    float fLevels[SPECTRUM_BANDS];
+    float fPeaks[SPECTRUM_BANDS];
+};
+
+#endif // __SPECTRUM_HPP__
@@ -0,0 +1,224 @@
+/*
+ * True-peak (inter-sample) detection, as per ITU-R BS.1770-4 Annex 2
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __TRUE_PEAK_HPP__
+#define __TRUE_PEAK_HPP__
+
+#include "simd_utils.hpp"
+
+#include <cstring>
+
+// 4x oversampling through the 48-tap polyphase FIR from BS.1770-4, 12 taps per phase.
+// The kernels compute 4 (SSE2) or 8 (AVX2) consecutive outputs of every phase at once,
+// so each unaligned load of the input is shared by all 4 phases.
+
+#define TRUE_PEAK_PHASES 4
+#define TRUE_PEAK_TAPS   12
+
+static const float kTruePeakCoeffs[TRUE_PEAK_PHASES][TRUE_PEAK_TAPS] = {
+    {  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,
+       0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+    { -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,
+       0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+    { -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,
+       0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+    { -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,
+       0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f }
+};
+
+// All kernels read 'TRUE_PEAK_TAPS-1' samples of history before 'buf[0]'.
+
+static inline
+float true_peak_kernel_scalar(const float* const buf, const uint32_t frames)
+{
+    float peak = 0.0f;
+
+    for (uint32_t i=0; i < frames; ++i)
+    {
+        for (int p=0; p < TRUE_PEAK_PHASES; ++p)
+        {
+            float sum = 0.0f;
+
+            for (int k=0; k < TRUE_PEAK_TAPS; ++k)
+                sum += kTruePeakCoeffs[p][k] * buf[int(i)-k];
+
+            sum = std::fabs(sum);
+
+            if (sum > peak)
+                peak = sum;
+        }
+    }
+
+    return peak;
+}
+
+#ifdef SIMD_UTILS_X86
+
+__attribute__((target("sse2")))
+static inline
+float true_peak_kernel_sse2(const float* const buf, const uint32_t frames)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 max = _mm_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+4 <= frames; i += 4)
+    {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        __m128 acc2 = _mm_setzero_ps();
+        __m128 acc3 = _mm_setzero_ps();
+
+        for (int k=0; k < TRUE_PEAK_TAPS; ++k)
+        {
+            const __m128 x = _mm_loadu_ps(buf+i-k);
+
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(kTruePeakCoeffs[0][k]), x));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_set1_ps(kTruePeakCoeffs[1][k]), x));
+            acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_set1_ps(kTruePeakCoeffs[2][k]), x));
+            acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_set1_ps(kTruePeakCoeffs[3][k]), x));
+        }
+
+        max = _mm_max_ps(max, _mm_max_ps(_mm_and_ps(mask, acc0), _mm_and_ps(mask, acc1)));
+        max = _mm_max_ps(max, _mm_max_ps(_mm_and_ps(mask, acc2), _mm_and_ps(mask, acc3)));
+    }
+
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(1, 0, 3, 2)));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    const float peak = _mm_cvtss_f32(max);
+    const float tail = true_peak_kernel_scalar(buf+i, frames-i);
+
+    return (tail > peak) ? tail : peak;
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+float true_peak_kernel_avx2(const float* const buf, const uint32_t frames)
+{
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 max = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+
+    for (; i+8 <= frames; i += 8)
+    {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+
+        for (int k=0; k < TRUE_PEAK_TAPS; ++k)
+        {
+            const __m256 x = _mm256_loadu_ps(buf+i-k);
+
+            acc0 = _mm256_fmadd_ps(_mm256_set1_ps(kTruePeakCoeffs[0][k]), x, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_set1_ps(kTruePeakCoeffs[1][k]), x, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_set1_ps(kTruePeakCoeffs[2][k]), x, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_set1_ps(kTruePeakCoeffs[3][k]), x, acc3);
+        }
+
+        max = _mm256_max_ps(max, _mm256_max_ps(_mm256_and_ps(mask, acc0), _mm256_and_ps(mask, acc1)));
+        max = _mm256_max_ps(max, _mm256_max_ps(_mm256_and_ps(mask, acc2), _mm256_and_ps(mask, acc3)));
+    }
+
+    __m128 max4 = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+    max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(1, 0, 3, 2)));
+    max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    const float peak = _mm_cvtss_f32(max4);
+    const float tail = true_peak_kernel_scalar(buf+i, frames-i);
+
+    return (tail > peak) ? tail : peak;
+}
+
+#endif // SIMD_UTILS_X86
+
+typedef float (*TruePeakKernelFunc)(const float* buf, uint32_t frames);
+
+static inline
+TruePeakKernelFunc true_peak_get_kernel_func()
+{
+#ifdef SIMD_UTILS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return true_peak_kernel_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return true_peak_kernel_sse2;
+#endif
+    return true_peak_kernel_scalar;
+}
+
+// -------------------------------
+// Per-channel detector, keeps the filter history between JACK periods
+
+class TruePeakDetector
+{
+public:
+    TruePeakDetector()
+        : fKernel(true_peak_kernel_scalar)
+    {
+        reset();
+    }
+
+    // Not realtime safe, call before processing starts.
+    void init()
+    {
+        fKernel = true_peak_get_kernel_func();
+        reset();
+    }
+
+    void reset()
+    {
+        ::memset(fBuffer, 0, sizeof(float)*(TRUE_PEAK_TAPS-1));
+    }
+
+    // Returns the highest absolute value of the 4x oversampled signal.
+    float process(const float* const buf, const uint32_t frames)
+    {
+        float peak = 0.0f;
+
+        for (uint32_t offset=0; offset < frames;)
+        {
+            const uint32_t chunk = (frames-offset < CHUNK_SIZE) ? frames-offset : CHUNK_SIZE;
+
+            ::memcpy(fBuffer+TRUE_PEAK_TAPS-1, buf+offset, sizeof(float)*chunk);
+
+            const float chunkPeak = fKernel(fBuffer+TRUE_PEAK_TAPS-1, chunk);
+
+            if (chunkPeak > peak)
+                peak = chunkPeak;
+
+            // keep the last samples as history for the next chunk
+            ::memmove(fBuffer, fBuffer+chunk, sizeof(float)*(TRUE_PEAK_TAPS-1));
+
+            offset += chunk;
+        }
+
+        return peak;
+    }
+
+private:
+    static const uint32_t CHUNK_SIZE = 256;
+
+    TruePeakKernelFunc fKernel;
+    float fBuffer[TRUE_PEAK_TAPS-1 + CHUNK_SIZE];
+};
+
+#endif // __TRUE_PEAK_HPP__
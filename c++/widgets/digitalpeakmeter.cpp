@@ -20,58 +20,77 @@
 #include <QtGui/QPainter>
 #include <QtGui/QPaintEvent>
 
+#include <algorithm>
+#include <cmath>
+
+// bottom of the scale, levels below this are not shown
+static const float kMinDb = -60.0f;
+
+// size of the clip indicator at the end of each bar
+static const int kClipSize = 3;
+
 DigitalPeakMeter::DigitalPeakMeter(QWidget* parent)
     : QWidget(parent),
       fChannels(0),
-      fSmoothMultiplier(1),
       fWidth(0),
       fHeight(0),
       fSizeMeter(0),
       fOrientation(VERTICAL),
+      fAttackMs(0.0f),
+      fReleaseMs(0.0f),
+      fPeakHoldMs(0),
+      fPeakDecayMs(0.0f),
       fColorBackground("#111111"),
       fGradientMeter(0, 0, 1, 1),
       fColorBase(93, 231, 61),
       fColorBaseAlt(15, 110, 15, 100),
-      fChannelsData(nullptr),
-      fLastValueData(nullptr)
+      fMeters(nullptr)
 {
+    setAttribute(Qt::WA_OpaquePaintEvent);
+
+    fTimer.start();
+
     setChannels(0);
     setColor(GREEN);
 }
 
 DigitalPeakMeter::~DigitalPeakMeter()
 {
-    if (fChannelsData != nullptr)
-        delete[] fChannelsData;
-    if (fLastValueData != nullptr)
-        delete[] fLastValueData;
+    if (fMeters != nullptr)
+        delete[] fMeters;
 }
 
 void DigitalPeakMeter::displayMeter(int meter, float level)
 {
-    Q_ASSERT(fChannelsData != nullptr);
+    Q_ASSERT(fMeters != nullptr);
     Q_ASSERT(meter > 0 && meter <= fChannels);
 
-    if (meter <= 0 || meter > fChannels || fChannelsData == nullptr)
+    if (meter <= 0 || meter > fChannels || fMeters == nullptr)
         return qCritical("DigitalPeakMeter::displayMeter(%i, %f) - invalid meter number", meter, level);
 
-    int i = meter - 1;
+    const QRect rect(setMeterLevel(meter - 1, level, fTimer.nsecsElapsed()));
 
-    if (fSmoothMultiplier > 0)
-        level = (fLastValueData[i] * fSmoothMultiplier + level) / float(fSmoothMultiplier + 1);
+    if (! rect.isEmpty())
+        update(rect);
+}
 
-    if (level < 0.001f)
-        level = 0.0f;
-    else if (level > 0.999f)
-        level = 1.0f;
+void DigitalPeakMeter::displayMeters(const float* levels, int count)
+{
+    Q_ASSERT(levels != nullptr);
+    Q_ASSERT(count >= 0 && count <= fChannels);
 
-    if (fChannelsData[i] != level)
-    {
-        fChannelsData[i] = level;
-        update();
-    }
+    if (levels == nullptr || count < 0 || count > fChannels)
+        return qCritical("DigitalPeakMeter::displayMeters(%p, %i) - invalid arguments", levels, count);
+
+    const qint64 now = fTimer.nsecsElapsed();
 
-    fLastValueData[i] = level;
+    QRect rect;
+
+    for (int i=0; i < count; ++i)
+        rect |= setMeterLevel(i, levels[i], now);
+
+    if (! rect.isEmpty())
+        update(rect);
 }
 
 void DigitalPeakMeter::setChannels(int channels)
@@ -83,27 +102,34 @@ void DigitalPeakMeter::setChannels(int channels)
 
     fChannels = channels;
 
-    if (fChannelsData != nullptr)
-        delete[] fChannelsData;
-    if (fLastValueData != nullptr)
-        delete[] fLastValueData;
+    if (fMeters != nullptr)
+        delete[] fMeters;
 
     if (channels > 0)
     {
-        fChannelsData  = new float[channels];
-        fLastValueData = new float[channels];
+        const qint64 now = fTimer.nsecsElapsed();
+
+        fMeters = new MeterData[channels];
 
         for (int i=0; i < channels; ++i)
         {
-            fChannelsData[i]  = 0.0f;
-            fLastValueData[i] = 0.0f;
+            MeterData& meter(fMeters[i]);
+            meter.level     = 0.0f;
+            meter.peak      = 0.0f;
+            meter.peakTime  = now;
+            meter.lastTime  = now;
+            meter.pixel     = 0;
+            meter.peakPixel = 0;
+            meter.clipped   = false;
         }
     }
     else
     {
-        fChannelsData  = nullptr;
-        fLastValueData = nullptr;
+        fMeters = nullptr;
     }
+
+    updateSizes();
+    updateGeometry();
 }
 
 void DigitalPeakMeter::setColor(Color color)
@@ -152,6 +178,66 @@ void DigitalPeakMeter::setOrientation(Orientation orientation)
     updateSizes();
 }
 
+void DigitalPeakMeter::setBallistics(Ballistics ballistics)
+{
+    switch (ballistics)
+    {
+    case DIRECT:
+        setAttackRelease(0.0f, 0.0f);
+        setPeakHold(0, 0.0f);
+        break;
+    case DIGITAL:
+        // instant attack, 20 dB fall in 1.7 s
+        setAttackRelease(0.0f, 1700.0f);
+        setPeakHold(1500, 1700.0f);
+        break;
+    case PPM:
+        // the level is already integrated, only the peak hold is added (same 20 dB in 1.5 s fall)
+        setAttackRelease(0.0f, 0.0f);
+        setPeakHold(1500, 1500.0f);
+        break;
+    case VU:
+        // the level is already integrated
+        setAttackRelease(0.0f, 0.0f);
+        setPeakHold(0, 0.0f);
+        break;
+    default:
+        return qCritical("DigitalPeakMeter::setBallistics(%i) - invalid ballistics", ballistics);
+    }
+}
+
+void DigitalPeakMeter::setAttackRelease(float attackMs, float releaseMs)
+{
+    Q_ASSERT(attackMs >= 0.0f && releaseMs >= 0.0f);
+
+    fAttackMs  = qMax(attackMs, 0.0f);
+    fReleaseMs = qMax(releaseMs, 0.0f);
+}
+
+void DigitalPeakMeter::setPeakHold(int holdMs, float decayMs)
+{
+    Q_ASSERT(holdMs >= 0 && decayMs >= 0.0f);
+
+    fPeakHoldMs  = qMax(holdMs, 0);
+    fPeakDecayMs = qMax(decayMs, 0.0f);
+
+    for (int i=0; i < fChannels; ++i)
+    {
+        fMeters[i].peak      = fMeters[i].level;
+        fMeters[i].peakPixel = fMeters[i].pixel;
+    }
+
+    update();
+}
+
+void DigitalPeakMeter::resetClips()
+{
+    for (int i=0; i < fChannels; ++i)
+        fMeters[i].clipped = false;
+
+    update();
+}
+
 void DigitalPeakMeter::setSmoothRelease(int value)
 {
     Q_ASSERT(value >= 0 && value <= 5);
@@ -161,12 +247,18 @@ void DigitalPeakMeter::setSmoothRelease(int value)
     else if (value > 5)
         value = 5;
 
-    fSmoothMultiplier = value;
+    setAttackRelease(fAttackMs, float(value) * 100.0f);
 }
 
 QSize DigitalPeakMeter::minimumSizeHint() const
 {
-    return QSize(10, 10);
+    // keep at least 2 pixels per bar
+    const int barsSize = fChannels * 2;
+
+    if (fOrientation == HORIZONTAL)
+        return QSize(10, barsSize > 10 ? barsSize : 10);
+
+    return QSize(barsSize > 10 ? barsSize : 10, 10);
 }
 
 QSize DigitalPeakMeter::sizeHint() const
@@ -194,90 +286,288 @@ void DigitalPeakMeter::updateSizes()
         if (fChannels > 0)
             fSizeMeter = fWidth/fChannels;
     }
-}
 
-void DigitalPeakMeter::paintEvent(QPaintEvent* event)
-{
-    QPainter painter(this);
-    event->accept();
+    // pixel 'i' of a bar lights up from kMinDb * (length-i)/length dB
+    const int length = (fOrientation == HORIZONTAL) ? fWidth : fHeight;
 
-    painter.setPen(Qt::black);
-    painter.setBrush(Qt::black);
-    painter.drawRect(0, 0, fWidth, fHeight);
+    fLevelTable.resize(length > 0 ? length : 0);
 
-    int meterX = 0;
-    painter.setPen(fColorBackground);
-    painter.setBrush(fGradientMeter);
+    for (int i=0; i < length; ++i)
+        fLevelTable[i] = std::pow(10.0f, kMinDb * float(length - i) / float(length) / 20.0f);
 
     for (int i=0; i < fChannels; ++i)
     {
-        float value, level = fChannelsData[i];
+        fMeters[i].pixel     = levelToPixel(fMeters[i].level);
+        fMeters[i].peakPixel = levelToPixel(fMeters[i].peak);
+    }
 
-        if (fOrientation == HORIZONTAL)
-            value = level * float(fWidth);
-        else if (fOrientation == VERTICAL)
-            value = float(fHeight) - (level * float(fHeight));
+    updatePixmaps();
+    update();
+}
+
+// Position of a bar's end, as a y coordinate (VERTICAL) or x coordinate (HORIZONTAL)
+int DigitalPeakMeter::levelToPixel(float level) const
+{
+    const int lit = int(std::upper_bound(fLevelTable.begin(), fLevelTable.end(), level) - fLevelTable.begin());
+
+    if (fOrientation == HORIZONTAL)
+        return lit;
+
+    return fHeight - lit;
+}
+
+// Runs the ballistics of meter 'index' for a new input level, returning the area to repaint.
+// Everything is based on the time since the previous update, so a late or skipped refresh
+// does not change the speed of the meter.
+QRect DigitalPeakMeter::setMeterLevel(int index, float level, qint64 now)
+{
+    MeterData& meter(fMeters[index]);
+
+    const float elapsedMs = float(now - meter.lastTime) / 1000000.0f;
+    meter.lastTime = now;
+
+    if (level < 0.0f)
+        level = -level;
+
+    // bar
+    if (level >= meter.level)
+    {
+        if (fAttackMs > 0.0f)
+            meter.level += (level - meter.level) * (1.0f - std::exp(-elapsedMs / fAttackMs));
         else
-            value = 0.0f;
+            meter.level = level;
+    }
+    else if (fReleaseMs > 0.0f)
+    {
+        meter.level *= std::pow(10.0f, -elapsedMs / fReleaseMs);
 
-        if (fOrientation == HORIZONTAL)
-            painter.drawRect(0, meterX, int(value), fSizeMeter);
-        else if (fOrientation == VERTICAL)
-            painter.drawRect(meterX, int(value), fSizeMeter, fHeight);
+        if (meter.level < level)
+            meter.level = level;
+    }
+    else
+    {
+        meter.level = level;
+    }
+
+    // peak hold
+    if (fPeakHoldMs > 0)
+    {
+        if (level >= meter.peak)
+        {
+            meter.peak     = level;
+            meter.peakTime = now;
+        }
+        else if (now - meter.peakTime > qint64(fPeakHoldMs) * 1000000)
+        {
+            if (fPeakDecayMs > 0.0f)
+                meter.peak *= std::pow(10.0f, -elapsedMs / fPeakDecayMs);
+            else
+                meter.peak = 0.0f;
+
+            if (meter.peak < meter.level)
+                meter.peak = meter.level;
+        }
+    }
+
+    QRect rect;
 
-        meterX += fSizeMeter;
+    // clip latch
+    if (level >= 1.0f && ! meter.clipped)
+    {
+        meter.clipped = true;
+        rect = getClipRect(index);
     }
 
-    painter.setBrush(Qt::black);
+    const int pixel = levelToPixel(meter.level);
+
+    if (pixel != meter.pixel)
+    {
+        rect |= getBarRect(index, meter.pixel, pixel);
+        meter.pixel = pixel;
+    }
+
+    if (fPeakHoldMs > 0)
+    {
+        const int peakPixel = levelToPixel(meter.peak);
+
+        if (peakPixel != meter.peakPixel)
+        {
+            rect |= getBarRect(index, meter.peakPixel, meter.peakPixel);
+            rect |= getBarRect(index, peakPixel, peakPixel);
+            meter.peakPixel = peakPixel;
+        }
+    }
+
+    return rect;
+}
+
+// Area of meter 'index' between two bar ends, both included
+QRect DigitalPeakMeter::getBarRect(int index, int from, int to) const
+{
+    const int meterX = index * fSizeMeter;
+    const int start  = qMin(from, to);
+    const int size   = qAbs(to - from) + 1;
 
     if (fOrientation == HORIZONTAL)
+        return QRect(start, meterX, size, fSizeMeter+1);
+
+    return QRect(meterX, start, fSizeMeter+1, size);
+}
+
+QRect DigitalPeakMeter::getClipRect(int index) const
+{
+    const int meterX = index * fSizeMeter;
+
+    if (fOrientation == HORIZONTAL)
+        return QRect(fWidth - kClipSize, meterX+1, kClipSize, fSizeMeter-1);
+
+    return QRect(meterX+1, 0, fSizeMeter-1, kClipSize);
+}
+
+void DigitalPeakMeter::updatePixmaps()
+{
+    if (fWidth <= 0 || fHeight <= 0)
     {
-        // Variables
-        float lsmall = fWidth;
-        float lfull  = fHeight - 1;
+        fPixmapBackground = QPixmap();
+        fPixmapBars = QPixmap();
+        return;
+    }
 
-        // Base
-        painter.setPen(fColorBaseAlt);
-        painter.drawLine(lsmall * 0.25f, 2, lsmall * 0.25f, lfull-2.0f);
-        painter.drawLine(lsmall * 0.50f, 2, lsmall * 0.50f, lfull-2.0f);
+    fPixmapBackground = QPixmap(fWidth, fHeight);
+    fPixmapBackground.fill(Qt::black);
 
-        // Yellow
-        painter.setPen(QColor(110, 110, 15, 100));
-        painter.drawLine(lsmall * 0.70f, 2, lsmall * 0.70f, lfull-2.0f);
-        painter.drawLine(lsmall * 0.83f, 2, lsmall * 0.83f, lfull-2.0f);
+    fPixmapBars = QPixmap(fWidth, fHeight);
+    fPixmapBars.fill(Qt::black);
 
-        // Orange
-        painter.setPen(QColor(180, 110, 15, 100));
-        painter.drawLine(lsmall * 0.90f, 2, lsmall * 0.90f, lfull-2.0f);
+    {
+        QPainter painter(&fPixmapBars);
+        painter.setPen(fColorBackground);
+        painter.setBrush(fGradientMeter);
 
-        // Red
-        painter.setPen(QColor(110, 15, 15, 100));
-        painter.drawLine(lsmall * 0.96f, 2, lsmall * 0.96f, lfull-2.0f);
+        int meterX = 0;
 
+        for (int i=0; i < fChannels; ++i)
+        {
+            if (fOrientation == HORIZONTAL)
+                painter.drawRect(0, meterX, fWidth, fSizeMeter);
+            else if (fOrientation == VERTICAL)
+                painter.drawRect(meterX, 0, fSizeMeter, fHeight);
+
+            meterX += fSizeMeter;
+        }
     }
-    else if (fOrientation == VERTICAL)
+
+    // scale marks, at -45, -30, -18, -10, -6 and -2.4 dB
+    QPainter painterBackground(&fPixmapBackground);
+    QPainter painterBars(&fPixmapBars);
+    QPainter* const painters[2] = { &painterBackground, &painterBars };
+
+    for (int i=0; i < 2; ++i)
+    {
+        QPainter& painter(*painters[i]);
+
+        if (fOrientation == HORIZONTAL)
+        {
+            // Variables
+            float lsmall = fWidth;
+            float lfull  = fHeight - 1;
+
+            // Base
+            painter.setPen(fColorBaseAlt);
+            painter.drawLine(lsmall * 0.25f, 2, lsmall * 0.25f, lfull-2.0f);
+            painter.drawLine(lsmall * 0.50f, 2, lsmall * 0.50f, lfull-2.0f);
+
+            // Yellow
+            painter.setPen(QColor(110, 110, 15, 100));
+            painter.drawLine(lsmall * 0.70f, 2, lsmall * 0.70f, lfull-2.0f);
+            painter.drawLine(lsmall * 0.83f, 2, lsmall * 0.83f, lfull-2.0f);
+
+            // Orange
+            painter.setPen(QColor(180, 110, 15, 100));
+            painter.drawLine(lsmall * 0.90f, 2, lsmall * 0.90f, lfull-2.0f);
+
+            // Red
+            painter.setPen(QColor(110, 15, 15, 100));
+            painter.drawLine(lsmall * 0.96f, 2, lsmall * 0.96f, lfull-2.0f);
+        }
+        else if (fOrientation == VERTICAL)
+        {
+            // Variables
+            float lsmall = fHeight;
+            float lfull  = fWidth - 1;
+
+            // Base
+            painter.setPen(fColorBaseAlt);
+            painter.drawLine(2, lsmall - (lsmall * 0.25f), lfull-2.0f, lsmall - (lsmall * 0.25f));
+            painter.drawLine(2, lsmall - (lsmall * 0.50f), lfull-2.0f, lsmall - (lsmall * 0.50f));
+
+            // Yellow
+            painter.setPen(QColor(110, 110, 15, 100));
+            painter.drawLine(2, lsmall - (lsmall * 0.70f), lfull-2.0f, lsmall - (lsmall * 0.70f));
+            painter.drawLine(2, lsmall - (lsmall * 0.83f), lfull-2.0f, lsmall - (lsmall * 0.83f));
+
+            // Orange
+            painter.setPen(QColor(180, 110, 15, 100));
+            painter.drawLine(2, lsmall - (lsmall * 0.90f), lfull-2.0f, lsmall - (lsmall * 0.90f));
+
+            // Red
+            painter.setPen(QColor(110, 15, 15, 100));
+            painter.drawLine(2, lsmall - (lsmall * 0.96f), lfull-2.0f, lsmall - (lsmall * 0.96f));
+        }
+    }
+}
+
+void DigitalPeakMeter::mousePressEvent(QMouseEvent* event)
+{
+    resetClips();
+    QWidget::mousePressEvent(event);
+}
+
+void DigitalPeakMeter::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    event->accept();
+
+    const QRect& rect(event->rect());
+    painter.drawPixmap(rect, fPixmapBackground, rect);
+
+    int meterX = 0;
+
+    for (int i=0; i < fChannels; ++i, meterX += fSizeMeter)
     {
-        // Variables
-        float lsmall = fHeight;
-        float lfull  = fWidth - 1;
-
-        // Base
-        painter.setPen(fColorBaseAlt);
-        painter.drawLine(2, lsmall - (lsmall * 0.25f), lfull-2.0f, lsmall - (lsmall * 0.25f));
-        painter.drawLine(2, lsmall - (lsmall * 0.50f), lfull-2.0f, lsmall - (lsmall * 0.50f));
-
-        // Yellow
-        painter.setPen(QColor(110, 110, 15, 100));
-        painter.drawLine(2, lsmall - (lsmall * 0.70f), lfull-2.0f, lsmall - (lsmall * 0.70f));
-        painter.drawLine(2, lsmall - (lsmall * 0.83f), lfull-2.0f, lsmall - (lsmall * 0.83f));
-
-        // Orange
-        painter.setPen(QColor(180, 110, 15, 100));
-        painter.drawLine(2, lsmall - (lsmall * 0.90f), lfull-2.0f, lsmall - (lsmall * 0.90f));
-
-        // Red
-        painter.setPen(QColor(110, 15, 15, 100));
-        painter.drawLine(2, lsmall - (lsmall * 0.96f), lfull-2.0f, lsmall - (lsmall * 0.96f));
+        const MeterData& meter(fMeters[i]);
+
+        if (fOrientation == HORIZONTAL)
+        {
+            if (meterX > rect.bottom() || meterX+fSizeMeter < rect.top())
+                continue;
+
+            if (meter.pixel > 0)
+                painter.drawPixmap(0, meterX, fPixmapBars, 0, meterX, meter.pixel+1, fSizeMeter+1);
+
+            if (fPeakHoldMs > 0 && meter.peakPixel > 0)
+            {
+                painter.setPen(Qt::white);
+                painter.drawLine(meter.peakPixel, meterX+1, meter.peakPixel, meterX+fSizeMeter-1);
+            }
+        }
+        else if (fOrientation == VERTICAL)
+        {
+            if (meterX > rect.right() || meterX+fSizeMeter < rect.left())
+                continue;
+
+            if (meter.pixel < fHeight)
+                painter.drawPixmap(meterX, meter.pixel, fPixmapBars, meterX, meter.pixel, fSizeMeter+1, fHeight-meter.pixel);
+
+            if (fPeakHoldMs > 0 && meter.peakPixel < fHeight)
+            {
+                painter.setPen(Qt::white);
+                painter.drawLine(meterX+1, meter.peakPixel, meterX+fSizeMeter-1, meter.peakPixel);
+            }
+        }
+
+        if (meter.clipped)
+            painter.fillRect(getClipRect(i), Qt::red);
     }
 }
 
@@ -18,9 +18,13 @@
 #ifndef __DIGITALPEAKMETER_HPP__
 #define __DIGITALPEAKMETER_HPP__
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QTimer>
+#include <QtGui/QPixmap>
 #include <QtWidgets/QWidget>
 
+#include <vector>
+
 class DigitalPeakMeter : public QWidget
 {
 public:
@@ -34,13 +38,39 @@ public:
         BLUE  = 2
     };
 
+    enum Ballistics {
+        DIRECT  = 1, // levels are shown as given
+        DIGITAL = 2, // IEC 60268-18 digital peak meter
+        PPM     = 3, // levels from a per-sample PPM integrator (see meter_ballistics.hpp), with peak hold
+        VU      = 4  // levels from a per-sample VU integrator (see meter_ballistics.hpp)
+    };
+
     DigitalPeakMeter(QWidget* parent);
     ~DigitalPeakMeter();
 
+    // 'level' is a linear amplitude, shown on a -60 to 0 dB scale
     void displayMeter(int meter, float level);
+
+    // updates meters 1 to 'count' at once, repainting only the bars that moved
+    void displayMeters(const float* levels, int count);
+
     void setChannels(int channels);
     void setColor(Color color);
     void setOrientation(Orientation orientation);
+
+    // sets attack, release and peak-hold times to the ones of a standard meter type
+    void setBallistics(Ballistics ballistics);
+
+    // 'attackMs' is the integration time constant, 'releaseMs' the time to fall by 20 dB; 0 means instant
+    void setAttackRelease(float attackMs, float releaseMs);
+
+    // peak marker is held for 'holdMs', then falls 20 dB every 'decayMs'; 0 'holdMs' disables it
+    void setPeakHold(int holdMs, float decayMs);
+
+    // clip indicators stay lit until reset here or by clicking the meter
+    void resetClips();
+
+    // kept for compatibility, sets a release time of 'value' * 100 ms
     void setSmoothRelease(int value);
 
     QSize minimumSizeHint() const;
@@ -48,24 +78,52 @@ public:
 
 protected:
     void updateSizes();
+    void updatePixmaps();
+
+    int levelToPixel(float level) const;
+    QRect setMeterLevel(int index, float level, qint64 now);
 
+    QRect getBarRect(int index, int from, int to) const;
+    QRect getClipRect(int index) const;
+
+    void mousePressEvent(QMouseEvent* event);
     void paintEvent(QPaintEvent* event);
     void resizeEvent(QResizeEvent* event);
 
 private:
+    struct MeterData {
+        float  level;    // after ballistics
+        float  peak;     // held peak
+        qint64 peakTime; // when the peak was last raised, in ns
+        qint64 lastTime; // last update, in ns
+        int    pixel;    // bar end, as drawn
+        int    peakPixel;
+        bool   clipped;
+    };
+
     int fChannels;
-    int fSmoothMultiplier;
     int fWidth, fHeight, fSizeMeter;
     Orientation fOrientation;
 
+    float fAttackMs, fReleaseMs;
+    int   fPeakHoldMs;
+    float fPeakDecayMs;
+
     QColor fColorBackground;
     QLinearGradient fGradientMeter;
 
     QColor fColorBase;
     QColor fColorBaseAlt;
 
-    float* fChannelsData;
-    float* fLastValueData;
+    // pre-rendered layers, see updatePixmaps()
+    QPixmap fPixmapBackground;
+    QPixmap fPixmapBars;
+
+    // linear level needed to light each pixel of a bar, rebuilt on resize
+    std::vector<float> fLevelTable;
+
+    QElapsedTimer fTimer;
+    MeterData* fMeters;
 };
 
 #endif // __DIGITALPEAKMETER_HPP__
@@ -0,0 +1,168 @@
+/*
+ * Goniometer and phase correlation meter, a custom Qt4 widget
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#include "goniometer.hpp"
+
+#include <QtGui/QPainter>
+#include <QtGui/QPaintEvent>
+
+Goniometer::Goniometer(QWidget* parent)
+    : QWidget(parent),
+      fCorrelation(0.0f),
+      fScopeSize(0),
+      fBarHeight(12),
+      fColorBase(93, 231, 61),
+      fColorBaseAlt(15, 110, 15, 100)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void Goniometer::setColor(Color color)
+{
+    if (color == GREEN)
+    {
+        fColorBase    = QColor(93, 231, 61);
+        fColorBaseAlt = QColor(15, 110, 15, 100);
+    }
+    else if (color == BLUE)
+    {
+        fColorBase    = QColor(82, 238, 248);
+        fColorBaseAlt = QColor(15, 15, 110, 100);
+    }
+    else
+        return qCritical("Goniometer::setColor(%i) - invalid color", color);
+
+    updateBackground();
+    update();
+}
+
+void Goniometer::displayCorrelation(float correlation)
+{
+    if (correlation < -1.0f)
+        correlation = -1.0f;
+    else if (correlation > 1.0f)
+        correlation = 1.0f;
+
+    if (fCorrelation != correlation)
+    {
+        fCorrelation = correlation;
+        update();
+    }
+}
+
+void Goniometer::displayPoints(const float* left, const float* right, int count)
+{
+    // rotated by 45 degrees, so mono is vertical and side is horizontal
+    const float half  = fScopeSize / 2.0f;
+    const float scale = half * 0.7071f;
+
+    fPoints.resize(count);
+
+    for (int i=0; i < count; ++i)
+    {
+        const float side = (right[i] - left[i]) * scale;
+        const float mid  = (right[i] + left[i]) * scale;
+
+        fPoints[i] = QPointF(half + side, half - mid);
+    }
+
+    update();
+}
+
+QSize Goniometer::minimumSizeHint() const
+{
+    return QSize(100, 100 + fBarHeight);
+}
+
+QSize Goniometer::sizeHint() const
+{
+    return QSize(300, 300 + fBarHeight);
+}
+
+// Axes and correlation scale are static, so they are drawn once per resize or color change
+void Goniometer::updateBackground()
+{
+    const int w = width();
+    const int h = height();
+
+    fScopeSize = qMin(w, h - fBarHeight);
+
+    if (w <= 0 || h <= 0 || fScopeSize <= 0)
+    {
+        fBackground = QPixmap();
+        return;
+    }
+
+    fBackground = QPixmap(w, h);
+    fBackground.fill(Qt::black);
+
+    QPainter painter(&fBackground);
+    painter.setPen(fColorBaseAlt);
+
+    const int s = fScopeSize;
+
+    // M/S cross and L/R diagonals
+    painter.drawLine(s/2, 0, s/2, s);
+    painter.drawLine(0, s/2, s, s/2);
+    painter.drawLine(0, 0, s, s);
+    painter.drawLine(s, 0, 0, s);
+
+    painter.drawText(4, 14, "L");
+    painter.drawText(s - 12, 14, "R");
+
+    // correlation scale, -1 to +1
+    const int barY = h - fBarHeight;
+
+    painter.drawLine(0, barY, w, barY);
+    painter.drawLine(w/4, barY, w/4, h);
+    painter.drawLine(w/2, barY, w/2, h);
+    painter.drawLine(w*3/4, barY, w*3/4, h);
+}
+
+void Goniometer::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    event->accept();
+
+    painter.drawPixmap(0, 0, fBackground);
+
+    // all points in one go
+    if (fPoints.size() > 0)
+    {
+        painter.setPen(fColorBase);
+        painter.drawPoints(&fPoints[0], int(fPoints.size()));
+    }
+
+    // correlation bar grows from the center, red when out of phase
+    const int w    = width();
+    const int barY = height() - fBarHeight + 2;
+    const int barX = int((fCorrelation + 1.0f) / 2.0f * w);
+
+    painter.setPen(Qt::NoPen);
+    painter.setBrush((fCorrelation < 0.0f) ? QColor(Qt::red) : fColorBase);
+
+    if (barX >= w/2)
+        painter.drawRect(w/2, barY, barX - w/2, fBarHeight - 4);
+    else
+        painter.drawRect(barX, barY, w/2 - barX, fBarHeight - 4);
+}
+
+void Goniometer::resizeEvent(QResizeEvent* event)
+{
+    updateBackground();
+    QWidget::resizeEvent(event);
+}
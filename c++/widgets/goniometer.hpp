@@ -0,0 +1,64 @@
+/*
+ * Goniometer and phase correlation meter, a custom Qt4 widget
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __GONIOMETER_HPP__
+#define __GONIOMETER_HPP__
+
+#include <QtGui/QPixmap>
+#include <QtWidgets/QWidget>
+
+#include <vector>
+
+class Goniometer : public QWidget
+{
+public:
+    enum Color {
+        GREEN = 1,
+        BLUE  = 2
+    };
+
+    Goniometer(QWidget* parent);
+
+    void setColor(Color color);
+
+    // -1.0 (out of phase) to +1.0 (mono)
+    void displayCorrelation(float correlation);
+
+    // plots 'count' stereo samples, replacing the previous ones
+    void displayPoints(const float* left, const float* right, int count);
+
+    QSize minimumSizeHint() const;
+    QSize sizeHint() const;
+
+protected:
+    void updateBackground();
+
+    void paintEvent(QPaintEvent* event);
+    void resizeEvent(QResizeEvent* event);
+
+private:
+    float fCorrelation;
+    int fScopeSize, fBarHeight;
+
+    QColor fColorBase;
+    QColor fColorBaseAlt;
+    QPixmap fBackground;
+
+    std::vector<QPointF> fPoints;
+};
+
+#endif // __GONIOMETER_HPP__
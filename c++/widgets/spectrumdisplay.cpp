@@ -0,0 +1,230 @@
+/*
+ * Spectrum Display, a custom Qt4 widget
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#include "spectrumdisplay.hpp"
+
+#include <QtGui/QPainter>
+#include <QtGui/QPaintEvent>
+
+#include <cmath>
+
+SpectrumDisplay::SpectrumDisplay(QWidget* parent)
+    : QWidget(parent),
+      fBands(0),
+      fMinFreq(20.0f),
+      fMaxFreq(20000.0f),
+      fMinDb(-90.0f),
+      fColorBase(93, 231, 61),
+      fColorBaseAlt(15, 110, 15, 100),
+      fLevels(nullptr),
+      fPeaks(nullptr)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+SpectrumDisplay::~SpectrumDisplay()
+{
+    if (fLevels != nullptr)
+        delete[] fLevels;
+    if (fPeaks != nullptr)
+        delete[] fPeaks;
+}
+
+void SpectrumDisplay::setBands(int count, float minFreq, float maxFreq, float minDb)
+{
+    Q_ASSERT(count >= 0);
+
+    if (count < 0 || minFreq <= 0.0f || maxFreq <= minFreq || minDb >= 0.0f)
+        return qCritical("SpectrumDisplay::setBands(%i, %f, %f, %f) - invalid arguments", count, minFreq, maxFreq, minDb);
+
+    if (fLevels != nullptr)
+        delete[] fLevels;
+    if (fPeaks != nullptr)
+        delete[] fPeaks;
+
+    fBands   = count;
+    fMinFreq = minFreq;
+    fMaxFreq = maxFreq;
+    fMinDb   = minDb;
+
+    if (count > 0)
+    {
+        fLevels = new float[count];
+        fPeaks  = new float[count];
+
+        for (int i=0; i < count; ++i)
+        {
+            fLevels[i] = minDb;
+            fPeaks[i]  = minDb;
+        }
+    }
+    else
+    {
+        fLevels = nullptr;
+        fPeaks  = nullptr;
+    }
+
+    updateBackground();
+    updateGeometry();
+    update();
+}
+
+void SpectrumDisplay::setColor(Color color)
+{
+    if (color == GREEN)
+    {
+        fColorBase    = QColor(93, 231, 61);
+        fColorBaseAlt = QColor(15, 110, 15, 100);
+    }
+    else if (color == BLUE)
+    {
+        fColorBase    = QColor(82, 238, 248);
+        fColorBaseAlt = QColor(15, 15, 110, 100);
+    }
+    else
+        return qCritical("SpectrumDisplay::setColor(%i) - invalid color", color);
+
+    updateBackground();
+    update();
+}
+
+void SpectrumDisplay::displayBands(const float* levels, const float* peaks)
+{
+    bool changed = false;
+
+    for (int i=0; i < fBands; ++i)
+    {
+        if (fLevels[i] != levels[i] || fPeaks[i] != peaks[i])
+        {
+            fLevels[i] = levels[i];
+            fPeaks[i]  = peaks[i];
+            changed = true;
+        }
+    }
+
+    if (changed)
+        update();
+}
+
+QSize SpectrumDisplay::minimumSizeHint() const
+{
+    return QSize(fBands > 100 ? fBands : 100, 60);
+}
+
+QSize SpectrumDisplay::sizeHint() const
+{
+    return QSize(480, 240);
+}
+
+// The grid never changes between frames, so it is drawn once per resize or color change
+void SpectrumDisplay::updateBackground()
+{
+    const int w = width();
+    const int h = height();
+
+    if (w <= 0 || h <= 0)
+    {
+        fBackground = QPixmap();
+        return;
+    }
+
+    fBackground = QPixmap(w, h);
+    fBackground.fill(Qt::black);
+
+    QPainter painter(&fBackground);
+    painter.setPen(fColorBaseAlt);
+
+    // level lines, every 10 dB
+    for (int db = -10; db > fMinDb; db -= 10)
+    {
+        const int y = int(float(db) / fMinDb * h);
+        painter.drawLine(0, y, w, y);
+    }
+
+    // frequency lines, 1-2-5 steps per decade, labelled at each decade
+    const float logRange = std::log10(fMaxFreq / fMinFreq);
+
+    for (float decade = 10.0f; decade < fMaxFreq; decade *= 10.0f)
+    {
+        static const float kSteps[3] = { 1.0f, 2.0f, 5.0f };
+
+        for (int i=0; i < 3; ++i)
+        {
+            const float freq = decade * kSteps[i];
+
+            if (freq < fMinFreq || freq > fMaxFreq)
+                continue;
+
+            const int x = int(std::log10(freq / fMinFreq) / logRange * w);
+            painter.drawLine(x, 0, x, h);
+
+            if (i == 0)
+                painter.drawText(x + 2, h - 2, (freq >= 1000.0f) ? QString("%1k").arg(int(freq / 1000.0f)) : QString::number(int(freq)));
+        }
+    }
+}
+
+void SpectrumDisplay::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    event->accept();
+
+    painter.drawPixmap(0, 0, fBackground);
+
+    if (fBands == 0)
+        return;
+
+    const int w = width();
+    const int h = height();
+
+    QLinearGradient gradient(0, 0, 0, h);
+    gradient.setColorAt(0.0f, Qt::red);
+    gradient.setColorAt(0.1f, Qt::yellow);
+    gradient.setColorAt(0.3f, fColorBase);
+    gradient.setColorAt(1.0f, fColorBase);
+
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(gradient);
+
+    for (int i=0; i < fBands; ++i)
+    {
+        const int x1 = i * w / fBands;
+        const int x2 = (i+1) * w / fBands;
+        const int y  = int(fLevels[i] / fMinDb * h);
+
+        if (y < h)
+            painter.drawRect(x1, y, (x2 - x1 > 1) ? x2 - x1 - 1 : 1, h - y);
+    }
+
+    painter.setPen(Qt::white);
+
+    for (int i=0; i < fBands; ++i)
+    {
+        const int x1 = i * w / fBands;
+        const int x2 = (i+1) * w / fBands;
+        const int y  = int(fPeaks[i] / fMinDb * h);
+
+        if (y < h)
+            painter.drawLine(x1, y, (x2 - x1 > 1) ? x2 - 2 : x1, y);
+    }
+}
+
+void SpectrumDisplay::resizeEvent(QResizeEvent* event)
+{
+    updateBackground();
+    QWidget::resizeEvent(event);
+}
@@ -0,0 +1,63 @@
+/*
+ * Spectrum Display, a custom Qt4 widget
+ * Copyright (C) 2011-2015 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the COPYING file
+ */
+
+#ifndef __SPECTRUMDISPLAY_HPP__
+#define __SPECTRUMDISPLAY_HPP__
+
+#include <QtGui/QPixmap>
+#include <QtWidgets/QWidget>
+
+class SpectrumDisplay : public QWidget
+{
+public:
+    enum Color {
+        GREEN = 1,
+        BLUE  = 2
+    };
+
+    SpectrumDisplay(QWidget* parent);
+    ~SpectrumDisplay();
+
+    // 'count' log-spaced bands between 'minFreq' and 'maxFreq', levels from 'minDb' to 0 dB
+    void setBands(int count, float minFreq, float maxFreq, float minDb);
+    void setColor(Color color);
+
+    // 'levels' and 'peaks' hold one value in dB per band
+    void displayBands(const float* levels, const float* peaks);
+
+    QSize minimumSizeHint() const;
+    QSize sizeHint() const;
+
+protected:
+    void updateBackground();
+
+    void paintEvent(QPaintEvent* event);
+    void resizeEvent(QResizeEvent* event);
+
+private:
+    int fBands;
+    float fMinFreq, fMaxFreq, fMinDb;
+
+    QColor fColorBase;
+    QColor fColorBaseAlt;
+    QPixmap fBackground;
+
+    float* fLevels;
+    float* fPeaks;
+};
+
+#endif // __SPECTRUMDISPLAY_HPP__
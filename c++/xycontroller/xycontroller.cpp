@@ -28,8 +28,10 @@
 #include "ui_xycontroller.h"
 
 #include <QtCore/QSettings>
+#include <QtCore/QSocketNotifier>
 #include <QtCore/QTimer>
 #include <QtGui/QKeyEvent>
+#include <QtWidgets/QActionGroup>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QGraphicsItem>
 #include <QtWidgets/QGraphicsScene>
@@ -37,19 +39,129 @@
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QMessageBox>
 
-// -------------------------------
+#include <atomic>
+#include <cmath>
 
-float abs_f(const float value)
-{
-    return (value < 1.0f) ? -value : value;
-}
+#ifndef Q_OS_WIN
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+# include <sys/eventfd.h>
+#endif
+
+// -------------------------------
 
 jack_client_t* jClient = nullptr;
 jack_port_t* jMidiInPort  = nullptr;
 jack_port_t* jMidiOutPort = nullptr;
 
-static Queue qMidiInData;
-static Queue qMidiOutData;
+// GUI to JACK and JACK to GUI, never locked
+static MidiQueue qMidiInData;
+static MidiQueue qMidiOutData;
+
+// Wakes up the GUI when MIDI input arrives, read end first.
+// An eventfd on Linux, a pipe elsewhere; without it the GUI polls instead.
+static int gMidiInNotifyFds[2] = { -1, -1 };
+
+// set by the process callback when it writes a wakeup, cleared by the GUI,
+// so there is at most one wakeup in flight
+static std::atomic<bool> x_midiInNotified(false);
+
+bool midi_in_notify_init()
+{
+#if defined(Q_OS_LINUX)
+    const int fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    gMidiInNotifyFds[0] = gMidiInNotifyFds[1] = fd;
+    return true;
+#elif ! defined(Q_OS_WIN)
+    if (pipe(gMidiInNotifyFds) != 0)
+        return false;
+
+    for (int i=0; i < 2; ++i)
+    {
+        fcntl(gMidiInNotifyFds[i], F_SETFL, fcntl(gMidiInNotifyFds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(gMidiInNotifyFds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void midi_in_notify_close()
+{
+#ifndef Q_OS_WIN
+    if (gMidiInNotifyFds[0] >= 0)
+        ::close(gMidiInNotifyFds[0]);
+    if (gMidiInNotifyFds[1] >= 0 && gMidiInNotifyFds[1] != gMidiInNotifyFds[0])
+        ::close(gMidiInNotifyFds[1]);
+#endif
+
+    gMidiInNotifyFds[0] = gMidiInNotifyFds[1] = -1;
+}
+
+// stamped with the current frame time, played one period later to keep the timing
+void send_midi_out(unsigned char d1, unsigned char d2, unsigned char d3)
+{
+    const unsigned char data[3] = { d1, d2, d3 };
+    qMidiOutData.put(jackbridge_frame_time(jClient), data, 3);
+}
+
+// how XY values are sent
+enum XYControlMode {
+    XY_MODE_CC   = 0, // 7-bit CC
+    XY_MODE_CC14 = 1, // 14-bit CC, MSB on the selected control and LSB on control + 32
+    XY_MODE_NRPN = 2  // 14-bit NRPN, the selected control is the parameter number
+};
+
+// XY position, the GUI only sets targets and the process callback generates the CCs
+struct XYAxis {
+    std::atomic<int>   control;
+    std::atomic<float> target;  // -1.0 to 1.0
+    std::atomic<float> current; // smoothed position, for display
+    std::atomic<bool>  jump;    // go to target without sending anything
+
+    // only used by the process callback
+    float value;
+    int   lastSent;
+
+    XYAxis(const int cc)
+        : control(cc),
+          target(0.0f),
+          current(0.0f),
+          jump(true),
+          value(0.0f),
+          lastSent(-1) {}
+};
+
+static XYAxis x_axisX(1);
+static XYAxis x_axisY(2);
+
+static std::atomic<int>      x_controlMode(XY_MODE_CC);
+static std::atomic<bool>     x_smooth(false);
+static std::atomic<float>    x_smoothTime(200.0f);  // ms
+static std::atomic<uint32_t> x_controlRate(250);    // CCs per second per axis, at most
+static std::atomic<uint32_t> x_channelMask(0x0001); // MIDI channels 1 to 16
+static std::atomic<uint32_t> x_maxMessageRate(0);   // messages per second, 0 for no limit
+
+void xy_set_target(XYAxis& axis, float value, const bool send)
+{
+    if (value < -1.0f)
+        value = -1.0f;
+    else if (value > 1.0f)
+        value = 1.0f;
+
+    axis.target.store(value, std::memory_order_relaxed);
+
+    if (! send)
+        axis.jump.store(true, std::memory_order_release);
+}
 
 QVector<QString> MIDI_CC_LIST;
 void MIDI_CC_LIST__init()
@@ -163,8 +275,10 @@ public:
 
         m_mouseLock = false;
         m_smooth    = false;
-        m_smooth_x  = 0.0f;
-        m_smooth_y  = 0.0f;
+
+        m_controlMode = XY_MODE_CC;
+        m_nrpnParam   = -1;
+        m_lastMsb[0]  = m_lastMsb[1] = 0;
 
         setBackgroundBrush(Qt::black);
 
@@ -182,16 +296,28 @@ public:
     void setControlX(int x)
     {
         cc_x = x;
+        x_axisX.control.store(x);
     }
 
     void setControlY(int y)
     {
         cc_y = y;
+        x_axisY.control.store(y);
     }
 
     void setChannels(QList<int> channels)
     {
         m_channels = channels;
+
+        uint32_t mask = 0;
+
+        foreach (const int& channel, channels)
+        {
+            if (channel >= 1 && channel <= 16)
+                mask |= 1 << (channel - 1);
+        }
+
+        x_channelMask.store(mask);
     }
 
     void setPosX(float x, bool forward=true)
@@ -203,13 +329,10 @@ public:
         m_cursor->setPos(posX, m_cursor->y());
         m_lineV->setX(posX);
 
+        xy_set_target(x_axisX, x, forward);
+
         if (forward)
-        {
-            float value = posX / (p_size.x() + p_size.width());
-            sendMIDI(&value, nullptr);
-        }
-        else
-            m_smooth_x = posX;
+            emit targetMoved();
     }
 
     void setPosY(float y, bool forward=true)
@@ -221,28 +344,64 @@ public:
         m_cursor->setPos(m_cursor->x(), posY);
         m_lineH->setY(posY);
 
+        xy_set_target(x_axisY, y, forward);
+
         if (forward)
-        {
-            float value = posY / (p_size.y() + p_size.height());
-            sendMIDI(nullptr, &value);
-        }
-        else
-            m_smooth_y = posY;
+            emit targetMoved();
     }
 
     void setSmooth(bool smooth)
     {
         m_smooth = smooth;
+        x_smooth.store(smooth);
     }
 
-    void setSmoothValues(float x, float y)
+    void setControlMode(int mode)
     {
-        m_smooth_x = x * (p_size.x() + p_size.width());
-        m_smooth_y = y * (p_size.y() + p_size.height());
+        m_controlMode = mode;
+        m_nrpnParam   = -1;
+        x_controlMode.store(mode);
     }
 
     void handleCC(int param, int value)
     {
+        if (m_controlMode == XY_MODE_NRPN)
+        {
+            // parameter number first, then data entry MSB and optional LSB
+            switch (param)
+            {
+            case 0x63:
+                m_nrpnParam = value << 7;
+                return;
+            case 0x62:
+                if (m_nrpnParam >= 0)
+                    m_nrpnParam = (m_nrpnParam & 0x3F80) | value;
+                return;
+            case 0x06:
+                handleValue14(m_nrpnParam, value << 7);
+                return;
+            case 0x26:
+                handleValue14(m_nrpnParam, (m_lastMsb[m_nrpnParam == cc_y ? 1 : 0] << 7) | value);
+                return;
+            }
+        }
+
+        if (m_controlMode == XY_MODE_CC14)
+        {
+            // MSB first, then optional LSB; controls from 32 up have no LSB
+            if (param < 0x20 && (param == cc_x || param == cc_y))
+            {
+                handleValue14(param, value << 7);
+                return;
+            }
+
+            if (param >= 0x20 && param < 0x40 && (param-0x20 == cc_x || param-0x20 == cc_y))
+            {
+                handleValue14(param-0x20, (m_lastMsb[param-0x20 == cc_y ? 1 : 0] << 7) | value);
+                return;
+            }
+        }
+
         bool sendUpdate = false;
         float xp, yp;
         xp = yp = 0.0f;
@@ -284,38 +443,61 @@ public:
         p_size.setRect(-(float(size.width())/2), -(float(size.height())/2), size.width(), size.height());
     }
 
-    void updateSmooth()
+    // shows the smoothed position, the CCs for it are already sent by the process callback.
+    // Returns false once the cursor has reached its target.
+    bool updateSmooth()
     {
         if (! m_smooth)
-            return;
+            return false;
 
-        if (m_cursor->x() == m_smooth_x && m_cursor->y() == m_smooth_y)
-            return;
+        const float xp = x_axisX.current.load(std::memory_order_relaxed);
+        const float yp = x_axisY.current.load(std::memory_order_relaxed);
 
-        if (abs_f(m_cursor->x() - m_smooth_x) <= 0.0005f)
-            m_smooth_x = m_cursor->x();
-        if (abs_f(m_cursor->y() - m_smooth_y) <= 0.0005f)
-            m_smooth_y = m_cursor->y();
+        const bool moving = (xp != x_axisX.target.load(std::memory_order_relaxed) ||
+                             yp != x_axisY.target.load(std::memory_order_relaxed));
 
-        if (m_cursor->x() == m_smooth_x && m_cursor->y() == m_smooth_y)
-            return;
+        const QPointF pos(xp * (p_size.x() + p_size.width()), yp * (p_size.y() + p_size.height()));
 
-        float newX = float(m_smooth_x + m_cursor->x()*7) / 8;
-        float newY = float(m_smooth_y + m_cursor->y()*7) / 8;
-        QPointF pos(newX, newY);
+        if (m_cursor->x() == pos.x() && m_cursor->y() == pos.y())
+            return moving;
 
         m_cursor->setPos(pos);
         m_lineH->setY(pos.y());
         m_lineV->setX(pos.x());
 
-        float xp = pos.x() / (p_size.x() + p_size.width());
-        float yp = pos.y() / (p_size.y() + p_size.height());
-
-        sendMIDI(&xp, &yp);
         emit cursorMoved(xp, yp);
+        return moving;
     }
 
 protected:
+    // 'value' is 0 to 16383
+    void handleValue14(int param, int value)
+    {
+        if (param < 0 || (param != cc_x && param != cc_y))
+            return;
+
+        const float pos = float(value) / 8191.5f - 1.0f;
+
+        float xp = m_cursor->x() / (p_size.x() + p_size.width());
+        float yp = m_cursor->y() / (p_size.y() + p_size.height());
+
+        if (param == cc_x)
+        {
+            m_lastMsb[0] = value >> 7;
+            xp = pos;
+            setPosX(xp, false);
+        }
+
+        if (param == cc_y)
+        {
+            m_lastMsb[1] = value >> 7;
+            yp = pos;
+            setPosY(yp, false);
+        }
+
+        emit cursorMoved(xp, yp);
+    }
+
     void handleMousePos(QPointF pos)
     {
         if (! p_size.contains(pos))
@@ -331,8 +513,12 @@ protected:
                 pos.setY(p_size.y() + p_size.height());
         }
 
-        m_smooth_x = pos.x();
-        m_smooth_y = pos.y();
+        float xp = pos.x() / (p_size.x() + p_size.width());
+        float yp = pos.y() / (p_size.y() + p_size.height());
+
+        xy_set_target(x_axisX, xp, true);
+        xy_set_target(x_axisY, yp, true);
+        emit targetMoved();
 
         if (! m_smooth)
         {
@@ -340,33 +526,10 @@ protected:
             m_lineH->setY(pos.y());
             m_lineV->setX(pos.x());
 
-            float xp = pos.x() / (p_size.x() + p_size.width());
-            float yp = pos.y() / (p_size.y() + p_size.height());
-
-            sendMIDI(&xp, &yp);
             emit cursorMoved(xp, yp);
         }
     }
 
-    void sendMIDI(float* xp=nullptr, float* yp=nullptr)
-    {
-        float rate = float(0xff) / 4;
-
-        if (xp != nullptr)
-        {
-            int value = *xp * rate + rate;
-            foreach (const int& channel, m_channels)
-                qMidiOutData.put(0xB0 + channel - 1, cc_x, value);
-        }
-
-        if (yp != nullptr)
-        {
-            int value = *yp * rate + rate;
-            foreach (const int& channel, m_channels)
-                qMidiOutData.put(0xB0 + channel - 1, cc_y, value);
-        }
-    }
-
     void keyPressEvent(QKeyEvent* event)
     {
         event->accept();
@@ -400,6 +563,7 @@ protected:
 
 signals:
     void cursorMoved(float, float);
+    void targetMoved();
 
 private:
     int cc_x;
@@ -408,8 +572,11 @@ private:
 
     bool  m_mouseLock;
     bool  m_smooth;
-    float m_smooth_x;
-    float m_smooth_y;
+
+    // 14-bit input state
+    int m_controlMode;
+    int m_nrpnParam;
+    int m_lastMsb[2];
 
     QGraphicsEllipseItem* m_cursor;
     QGraphicsLineItem* m_lineH;
@@ -451,6 +618,9 @@ public:
         cc_x = 1;
         cc_y = 2;
 
+        m_lastInOverflows  = 0;
+        m_lastOutOverflows = 0;
+
         // -------------------------------------------------------------
         // Set-up GUI stuff
 
@@ -460,6 +630,11 @@ public:
         ui->dial_y->setLabel("Y");
         ui->keyboard->setOctaves(10);
 
+        QActionGroup* const resolutionGroup = new QActionGroup(this);
+        resolutionGroup->addAction(ui->act_res_cc);
+        resolutionGroup->addAction(ui->act_res_cc14);
+        resolutionGroup->addAction(ui->act_res_nrpn);
+
         ui->graphicsView->setScene(&scene);
         ui->graphicsView->setRenderHints(QPainter::Antialiasing);
 
@@ -482,6 +657,10 @@ public:
 
         connect(ui->cb_smooth, SIGNAL(clicked(bool)), SLOT(slot_setSmooth(bool)));
 
+        connect(ui->act_res_cc, SIGNAL(triggered(bool)), SLOT(slot_setControlMode()));
+        connect(ui->act_res_cc14, SIGNAL(triggered(bool)), SLOT(slot_setControlMode()));
+        connect(ui->act_res_nrpn, SIGNAL(triggered(bool)), SLOT(slot_setControlMode()));
+
         connect(ui->dial_x, SIGNAL(valueChanged(int)), SLOT(slot_updateSceneX(int)));
         connect(ui->dial_y, SIGNAL(valueChanged(int)), SLOT(slot_updateSceneY(int)));
 
@@ -489,6 +668,7 @@ public:
         connect(ui->cb_control_y, SIGNAL(currentIndexChanged(QString)), SLOT(slot_checkCC_Y(QString)));
 
         connect(&scene, SIGNAL(cursorMoved(float,float)), SLOT(slot_sceneCursorMoved(float,float)));
+        connect(&scene, SIGNAL(targetMoved()), SLOT(slot_startSmoothTimer()));
 
         connect(ui->act_ch_01, SIGNAL(triggered(bool)), SLOT(slot_checkChannel(bool)));
         connect(ui->act_ch_02, SIGNAL(triggered(bool)), SLOT(slot_checkChannel(bool)));
@@ -515,7 +695,20 @@ public:
         // -------------------------------------------------------------
         // Final stuff
 
-        m_midiInTimerId = startTimer(30);
+        // woken up by the process callback, or polling if that is not available
+        if (gMidiInNotifyFds[0] >= 0)
+        {
+            m_midiInTimerId = 0;
+            m_midiInNotifier = new QSocketNotifier(gMidiInNotifyFds[0], QSocketNotifier::Read, this);
+            connect(m_midiInNotifier, SIGNAL(activated(int)), SLOT(slot_midiInReady()));
+        }
+        else
+        {
+            m_midiInTimerId = startTimer(30);
+            m_midiInNotifier = nullptr;
+        }
+
+        m_smoothTimerId = 0;
         QTimer::singleShot(0, this, SLOT(slot_updateScreen()));
     }
 
@@ -528,31 +721,32 @@ public:
         int dial_y = ui->dial_y->value();
         slot_updateSceneX(dial_x);
         slot_updateSceneY(dial_y);
-        scene.setSmoothValues(float(dial_x) / 100, float(dial_y) / 100);
     }
 
 protected slots:
     void slot_noteOn(int note)
     {
         foreach (const int& channel, m_channels)
-            qMidiOutData.put(0x90 + channel - 1, note, 100);
+            send_midi_out(0x90 + channel - 1, note, 100);
+
+        checkOverflows();
     }
 
     void slot_noteOff(int note)
     {
         foreach (const int& channel, m_channels)
-            qMidiOutData.put(0x80 + channel - 1, note, 0);
+            send_midi_out(0x80 + channel - 1, note, 0);
+
+        checkOverflows();
     }
 
     void slot_updateSceneX(int x)
     {
-        scene.setSmoothValues(float(x) / 100, float(ui->dial_y->value()) / 100);
         scene.setPosX(float(x) / 100, bool(sender()));
     }
 
     void slot_updateSceneY(int y)
     {
-        scene.setSmoothValues(float(ui->dial_x->value()) / 100, float(y) / 100);
         scene.setPosY(float(y) / 100, bool(sender()));
     }
 
@@ -660,6 +854,41 @@ protected slots:
     void slot_setSmooth(bool yesno)
     {
         scene.setSmooth(yesno);
+
+        if (yesno)
+            slot_startSmoothTimer();
+    }
+
+    // animates the cursor while it moves towards its target, then stops
+    void slot_startSmoothTimer()
+    {
+        if (m_smoothTimerId == 0 && ui->cb_smooth->isChecked())
+            m_smoothTimerId = startTimer(30);
+    }
+
+    void slot_midiInReady()
+    {
+        // Drain the fd, then clear the flag, then read the queue. Input queued before the
+        // flag is cleared is read below; input queued after it writes the fd again, and
+        // that write cannot be eaten by the drain, so no wakeup is ever lost.
+#ifndef Q_OS_WIN
+        uint64_t value;
+        while (::read(gMidiInNotifyFds[0], &value, sizeof(value)) > 0) {}
+#endif
+
+        x_midiInNotified.store(false, std::memory_order_release);
+
+        readMidiIn();
+    }
+
+    void slot_setControlMode()
+    {
+        if (ui->act_res_cc14->isChecked())
+            scene.setControlMode(XY_MODE_CC14);
+        else if (ui->act_res_nrpn->isChecked())
+            scene.setControlMode(XY_MODE_NRPN);
+        else
+            scene.setControlMode(XY_MODE_CC);
     }
 
     void slot_sceneCursorMoved(float xp, float yp)
@@ -703,6 +932,10 @@ protected:
         settings.setValue("Geometry", saveGeometry());
         settings.setValue("ShowKeyboard", ui->scrollArea->isVisible());
         settings.setValue("Smooth", ui->cb_smooth->isChecked());
+        settings.setValue("ControlMode", x_controlMode.load());
+        settings.setValue("MaxMessageRate", x_maxMessageRate.load());
+        settings.setValue("SmoothTime", x_smoothTime.load());
+        settings.setValue("ControlRate", x_controlRate.load());
         settings.setValue("DialX", ui->dial_x->value());
         settings.setValue("DialY", ui->dial_y->value());
         settings.setValue("ControlX", cc_x);
@@ -722,6 +955,17 @@ protected:
         ui->cb_smooth->setChecked(smooth);
         scene.setSmooth(smooth);
 
+        const int controlMode = settings.value("ControlMode", XY_MODE_CC).toInt();
+        ui->act_res_cc14->setChecked(controlMode == XY_MODE_CC14);
+        ui->act_res_nrpn->setChecked(controlMode == XY_MODE_NRPN);
+        ui->act_res_cc->setChecked(controlMode != XY_MODE_CC14 && controlMode != XY_MODE_NRPN);
+        slot_setControlMode();
+
+        // no GUI for these, only stored in the settings file
+        x_smoothTime.store(qBound(1.0, settings.value("SmoothTime", 200.0).toDouble(), 5000.0));
+        x_controlRate.store(qBound(10, settings.value("ControlRate", 250).toInt(), 2000));
+        x_maxMessageRate.store(qBound(0, settings.value("MaxMessageRate", 0).toInt(), 100000));
+
         ui->dial_x->setValue(settings.value("DialX", 50).toInt());
         ui->dial_y->setValue(settings.value("DialY", 50).toInt());
 
@@ -804,38 +1048,72 @@ protected:
             ui->act_ch_16->setChecked(true);
     }
 
+    void readMidiIn()
+    {
+        const MidiEvent* events[MidiQueue::MAX_SIZE];
+        const uint32_t count = qMidiInData.peek(events, MidiQueue::MAX_SIZE);
+
+        for (uint32_t i=0; i < count; ++i)
+        {
+            // only channel messages are of interest here
+            if (events[i]->size != 3)
+                continue;
+
+            const unsigned char* const data(qMidiInData.getData(*events[i]));
+
+            int channel = (data[0] & 0x0F) + 1;
+            int mode    = data[0] & 0xF0;
+
+            if (m_channels.contains(channel))
+            {
+                if (mode == 0x80)
+                    ui->keyboard->sendNoteOff(data[1], false);
+                else if (mode == 0x90)
+                    ui->keyboard->sendNoteOn(data[1], false);
+                else if (mode == 0xB0)
+                    scene.handleCC(data[1], data[2]);
+            }
+        }
+
+        qMidiInData.pop(count);
+
+        checkOverflows();
+    }
+
     void timerEvent(QTimerEvent* event)
     {
         if (event->timerId() == m_midiInTimerId)
         {
-            if (! qMidiInData.isEmpty())
+            readMidiIn();
+        }
+        else if (event->timerId() == m_smoothTimerId)
+        {
+            checkOverflows();
+
+            if (! scene.updateSmooth())
             {
-                unsigned char d1, d2, d3;
-                qMidiInInternal.copyDataFrom(&qMidiInData);
-
-                while (qMidiInInternal.get(&d1, &d2, &d3, false))
-                {
-                    int channel = (d1 & 0x0F) + 1;
-                    int mode    = d1 & 0xF0;
-
-                    if (m_channels.contains(channel))
-                    {
-                        if (mode == 0x80)
-                            ui->keyboard->sendNoteOff(d2, false);
-                        else if (mode == 0x90)
-                            ui->keyboard->sendNoteOn(d2, false);
-                        else if (mode == 0xB0)
-                            scene.handleCC(d2, d3);
-                    }
-                }
+                killTimer(m_smoothTimerId);
+                m_smoothTimerId = 0;
             }
-
-            scene.updateSmooth();
         }
 
         QMainWindow::timerEvent(event);
     }
 
+    // called after reading input and after queueing output, since nothing polls anymore
+    void checkOverflows()
+    {
+        const uint32_t inOverflows  = qMidiInData.getOverflowCount();
+        const uint32_t outOverflows = qMidiOutData.getOverflowCount();
+
+        if (inOverflows != m_lastInOverflows || outOverflows != m_lastOutOverflows)
+        {
+            qWarning("MIDI queue full, %u input and %u output messages dropped so far", inOverflows, outOverflows);
+            m_lastInOverflows  = inOverflows;
+            m_lastOutOverflows = outOverflows;
+        }
+    }
+
     void resizeEvent(QResizeEvent* event)
     {
         updateScreen();
@@ -854,18 +1132,247 @@ private:
     QList<int> m_channels;
 
     int m_midiInTimerId;
+    int m_smoothTimerId;
+    QSocketNotifier* m_midiInNotifier;
+    uint32_t m_lastInOverflows;
+    uint32_t m_lastOutOverflows;
 
     QSettings settings;
     XYGraphicsScene scene;
     Ui::XYControllerW* const ui;
-
-    Queue qMidiInInternal;
 };
 
 #include "xycontroller.moc"
 
 // -------------------------------
 
+// -1.0..1.0 to 0..127
+static inline
+int xy_to_cc_value(const float value)
+{
+    const float rate = float(0xff) / 4;
+    return int(value * rate + rate);
+}
+
+// -1.0..1.0 to 0..16383
+static inline
+int xy_to_cc14_value(const float value)
+{
+    return int((value + 1.0f) * 8191.5f + 0.5f);
+}
+
+// next CC slot, in frames from the start of the current cycle
+static uint32_t gNextTick = 0;
+
+// room asked for per 3-byte message when checking a whole group fits, more than JACK needs
+// for the message plus its event header, so the check is on the safe side
+#define XY_MIDI_MESSAGE_SPACE 32
+
+// number of messages write_xy_value() sends for one value
+static inline
+uint32_t xy_value_message_count(const int control, const int mode)
+{
+    if (mode == XY_MODE_NRPN)
+        return 4;
+
+    // controls from 32 up have no LSB, they get the MSB only
+    if (mode == XY_MODE_CC14 && control < 0x20)
+        return 2;
+
+    return 1;
+}
+
+// writes one controller value in the given mode, all of its messages or none of them;
+// returns how many were written, 0 if the buffer has no room for all of them
+static uint32_t write_xy_value(void* const midiOutBuffer, const jack_nframes_t frame, const int channel, const int control,
+                           const int value, const int mode)
+{
+    const unsigned char status = 0xB0 + channel;
+    const uint32_t count = xy_value_message_count(control, mode);
+
+    // check first, a MSB without its LSB or a half NRPN select would be worse than nothing
+    if (count > 1 && jackbridge_midi_max_event_size(midiOutBuffer) < count * XY_MIDI_MESSAGE_SPACE)
+        return 0;
+
+    if (mode == XY_MODE_NRPN)
+    {
+        // all 4 messages in the same frame, so the group can never be split across cycles
+        const unsigned char data[4][3] = {
+            { status, 0x63, 0x00 },
+            { status, 0x62, (unsigned char)(control & 0x7F) },
+            { status, 0x06, (unsigned char)(value >> 7) },
+            { status, 0x26, (unsigned char)(value & 0x7F) }
+        };
+
+        for (uint32_t i=0; i < 4; ++i)
+        {
+            if (! jackbridge_midi_event_write(midiOutBuffer, frame, data[i], 3))
+                return i;
+        }
+
+        return 4;
+    }
+
+    if (count == 2)
+    {
+        const unsigned char msb[3] = { status, (unsigned char)control, (unsigned char)(value >> 7) };
+        const unsigned char lsb[3] = { status, (unsigned char)(control + 0x20), (unsigned char)(value & 0x7F) };
+
+        if (! jackbridge_midi_event_write(midiOutBuffer, frame, msb, 3))
+            return 0;
+
+        return jackbridge_midi_event_write(midiOutBuffer, frame, lsb, 3) ? 2 : 1;
+    }
+
+    const unsigned char data[3] = { status, (unsigned char)control, (unsigned char)((mode == XY_MODE_CC14) ? (value >> 7) : value) };
+    return jackbridge_midi_event_write(midiOutBuffer, frame, data, 3) ? 1 : 0;
+}
+
+// Last-value-wins table of controller values waiting to be sent, indexed by channel and control.
+// Only used by the process callback. A value set several times before a flush is sent once,
+// and whatever the rate limit holds back stays pending, in order, until there is room again.
+class CCTable
+{
+public:
+    CCTable()
+        : fPendingCount(0)
+    {
+        std::memset(fEntries, 0, sizeof(fEntries));
+    }
+
+    void set(const int channel, const int control, const int value, const int mode)
+    {
+        const uint16_t index = channel*128 + control;
+        Entry& entry(fEntries[index]);
+
+        entry.value = value;
+        entry.mode  = mode;
+
+        if (! entry.pending)
+        {
+            entry.pending = true;
+            fPending[fPendingCount++] = index;
+        }
+    }
+
+    // writes pending values at 'frame', using at most 'budget' messages; returns how many were used
+    uint32_t flush(void* const midiOutBuffer, const jack_nframes_t frame, const uint32_t budget)
+    {
+        uint32_t used = 0, kept = 0;
+
+        for (uint32_t i=0; i < fPendingCount; ++i)
+        {
+            const uint16_t index = fPending[i];
+            Entry& entry(fEntries[index]);
+
+            const int channel = index / 128;
+            const int control = index % 128;
+            const uint32_t cost = xy_value_message_count(control, entry.mode);
+
+            const uint32_t written = (used + cost <= budget)
+                                   ? write_xy_value(midiOutBuffer, frame, channel, control, entry.value, entry.mode)
+                                   : 0;
+
+            // whatever went out counts against the rate limit, even the start of a group JACK
+            // refused to take whole after all; that one is sent again in full, so the receiver
+            // ends up with the right value
+            used += written;
+
+            if (written != cost)
+            {
+                fPending[kept++] = index;
+                continue;
+            }
+
+            entry.pending = false;
+        }
+
+        fPendingCount = kept;
+        return used;
+    }
+
+private:
+    struct Entry {
+        uint16_t value;
+        uint8_t  mode;
+        bool     pending;
+    };
+
+    Entry    fEntries[16*128];
+    uint16_t fPending[16*128];
+    uint32_t fPendingCount;
+};
+
+static CCTable gCCTable;
+
+// message budget left for the rate limit
+static float gMessageTokens = 0.0f;
+
+// moves an axis towards its target by one slot, and queues its value if it changed and 'send' is set
+static void process_xy_axis(XYAxis& axis, const float coef, const uint32_t channelMask, const int mode, const bool send)
+{
+    const bool jump = axis.jump.exchange(false, std::memory_order_acquire);
+    const float target = axis.target.load(std::memory_order_relaxed);
+
+    if (jump || coef >= 1.0f || std::fabs(target - axis.value) < 0.00005f)
+        axis.value = target;
+    else
+        axis.value += (target - axis.value) * coef;
+
+    axis.current.store(axis.value, std::memory_order_relaxed);
+
+    const int value = (mode == XY_MODE_CC) ? xy_to_cc_value(axis.value) : xy_to_cc14_value(axis.value);
+
+    if (jump)
+    {
+        axis.lastSent = value;
+        return;
+    }
+
+    if (value == axis.lastSent || ! send)
+        return;
+
+    axis.lastSent = value;
+
+    const int control = axis.control.load(std::memory_order_relaxed);
+
+    for (int i=0; i < 16; ++i)
+    {
+        if (channelMask & (1 << i))
+            gCCTable.set(i, control, value, mode);
+    }
+}
+
+// writes queued GUI events that are due before frame 'limit'
+static void write_queued_midi(void* const midiOutBuffer, const jack_nframes_t cycleStart, const jack_nframes_t nframes,
+                              const jack_nframes_t limit, jack_nframes_t& lastFrame)
+{
+    while (const MidiEvent* const event = qMidiOutData.peek())
+    {
+        // sent during the previous period, so it plays at the same offset in this one
+        const int32_t offset = int32_t(event->time + nframes - cycleStart);
+
+        // belongs to the next period; anything further ahead means the clock jumped, play it now
+        if (offset >= int32_t(nframes) && offset < int32_t(nframes*2))
+            break;
+
+        jack_nframes_t frame = (offset > 0 && offset < int32_t(nframes)) ? jack_nframes_t(offset) : lastFrame;
+
+        // JACK needs events in order
+        if (frame < lastFrame)
+            frame = lastFrame;
+
+        if (frame >= limit)
+            break;
+
+        if (! jackbridge_midi_event_write(midiOutBuffer, frame, qMidiOutData.getData(*event), event->size))
+            break;
+
+        lastFrame = frame;
+        qMidiOutData.pop();
+    }
+}
+
 int process_callback(const jack_nframes_t nframes, void*)
 {
     void* const midiInBuffer  = jackbridge_port_get_buffer(jMidiInPort, nframes);
@@ -878,42 +1385,78 @@ int process_callback(const jack_nframes_t nframes, void*)
     jack_midi_event_t midiEvent;
     uint32_t midiEventCount = jackbridge_midi_get_event_count(midiInBuffer);
 
-    qMidiInData.lock();
+    const jack_nframes_t cycleStart = jackbridge_last_frame_time(jClient);
+    bool midiInQueued = false;
 
     for (uint32_t i=0; i < midiEventCount; i++)
     {
         if (! jackbridge_midi_event_get(&midiEvent, midiInBuffer, i))
             break;
 
-        if (midiEvent.size == 1)
-            qMidiInData.put(midiEvent.buffer[0], 0, 0, false);
-        else if (midiEvent.size == 2)
-            qMidiInData.put(midiEvent.buffer[0], midiEvent.buffer[1], 0, false);
-        else if (midiEvent.size >= 3)
-            qMidiInData.put(midiEvent.buffer[0], midiEvent.buffer[1], midiEvent.buffer[2], false);
+        if (midiEvent.size == 0)
+            continue;
 
-        if (qMidiInData.isFull())
+        // full, the rest of this cycle would be dropped too
+        if (! qMidiInData.put(cycleStart + midiEvent.time, midiEvent.buffer, midiEvent.size))
             break;
+
+        midiInQueued = true;
     }
-    qMidiInData.unlock();
+
+#ifndef Q_OS_WIN
+    // one non-blocking write per cycle at most, and none while the GUI has not caught up yet
+    if (midiInQueued && gMidiInNotifyFds[1] >= 0 && ! x_midiInNotified.exchange(true, std::memory_order_acq_rel))
+    {
+        const uint64_t value = 1;
+        const ssize_t ret = ::write(gMidiInNotifyFds[1], &value, sizeof(value));
+        (void)ret;
+    }
+#else
+    (void)midiInQueued;
+#endif
 
     // MIDI Out
     jackbridge_midi_clear_buffer(midiOutBuffer);
-    qMidiOutData.lock();
 
-    if (! qMidiOutData.isEmpty())
+    // XY CCs go out at a steady rate, in time order with the queued events
+    const float sampleRate = jackbridge_get_sample_rate(jClient);
+    const jack_nframes_t interval = qMax(jack_nframes_t(sampleRate / x_controlRate.load(std::memory_order_relaxed)), jack_nframes_t(1));
+    const uint32_t channelMask = x_channelMask.load(std::memory_order_relaxed);
+    const int mode = x_controlMode.load(std::memory_order_relaxed);
+    const uint32_t maxMessageRate = x_maxMessageRate.load(std::memory_order_relaxed);
+
+    // refill the rate limit budget, allowing bursts of up to 50 ms worth of messages
+    if (maxMessageRate > 0)
+        gMessageTokens = qMin(gMessageTokens + float(maxMessageRate) * nframes / sampleRate, qMax(float(maxMessageRate) / 20.0f, 4.0f));
+
+    float coef = 1.0f;
+
+    if (x_smooth.load(std::memory_order_relaxed))
+        coef = 1.0f - std::exp(-float(interval) / (x_smoothTime.load(std::memory_order_relaxed) * sampleRate / 1000.0f));
+
+    jack_nframes_t lastFrame = 0;
+
+    for (; gNextTick < nframes; gNextTick += interval)
     {
-        unsigned char d1, d2, d3, data[3];
+        write_queued_midi(midiOutBuffer, cycleStart, nframes, gNextTick + 1, lastFrame);
 
-        while (qMidiOutData.get(&d1, &d2, &d3, false))
-        {
-            data[0] = d1;
-            data[1] = d2;
-            data[2] = d3;
-            jackbridge_midi_event_write(midiOutBuffer, 0, data, 3);
-        }
+        // 14-bit values change on almost every slot, so those are sent once per cycle at most
+        const bool send = (mode == XY_MODE_CC || gNextTick + interval >= nframes);
+
+        process_xy_axis(x_axisX, coef, channelMask, mode, send);
+        process_xy_axis(x_axisY, coef, channelMask, mode, send);
+
+        if (maxMessageRate > 0)
+            gMessageTokens -= gCCTable.flush(midiOutBuffer, gNextTick, uint32_t(gMessageTokens));
+        else
+            gCCTable.flush(midiOutBuffer, gNextTick, UINT32_MAX);
+
+        lastFrame = gNextTick;
     }
-    qMidiOutData.unlock();
+
+    write_queued_midi(midiOutBuffer, cycleStart, nframes, nframes, lastFrame);
+
+    gNextTick -= nframes;
 
     return 0;
 }
@@ -976,6 +1519,9 @@ int main(int argc, char* argv[])
     jMidiInPort  = jackbridge_port_register(jClient, "midi_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
     jMidiOutPort = jackbridge_port_register(jClient, "midi_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
 
+    if (! midi_in_notify_init())
+        qWarning("Could not create a MIDI input notifier, polling instead");
+
     jackbridge_set_process_callback(jClient, process_callback, nullptr);
 #ifdef HAVE_JACKSESSION
     jackbridge_set_session_callback(jClient, session_callback, argv[0]);
@@ -992,5 +1538,7 @@ int main(int argc, char* argv[])
     jackbridge_deactivate(jClient);
     jackbridge_client_close(jClient);
 
+    midi_in_notify_close();
+
     return ret;
 }